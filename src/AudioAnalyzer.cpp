@@ -3,15 +3,129 @@
 #include <cmath>
 #include <algorithm>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// Splits interleaved frames into one buffer per channel
+void deinterleave(const float* input, int frames, int num_channels, float* const* outputs) {
+    int frame = 0;
+
+    if (num_channels == 2) {
+#if defined(__SSE2__)
+        for (; frame + 4 <= frames; frame += 4) {
+            __m128 a = _mm_loadu_ps(input + frame * 2);      // L0 R0 L1 R1
+            __m128 b = _mm_loadu_ps(input + frame * 2 + 4);  // L2 R2 L3 R3
+            _mm_storeu_ps(outputs[0] + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(outputs[1] + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#elif defined(__ARM_NEON)
+        for (; frame + 4 <= frames; frame += 4) {
+            float32x4x2_t lr = vld2q_f32(input + frame * 2);
+            vst1q_f32(outputs[0] + frame, lr.val[0]);
+            vst1q_f32(outputs[1] + frame, lr.val[1]);
+        }
+#endif
+    }
+
+    for (; frame < frames; frame++) {
+        for (int c = 0; c < num_channels; c++) {
+            outputs[c][frame] = input[frame * num_channels + c];
+        }
+    }
+}
+
+}
+
 AudioAnalyzer::AudioAnalyzer() {
     num_bins = fft_size / 2 + 1;
 }
 
+bool AudioAnalyzer::isValidFftSize(int size) {
+    return size >= MIN_FFT_SIZE && size <= MAX_FFT_SIZE && (size & (size - 1)) == 0;
+}
+
+bool AudioAnalyzer::setFftSize(int size) {
+    if (initialized) {
+        std::cerr << "FFT size must be set before initializing\n";
+        return false;
+    }
+    if (!isValidFftSize(size)) {
+        std::cerr << "FFT size " << size << " must be a power of two from " << MIN_FFT_SIZE << " to "
+                  << MAX_FFT_SIZE << "\n";
+        return false;
+    }
+    fft_size = size;
+    num_bins = fft_size / 2 + 1;
+    analysis_size = fft_size / 2;
+    snapshot_hop = std::max(analysis_size / 2, (int)WAVEFORM_SAMPLES);
+    return true;
+}
+
 AudioAnalyzer::~AudioAnalyzer() {
     cleanup();
 }
 
+bool AudioAnalyzer::loadWav(const char* path, std::vector<float>& interleaved, int& sample_rate, int& num_channels) {
+    SDL_AudioSpec wav_spec;
+    Uint8* wav_data = nullptr;
+    Uint32 wav_length = 0;
+    if (!SDL_LoadWAV(path, &wav_spec, &wav_data, &wav_length)) {
+        std::cerr << "Failed to load " << path << ": " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    // Analyze at the file's own rate and channel count, as float
+    SDL_AudioSpec float_spec = wav_spec;
+    float_spec.format = SDL_AUDIO_F32;
+
+    Uint8* float_data = nullptr;
+    int float_length = 0;
+    bool converted = SDL_ConvertAudioSamples(&wav_spec, wav_data, (int)wav_length, &float_spec, &float_data, &float_length);
+    SDL_free(wav_data);
+    if (!converted) {
+        std::cerr << "Failed to convert " << path << ": " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    sample_rate = float_spec.freq;
+    num_channels = float_spec.channels;
+    interleaved.assign((const float*)float_data, (const float*)float_data + float_length / sizeof(float));
+    SDL_free(float_data);
+    return true;
+}
+
+void AudioAnalyzer::printRecordingDevices() {
+    if (!SDL_Init(SDL_INIT_AUDIO)) {
+        std::cerr << "Failed to initialize SDL audio: " << SDL_GetError() << std::endl;
+        return;
+    }
+
+    int count;
+    SDL_AudioDeviceID* devices = SDL_GetAudioRecordingDevices(&count);
+    std::cout << "Recording devices (" << count << "):\n";
+    for (int i = 0; i < count; i++) {
+        SDL_AudioSpec native;
+        int frames;
+        const char* name = SDL_GetAudioDeviceName(devices[i]);
+        std::cout << "  [" << i << "] " << (name ? name : "Unknown");
+        if (SDL_GetAudioDeviceFormat(devices[i], &native, &frames)) {
+            std::cout << " (" << native.channels << " ch, " << native.freq << " Hz)";
+        }
+        std::cout << "\n";
+    }
+    SDL_free(devices);
+}
+
 bool AudioAnalyzer::initialize(int device_index) {
+    return initialize(std::vector<int>(1, device_index));
+}
+
+bool AudioAnalyzer::initialize(const std::vector<int>& device_indices) {
     if (initialized) {
         std::cerr << "AudioAnalyzer already initialized\n";
         return false;
@@ -33,99 +147,524 @@ bool AudioAnalyzer::initialize(int device_index) {
         return false;
     }
 
-    if (device_index < 0 || device_index >= count) {
-        std::cerr << "Invalid device index\n";
-        SDL_free(devices);
+    for (size_t i = 0; i < device_indices.size(); i++) {
+        int device_index = device_indices[i];
+        if (device_index < 0 || device_index >= count) {
+            std::cerr << "Invalid device index " << device_index << "\n";
+            SDL_free(devices);
+            closeCaptures();
+            return false;
+        }
+
+        if (!openCapture(devices[device_index])) {
+            SDL_free(devices);
+            closeCaptures();
+            return false;
+        }
+    }
+    SDL_free(devices);
+
+    if (captures.empty()) {
+        std::cerr << "No audio recording devices selected\n";
         return false;
     }
+    spec = captures[0].spec;
 
-    SDL_AudioDeviceID selected = devices[device_index];
-    SDL_free(devices);
+    setupAnalysis();
+
+    // Start recording
+    for (size_t i = 0; i < captures.size(); i++) {
+        SDL_ResumeAudioDevice(captures[i].mic);
+    }
+
+    initialized = true;
+    return true;
+}
+
+void AudioAnalyzer::setupAnalysis() {
+    // Allocate FFT buffers; every channel's buffers share the mono plan
+    fft_in = fftw_alloc_real(fft_size);
+    fft_out = fftw_alloc_complex(num_bins);
+    plan = fftw_plan_dft_r2c_1d(fft_size, fft_in, fft_out, planner_flags);
+
+    for (size_t i = 0; i < channels.size(); i++) {
+        channels[i].fft_in = fftw_alloc_real(fft_size);
+        channels[i].fft_out = fftw_alloc_complex(num_bins);
+        channels[i].history.assign(analysis_size, 0.0f);
+    }
+    mono_history.assign(analysis_size, 0.0f);
+    samples_since_snapshot = 0;
+    snapshots.clear();
+
+    // Log-spaced spectrum bins; each covers at least one FFT bin
+    columns.assign(max_snapshots, SpectrumColumn());
+    column_count = 0;
+    spectrum_edges.resize(SPECTRUM_BINS + 1);
+    double freq_per_bin = (double)spec.freq / fft_size;
+    for (int k = 0; k <= SPECTRUM_BINS; k++) {
+        double freq = 20.0 * std::pow(1000.0, (double)k / SPECTRUM_BINS);
+        spectrum_edges[k] = std::min((int)(freq / freq_per_bin), num_bins - 1);
+    }
+
+    // Onset STFT buffers
+    onset_in = fftw_alloc_real(onset_fft_size);
+    onset_out = fftw_alloc_complex(onset_fft_size / 2 + 1);
+    onset_plan = fftw_plan_dft_r2c_1d(onset_fft_size, onset_in, onset_out, planner_flags);
+
+    onset_window.resize(onset_fft_size);
+    for (int i = 0; i < onset_fft_size; i++) {
+        onset_window[i] = 0.5f - 0.5f * std::cos(2.0f * (float)M_PI * i / onset_fft_size);
+    }
+    onset_ring.assign(onset_fft_size, 0.0f);
+    onset_ring_pos = 0;
+    samples_since_hop = 0;
+    prev_log_magnitudes.assign(onset_fft_size / 2 + 1, 0.0f);
+
+    hop_duration = (float)onset_hop_size / spec.freq;
+    float hop_rate = 1.0f / hop_duration;
+    min_lag = (int)std::round(hop_rate * 60.0f / 200.0f);
+    max_lag = (int)std::round(hop_rate * 60.0f / 60.0f);
+    flux_history.assign(max_lag + 1, 0.0f);
+    flux_history_pos = 0;
+    tempo_scores.assign(max_lag + 1, 0.0f);
+
+    envelope.bass = envelope.mid = envelope.high = 0.0f;
+
+    startChannelWorkers();
+}
+
+void AudioAnalyzer::startChannelWorkers() {
+    if (channels.size() <= INLINE_CHANNELS) return;
+
+    worker_generation = 0;
+    workers_pending = 0;
+    workers_stopping = false;
+    for (size_t c = 0; c < channels.size(); c++) {
+        channel_workers.push_back(std::thread(&AudioAnalyzer::channelWorker, this, c));
+    }
+}
+
+void AudioAnalyzer::stopChannelWorkers() {
+    if (channel_workers.empty()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(worker_mutex);
+        workers_stopping = true;
+    }
+    worker_wake.notify_all();
+    for (size_t i = 0; i < channel_workers.size(); i++) {
+        channel_workers[i].join();
+    }
+    channel_workers.clear();
+}
+
+void AudioAnalyzer::channelWorker(size_t index) {
+    Uint64 seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(worker_mutex);
+            worker_wake.wait(lock, [this, seen]() { return workers_stopping || worker_generation != seen; });
+            if (workers_stopping) return;
+            seen = worker_generation;
+        }
+
+        // Raw bands; the caller normalizes them once every channel is done
+        Channel& channel = channels[index];
+        channel.bands = computeBands(channel.history.data(), (int)channel.history.size(),
+                                     channel.sample_rate, channel.fft_in, channel.fft_out);
+
+        std::lock_guard<std::mutex> lock(worker_mutex);
+        if (--workers_pending == 0) {
+            worker_done.notify_one();
+        }
+    }
+}
+
+bool AudioAnalyzer::initializeOffline(int sample_rate, int num_channels) {
+    if (initialized) {
+        std::cerr << "AudioAnalyzer already initialized\n";
+        return false;
+    }
+    if (sample_rate <= 0 || num_channels <= 0) {
+        std::cerr << "Invalid offline format: " << num_channels << " ch at " << sample_rate << " Hz\n";
+        return false;
+    }
 
-    // Set up audio specification
     spec.format = SDL_AUDIO_F32;
-    spec.channels = 1;
-    spec.freq = 44100;
+    spec.channels = num_channels;
+    spec.freq = sample_rate;
+
+    for (int c = 0; c < num_channels; c++) {
+        Channel channel = {};
+        channel.sample_rate = sample_rate;
+        channels.push_back(channel);
+    }
+
+    setupAnalysis();
+
+    offline = true;
+    offline_frames = 0;
+    initialized = true;
+    return true;
+}
+
+void AudioAnalyzer::pushSamples(const float* interleaved, int frames) {
+    if (!initialized || !offline || frames <= 0) return;
+
+    int num_channels = spec.channels;
+    std::vector<float*> outputs(num_channels);
+    for (int c = 0; c < num_channels; c++) {
+        channels[c].samples.resize(frames);
+        outputs[c] = channels[c].samples.data();
+    }
+    deinterleave(interleaved, frames, num_channels, outputs.data());
+
+    // Timestamps count audio time from the first pushed sample
+    offline_frames += frames;
+    processPrimaryBlock(frames, (offline_frames - 1) * SDL_NS_PER_SECOND / spec.freq);
+}
+
+bool AudioAnalyzer::initializeSynthetic(int sample_rate) {
+    if (!initializeOffline(sample_rate, 1)) {
+        return false;
+    }
+
+    synthetic = true;
+    synthetic_last_ns = SDL_GetTicksNS();
+    std::cout << "Using synthetic audio input at " << sample_rate << " Hz\n";
+    return true;
+}
+
+bool AudioAnalyzer::openCapture(SDL_AudioDeviceID device) {
+    Capture capture = {};
+
+    // Capture at the device's native rate and channel count, as float
+    if (!SDL_GetAudioDeviceFormat(device, &capture.spec, &capture.buffer_frames)) {
+        std::cerr << "Failed to query device format: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    capture.spec.format = SDL_AUDIO_F32;
+    capture.first_channel = (int)channels.size();
 
     // Open recording device
-    mic = SDL_OpenAudioDevice(selected, &spec);
-    if (!mic) {
+    capture.mic = SDL_OpenAudioDevice(device, &capture.spec);
+    if (!capture.mic) {
         std::cerr << "Failed to open recording device: " << SDL_GetError() << std::endl;
         return false;
     }
 
     // Create audio stream
-    stream = SDL_CreateAudioStream(&spec, &spec);
-    if (!stream) {
+    capture.stream = SDL_CreateAudioStream(&capture.spec, &capture.spec);
+    if (!capture.stream) {
         std::cerr << "Failed to create audio stream: " << SDL_GetError() << std::endl;
-        SDL_CloseAudioDevice(mic);
+        SDL_CloseAudioDevice(capture.mic);
         return false;
     }
 
     // Bind stream to device
-    SDL_BindAudioStream(mic, stream);
+    SDL_BindAudioStream(capture.mic, capture.stream);
+    captures.push_back(capture);
 
-    // Allocate FFT buffers
-    fft_in = fftw_alloc_real(fft_size);
-    fft_out = fftw_alloc_complex(num_bins);
-    plan = fftw_plan_dft_r2c_1d(fft_size, fft_in, fft_out, FFTW_ESTIMATE);
-
-    // Start recording
-    SDL_ResumeAudioDevice(mic);
+    for (int c = 0; c < capture.spec.channels; c++) {
+        Channel channel = {};
+        channel.sample_rate = capture.spec.freq;
+        channels.push_back(channel);
+    }
 
-    initialized = true;
+    const char* name = SDL_GetAudioDeviceName(device);
+    std::cout << "Capturing " << (name ? name : "Unknown") << ": " << capture.spec.channels
+              << " ch at " << capture.spec.freq << " Hz\n";
     return true;
 }
 
 void AudioAnalyzer::update() {
     if (!initialized) return;
 
-    // Clear old buffer
+    // Clear old buffers
     audioBuffer.clear();
 
-    // Capture audio from stream
-    int available = SDL_GetAudioStreamAvailable(stream);
-    if (available > 0) {
-        std::vector<float> temp_buffer(available / sizeof(float));
-        int bytes_read = SDL_GetAudioStreamData(stream, temp_buffer.data(), available);
+    if (synthetic) {
+        int frames = generateSynthetic();
+        if (frames > 0) {
+            processPrimaryBlock(frames, SDL_GetTicksNS());
+        }
+        return;
+    }
+
+    // Offline input arrives through pushSamples()
+    if (offline) return;
+
+    // The primary device is processed last so snapshots see every device's newest samples
+    int primary_frames = 0;
+    Uint64 primary_newest_ns = 0;
+
+    for (size_t d = 0; d < captures.size(); d++) {
+        const Capture& capture = captures[d];
+        int num_channels = capture.spec.channels;
+        for (int c = 0; c < num_channels; c++) {
+            channels[capture.first_channel + c].samples.clear();
+        }
+
+        // Capture audio from stream
+        int available = SDL_GetAudioStreamAvailable(capture.stream);
+        if (available <= 0) continue;
+
+        interleaved.resize(available / sizeof(float));
+        int bytes_read = SDL_GetAudioStreamData(capture.stream, interleaved.data(), available);
+        if (bytes_read <= 0) continue;
+        Uint64 read_ns = SDL_GetTicksNS();
+
+        int frames = bytes_read / (sizeof(float) * num_channels);
+        std::vector<float*> outputs(num_channels);
+        for (int c = 0; c < num_channels; c++) {
+            channels[capture.first_channel + c].samples.resize(frames);
+            outputs[c] = channels[capture.first_channel + c].samples.data();
+        }
+        deinterleave(interleaved.data(), frames, num_channels, outputs.data());
 
-        if (bytes_read > 0) {
-            int sample_count = bytes_read / sizeof(float);
-            audioBuffer.insert(audioBuffer.end(), temp_buffer.begin(), temp_buffer.begin() + sample_count);
+        if (d != 0) {
+            for (int c = 0; c < num_channels; c++) {
+                pushHistory(channels[capture.first_channel + c].history, outputs[c], frames);
+            }
+            continue;
         }
+
+        // The newest sample sat in the device buffer for roughly one buffer's duration
+        Uint64 buffer_ns = (Uint64)capture.buffer_frames * SDL_NS_PER_SECOND / capture.spec.freq;
+        primary_frames = frames;
+        primary_newest_ns = read_ns > buffer_ns ? read_ns - buffer_ns : 0;
+    }
+
+    if (primary_frames > 0) {
+        processPrimaryBlock(primary_frames, primary_newest_ns);
     }
 }
 
-AudioAnalyzer::FrequencyBands AudioAnalyzer::getFrequencyBands() {
-    FrequencyBands bands = {0.0f, 0.0f, 0.0f};
+void AudioAnalyzer::pushHistory(std::vector<float>& history, const float* samples, int count) {
+    int size = (int)history.size();
+    if (count >= size) {
+        std::copy(samples + count - size, samples + count, history.begin());
+        return;
+    }
+    std::copy(history.begin() + count, history.end(), history.begin());
+    std::copy(samples, samples + count, history.end() - count);
+}
 
-    if (!initialized || audioBuffer.empty()) {
-        return bands;
+int AudioAnalyzer::generateSynthetic() {
+    Uint64 now = SDL_GetTicksNS();
+    int frames = (int)((now - synthetic_last_ns) * spec.freq / SDL_NS_PER_SECOND);
+    if (frames <= 0) {
+        channels[0].samples.clear();
+        return 0;
+    }
+    synthetic_last_ns += (Uint64)frames * SDL_NS_PER_SECOND / spec.freq;
+
+    // ~-60 dBFS white noise (xorshift), enough to keep the normalization and onset stats alive
+    std::vector<float>& samples = channels[0].samples;
+    samples.resize(frames);
+    for (int i = 0; i < frames; i++) {
+        noise_state ^= noise_state << 13;
+        noise_state ^= noise_state >> 17;
+        noise_state ^= noise_state << 5;
+        samples[i] = ((float)noise_state / 4294967295.0f * 2.0f - 1.0f) * 0.001f;
+    }
+    return frames;
+}
+
+// Mixes the primary device's channels [0, spec.channels) down to mono and runs the
+// per-block analysis. newest_ns is the estimated capture time of the last frame
+void AudioAnalyzer::processPrimaryBlock(int frames, Uint64 newest_ns) {
+    int num_channels = spec.channels;
+    Uint64 frame_ns = SDL_NS_PER_SECOND / spec.freq;
+    Uint64 block_ns = (Uint64)(frames - 1) * frame_ns;
+    capture_timing.newest_ns = newest_ns;
+    capture_timing.oldest_ns = newest_ns > block_ns ? newest_ns - block_ns : 0;
+
+    // A pending click goes at the end of the block so it is as fresh as possible
+    if (click_pending) {
+        int click_frames = std::min(frames, std::max(1, (int)(click_duration * spec.freq)));
+        int first = frames - click_frames;
+        for (int c = 0; c < num_channels; c++) {
+            float* samples = channels[c].samples.data();
+            for (int i = 0; i < click_frames; i++) {
+                // Alternating sign: a full-scale burst with energy across the whole spectrum
+                samples[first + i] = (i % 2 == 0) ? 1.0f : -1.0f;
+            }
+        }
+        click_ns = capture_timing.oldest_ns + (Uint64)first * frame_ns;
+        click_pending = false;
+    }
+
+    // Mono mix of the primary device
+    audioBuffer.assign(frames, 0.0f);
+    float channel_scale = 1.0f / num_channels;
+    for (int c = 0; c < num_channels; c++) {
+        const float* samples = channels[c].samples.data();
+        for (int i = 0; i < frames; i++) {
+            audioBuffer[i] += samples[i] * channel_scale;
+        }
     }
 
+    double sum_squares = 0.0;
+    for (int i = 0; i < frames; i++) {
+        sum_squares += audioBuffer[i] * audioBuffer[i];
+    }
+    level = std::sqrt(sum_squares / frames);
+
+    processOnsetSamples(audioBuffer.data(), frames);
+
+    // Feed the analysis windows a hop at a time, taking a snapshot at each hop boundary
+    for (int offset = 0; offset < frames;) {
+        int chunk = std::min(frames - offset, snapshot_hop - samples_since_snapshot);
+        pushHistory(mono_history, audioBuffer.data() + offset, chunk);
+        for (int c = 0; c < num_channels; c++) {
+            pushHistory(channels[c].history, channels[c].samples.data() + offset, chunk);
+        }
+        offset += chunk;
+        samples_since_snapshot += chunk;
+
+        if (samples_since_snapshot == snapshot_hop) {
+            samples_since_snapshot = 0;
+            analyzeSnapshot(capture_timing.oldest_ns + (Uint64)(offset - 1) * frame_ns);
+        }
+    }
+}
+
+void AudioAnalyzer::processOnsetSamples(const float* samples, int count) {
+    for (int i = 0; i < count; i++) {
+        onset_ring[onset_ring_pos] = samples[i];
+        onset_ring_pos = (onset_ring_pos + 1) % onset_fft_size;
+
+        if (++samples_since_hop >= onset_hop_size) {
+            samples_since_hop = 0;
+            processHop();
+        }
+    }
+}
+
+void AudioAnalyzer::processHop() {
+    // Unroll the ring (oldest sample first) through the window
+    for (int i = 0; i < onset_fft_size; i++) {
+        onset_in[i] = onset_ring[(onset_ring_pos + i) % onset_fft_size] * onset_window[i];
+    }
+    fftw_execute(onset_plan);
+
+    // Spectral flux: summed rise of log-compressed magnitudes since the last hop
+    int bins = onset_fft_size / 2 + 1;
+    float flux = 0.0f;
+    for (int i = 0; i < bins; i++) {
+        double real = onset_out[i][0];
+        double imag = onset_out[i][1];
+        float log_magnitude = std::log1p(100.0f * (float)std::sqrt(real * real + imag * imag));
+        float rise = log_magnitude - prev_log_magnitudes[i];
+        if (rise > 0.0f) flux += rise;
+        prev_log_magnitudes[i] = log_magnitude;
+    }
+    flux /= bins;
+
+    // Adaptive threshold, O(1) per hop. Time constants are in seconds so they don't depend on hop size
+    float alpha = 1.0f - std::exp(-hop_duration / threshold_time);
+    float threshold = flux_mean + threshold_k * flux_deviation;
+
+    time_since_onset += hop_duration;
+    onset_envelope *= std::exp(-hop_duration / onset_decay_time);
+
+    // Peak picking: above threshold, on the falling edge after a rise, outside the refractory window
+    bool is_onset = prev_flux > threshold && flux < prev_flux && time_since_onset > refractory_time;
+    if (is_onset) {
+        float strength = (prev_flux - flux_mean) / (flux_deviation + 1e-6f);
+        onset_envelope = std::max(onset_envelope, std::min(strength / (2.0f * threshold_k), 1.0f));
+        onset_pending = true;
+        time_since_onset = 0.0f;
+    }
+
+    flux_deviation += alpha * (std::fabs(flux - flux_mean) - flux_deviation);
+    flux_mean += alpha * (flux - flux_mean);
+    prev_flux = flux;
+
+    updateTempo(flux, is_onset);
+}
+
+void AudioAnalyzer::updateTempo(float flux, bool is_onset) {
+    // Half-wave rectified novelty so steady sections don't build up scores
+    float novelty = std::max(flux - flux_mean, 0.0f);
+
+    int history_size = (int)flux_history.size();
+    flux_history[flux_history_pos] = novelty;
+
+    // Comb scores: how well this hop lines up with the one `lag` hops back, decayed over tempo_memory.
+    // Fixed lag range, so the cost per hop doesn't grow with history length
+    float decay = std::exp(-hop_duration / tempo_memory);
+    int best_lag = 0;
+    float best_score = 0.0f;
+    for (int lag = min_lag; lag <= max_lag; lag++) {
+        float past = flux_history[(flux_history_pos - lag + history_size) % history_size];
+        tempo_scores[lag] = tempo_scores[lag] * decay + novelty * past;
+
+        // Bias toward 120 BPM to avoid locking onto half/double tempo
+        float bpm = 60.0f / (lag * hop_duration);
+        float octaves_from_120 = std::log2(bpm / 120.0f);
+        float score = tempo_scores[lag] * std::exp(-0.5f * octaves_from_120 * octaves_from_120);
+        if (score > best_score) {
+            best_score = score;
+            best_lag = lag;
+        }
+    }
+    flux_history_pos = (flux_history_pos + 1) % history_size;
+
+    if (best_lag > 0) {
+        // Parabolic interpolation between neighbouring lags for sub-hop tempo resolution
+        float lag = (float)best_lag;
+        if (best_lag > min_lag && best_lag < max_lag) {
+            float left = tempo_scores[best_lag - 1];
+            float center = tempo_scores[best_lag];
+            float right = tempo_scores[best_lag + 1];
+            float curvature = left - 2.0f * center + right;
+            if (curvature < 0.0f) {
+                lag += 0.5f * (left - right) / curvature;
+            }
+        }
+        beat_period = lag * hop_duration;
+    }
+
+    // Free-running phase, nudged toward detected onsets (a simple PLL)
+    beat_phase += hop_duration / beat_period;
+    beat_phase -= std::floor(beat_phase);
+    if (is_onset) {
+        // Onsets are confirmed about half a window plus a hop after they happen
+        float detection_delay = (0.5f * onset_fft_size + onset_hop_size) / spec.freq;
+        float error = beat_phase - detection_delay / beat_period;
+        error -= std::floor(error + 0.5f);
+        beat_phase -= 0.3f * error;
+        beat_phase -= std::floor(beat_phase);
+    }
+}
+
+AudioAnalyzer::BeatInfo AudioAnalyzer::getBeatInfo() {
+    BeatInfo info = {onset_envelope, beat_phase, 60.0f / beat_period, onset_pending};
+    onset_pending = false;
+    return info;
+}
+
+AudioAnalyzer::FrequencyBands AudioAnalyzer::computeBands(const float* samples, int count, int sample_rate,
+                                                          double* in, fftw_complex* out) {
+    FrequencyBands bands = {0.0f, 0.0f, 0.0f};
+
     // Copy audio samples to FFT input
-    int samples_to_process = std::min((int)audioBuffer.size(), fft_size);
+    int samples_to_process = std::min(count, fft_size);
     for (int i = 0; i < samples_to_process; i++) {
-        fft_in[i] = audioBuffer[i];
+        in[i] = samples[i];
     }
     // Zero-pad if needed
     for (int i = samples_to_process; i < fft_size; i++) {
-        fft_in[i] = 0.0;
+        in[i] = 0.0;
     }
 
-    // Execute FFT
-    fftw_execute(plan);
-
-    // Calculate magnitudes for each bin
-    std::vector<double> magnitudes(num_bins);
-    for (int i = 0; i < num_bins; i++) {
-        double real = fft_out[i][0];
-        double imag = fft_out[i][1];
-        magnitudes[i] = std::sqrt(real * real + imag * imag);
-    }
+    // Execute FFT (new-array execute is thread-safe, so channels can run concurrently)
+    fftw_execute_dft_r2c(plan, in, out);
 
     // Frequency per bin
-    double freq_per_bin = (double)spec.freq / fft_size;
+    double freq_per_bin = (double)sample_rate / fft_size;
 
     // Sum magnitudes for each frequency band
     double bass_sum = 0.0;
@@ -137,15 +676,16 @@ AudioAnalyzer::FrequencyBands AudioAnalyzer::getFrequencyBands() {
 
     for (int i = 0; i < num_bins; i++) {
         double freq = i * freq_per_bin;
+        double magnitude = std::sqrt(out[i][0] * out[i][0] + out[i][1] * out[i][1]);
 
         if (freq >= 20 && freq < 250) {
-            bass_sum += magnitudes[i];
+            bass_sum += magnitude;
             bass_count++;
         } else if (freq >= 250 && freq < 4000) {
-            mid_sum += magnitudes[i];
+            mid_sum += magnitude;
             mid_count++;
         } else if (freq >= 4000 && freq <= 20000) {
-            high_sum += magnitudes[i];
+            high_sum += magnitude;
             high_count++;
         }
     }
@@ -155,46 +695,199 @@ AudioAnalyzer::FrequencyBands AudioAnalyzer::getFrequencyBands() {
     if (mid_count > 0) bands.mid = mid_sum / mid_count;
     if (high_count > 0) bands.high = high_sum / high_count;
 
-    // Track maximum and minimum in a sliding window (~5 seconds)
-    float current_max = std::max({bands.bass, bands.mid, bands.high});
-    float current_min = std::min({bands.bass, bands.mid, bands.high});
-    max_history.push_back(current_max);
-    min_history.push_back(current_min);
+    return bands;
+}
+
+void AudioAnalyzer::analyzeSnapshot(Uint64 time_ns) {
+    // Per-channel FFTs run on the workers in parallel with the mono one, or inline after it
+    // when there are too few to be worth waking threads for. A single mono channel is the mix itself
+    bool per_channel = channels.size() > 1;
+    bool threaded = !channel_workers.empty();
+    if (threaded) {
+        {
+            std::lock_guard<std::mutex> lock(worker_mutex);
+            workers_pending = channel_workers.size();
+            worker_generation++;
+        }
+        worker_wake.notify_all();
+    }
+
+    FrequencyBands bands = computeBands(mono_history.data(), (int)mono_history.size(), spec.freq, fft_in, fft_out);
+    raw_bands = bands;
 
-    // Keep only the last ~5 seconds of history
-    if (max_history.size() > max_history_size) {
-        max_history.erase(max_history.begin());
+    // Gain follows the mono bands, one hop of audio per step
+    updateGain(bands, (float)snapshot_hop / spec.freq);
+    normalizeBands(bands);
+
+    // Channels share the mono gain so their levels stay comparable for panning
+    if (threaded) {
+        std::unique_lock<std::mutex> lock(worker_mutex);
+        worker_done.wait(lock, [this]() { return workers_pending == 0; });
     }
-    if (min_history.size() > max_history_size) {
-        min_history.erase(min_history.begin());
+    if (per_channel) {
+        for (size_t c = 0; c < channels.size(); c++) {
+            Channel& channel = channels[c];
+            if (!threaded) {
+                channel.bands = computeBands(channel.history.data(), (int)channel.history.size(),
+                                             channel.sample_rate, channel.fft_in, channel.fft_out);
+            }
+            normalizeBands(channel.bands);
+        }
+    } else {
+        channels[0].bands = bands;
     }
 
-    // Calculate rolling average of the sliding window
-    float max_average = 0.0f;
-    float min_average = 0.0f;
-    for (float val : max_history) {
-        max_average += val;
+    // Capture time estimates jitter with each stream read; snapshots are exactly a hop
+    // apart in audio time, so follow the estimate slowly (never backwards) and only
+    // resync on a forward gap such as a dropout
+    if (!snapshots.empty()) {
+        Sint64 hop_ns = (Sint64)getSnapshotIntervalNS();
+        Sint64 expected = (Sint64)snapshots.back().time_ns + hop_ns;
+        Sint64 error = (Sint64)time_ns - expected;
+        if (error < 2 * hop_ns) {
+            time_ns = (Uint64)(expected + std::max(error, -hop_ns) / 16);
+        }
     }
-    for (float val : min_history) {
-        min_average += val;
+
+    addSpectrumColumn(time_ns);
+
+    BandSnapshot snapshot;
+    snapshot.time_ns = time_ns;
+    snapshot.bands = bands;
+    snapshot.left = channels[0].bands;
+    snapshot.right = per_channel ? channels[1].bands : channels[0].bands;
+    snapshots.push_back(snapshot);
+    if (snapshots.size() > max_snapshots) {
+        snapshots.pop_front();
     }
-    if (max_history.size() > 0) {
-        max_average /= max_history.size();
+}
+
+// Reads the mono spectrum analyzeSnapshot() just left in fft_out
+void AudioAnalyzer::addSpectrumColumn(Uint64 time_ns) {
+    SpectrumColumn& column = columns[column_count % columns.size()];
+    column.time_ns = time_ns;
+
+    // Relative to the loudest band's envelope, so the texture follows the auto-gain
+    float reference = std::max(std::max(envelope.bass, envelope.mid), std::max(envelope.high, gain.floor));
+    for (int k = 0; k < SPECTRUM_BINS; k++) {
+        int first = spectrum_edges[k];
+        int last = std::max(spectrum_edges[k + 1], first + 1);
+        last = std::min(last, num_bins);
+
+        double sum = 0.0;
+        for (int i = first; i < last; i++) {
+            sum += std::sqrt(fft_out[i][0] * fft_out[i][0] + fft_out[i][1] * fft_out[i][1]);
+        }
+        float magnitude = (float)(sum / std::max(last - first, 1));
+        float db = 20.0f * std::log10(std::max(magnitude, 1e-9f) / reference);
+        column.spectrum[k] = std::min(std::max(1.0f + (db - spectrum_headroom_db) / spectrum_range_db, 0.0f), 1.0f);
     }
-    if (min_history.size() > 0) {
-        min_average /= min_history.size();
+
+    // The hop that triggered this snapshot is the end of the mono history
+    int decimation = snapshot_hop / WAVEFORM_SAMPLES;
+    const float* hop = mono_history.data() + mono_history.size() - snapshot_hop;
+    for (int i = 0; i < WAVEFORM_SAMPLES; i++) {
+        float sum = 0.0f;
+        for (int j = 0; j < decimation; j++) {
+            sum += hop[i * decimation + j];
+        }
+        column.waveform[i] = std::min(std::max(sum / decimation, -1.0f), 1.0f);
     }
 
-    // Calculate range and normalize by it
-    float range = max_average - min_average;
+    column_count++;
+}
 
-    if (range > 0.0f) {
-        bands.bass = (bands.bass *2.5) / range;
-        bands.mid = (bands.mid *3.0) / range;
-        bands.high = (bands.high *3.0) / range;
+const AudioAnalyzer::SpectrumColumn* AudioAnalyzer::getColumn(Uint64 index) const {
+    if (index >= column_count || column_count - index > columns.size()) {
+        return nullptr;
     }
+    return &columns[index % columns.size()];
+}
 
-    return bands;
+AudioAnalyzer::FrequencyBands AudioAnalyzer::getFrequencyBands() {
+    if (!initialized || snapshots.empty()) {
+        FrequencyBands none = {0.0f, 0.0f, 0.0f};
+        return none;
+    }
+    return snapshots.back().bands;
+}
+
+namespace {
+
+AudioAnalyzer::FrequencyBands lerpBands(const AudioAnalyzer::FrequencyBands& a,
+                                        const AudioAnalyzer::FrequencyBands& b, float t) {
+    // Extrapolation can overshoot below zero; negative band levels mean nothing
+    AudioAnalyzer::FrequencyBands result;
+    result.bass = std::max(0.0f, a.bass + (b.bass - a.bass) * t);
+    result.mid = std::max(0.0f, a.mid + (b.mid - a.mid) * t);
+    result.high = std::max(0.0f, a.high + (b.high - a.high) * t);
+    return result;
+}
+
+}
+
+AudioAnalyzer::BandSnapshot AudioAnalyzer::getBandsAt(Uint64 time_ns) const {
+    if (snapshots.empty()) {
+        BandSnapshot none = {};
+        none.time_ns = time_ns;
+        return none;
+    }
+    if (snapshots.size() == 1) {
+        return snapshots.back();
+    }
+    if (time_ns <= snapshots.front().time_ns) {
+        return snapshots.front();
+    }
+
+    // Newest pair that brackets the time, or the last pair when extrapolating
+    size_t i = snapshots.size() - 1;
+    while (i > 1 && snapshots[i - 1].time_ns > time_ns) {
+        i--;
+    }
+    const BandSnapshot& a = snapshots[i - 1];
+    const BandSnapshot& b = snapshots[i];
+
+    Uint64 latest = b.time_ns + getSnapshotIntervalNS();
+    Uint64 t_ns = std::min(time_ns, latest);
+    float t = (float)((double)((Sint64)(t_ns - a.time_ns)) / (double)(b.time_ns - a.time_ns));
+
+    BandSnapshot result;
+    result.time_ns = t_ns;
+    result.bands = lerpBands(a.bands, b.bands, t);
+    result.left = lerpBands(a.left, b.left, t);
+    result.right = lerpBands(a.right, b.right, t);
+    return result;
+}
+
+namespace {
+
+// One-pole follower step with separate rise and fall time constants
+float followEnvelope(float envelope, float value, float duration, float attack_time, float release_time) {
+    float time_constant = value > envelope ? attack_time : release_time;
+    if (time_constant <= 0.0f) return value;
+    return envelope + (value - envelope) * (1.0f - std::exp(-duration / time_constant));
+}
+
+}
+
+void AudioAnalyzer::updateGain(const FrequencyBands& bands, float duration) {
+    envelope.bass = followEnvelope(envelope.bass, bands.bass, duration, gain.attack_time, gain.release_time);
+    envelope.mid = followEnvelope(envelope.mid, bands.mid, duration, gain.attack_time, gain.release_time);
+    envelope.high = followEnvelope(envelope.high, bands.high, duration, gain.attack_time, gain.release_time);
+}
+
+void AudioAnalyzer::normalizeBands(FrequencyBands& bands) const {
+    bands.bass *= gain.bass_target / std::max(envelope.bass, gain.floor);
+    bands.mid *= gain.mid_target / std::max(envelope.mid, gain.floor);
+    bands.high *= gain.high_target / std::max(envelope.high, gain.floor);
+}
+
+AudioAnalyzer::FrequencyBands AudioAnalyzer::getChannelBands(int channel) const {
+    if (channel < 0 || channel >= (int)channels.size()) {
+        FrequencyBands none = {0.0f, 0.0f, 0.0f};
+        return none;
+    }
+    return channels[channel].bands;
 }
 
 std::array<float, 3> AudioAnalyzer::getCoefficients() {
@@ -202,9 +895,34 @@ std::array<float, 3> AudioAnalyzer::getCoefficients() {
     return {bands.bass, bands.mid, bands.high};
 }
 
+void AudioAnalyzer::closeCaptures() {
+    for (size_t i = 0; i < captures.size(); i++) {
+        if (captures[i].stream) {
+            SDL_DestroyAudioStream(captures[i].stream);
+        }
+        if (captures[i].mic) {
+            SDL_CloseAudioDevice(captures[i].mic);
+        }
+    }
+    captures.clear();
+
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (channels[i].fft_in) {
+            fftw_free(channels[i].fft_in);
+        }
+        if (channels[i].fft_out) {
+            fftw_free(channels[i].fft_out);
+        }
+    }
+    channels.clear();
+}
+
 void AudioAnalyzer::cleanup() {
     if (!initialized) return;
 
+    // Workers use the channel buffers freed below
+    stopChannelWorkers();
+
     // Clean up FFT
     if (plan) {
         fftw_destroy_plan(plan);
@@ -218,16 +936,23 @@ void AudioAnalyzer::cleanup() {
         fftw_free(fft_out);
         fft_out = nullptr;
     }
-
-    // Clean up SDL
-    if (stream) {
-        SDL_DestroyAudioStream(stream);
-        stream = nullptr;
+    if (onset_plan) {
+        fftw_destroy_plan(onset_plan);
+        onset_plan = nullptr;
     }
-    if (mic) {
-        SDL_CloseAudioDevice(mic);
-        mic = 0;
+    if (onset_in) {
+        fftw_free(onset_in);
+        onset_in = nullptr;
     }
+    if (onset_out) {
+        fftw_free(onset_out);
+        onset_out = nullptr;
+    }
+
+    // Clean up SDL
+    closeCaptures();
 
+    synthetic = false;
+    offline = false;
     initialized = false;
 }
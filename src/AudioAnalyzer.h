@@ -5,6 +5,10 @@
 #include <fftw3.h>
 #include <vector>
 #include <array>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 class AudioAnalyzer {
 public:
@@ -14,34 +18,253 @@ public:
         float high;      // 4000-20000 Hz
     };
 
+    struct BeatInfo {
+        float onset_strength;  // Envelope that jumps to ~1 on an onset and decays
+        float beat_phase;      // 0 on the beat, rising to 1 just before the next
+        float bpm;
+        bool onset;            // An onset was detected since the last call
+    };
+
+    // Bands from one analysis hop, stamped with the capture time of the window's newest sample
+    struct BandSnapshot {
+        Uint64 time_ns;
+        FrequencyBands bands;  // Mono mix
+        FrequencyBands left;   // Channel 0
+        FrequencyBands right;  // Channel 1, or channel 0 for mono input
+    };
+
+    // One spectrogram column per snapshot, for the shader's audio history texture
+    static const int SPECTRUM_BINS = 128;     // Log-spaced 20 Hz - 20 kHz
+    static const int WAVEFORM_SAMPLES = 128;  // The snapshot's hop of the mono mix, box-decimated
+    static const int MIN_FFT_SIZE = 2 * WAVEFORM_SAMPLES;  // Analysis window (half the FFT) >= the hop
+    static const int MAX_FFT_SIZE = 65536;
+
+    struct SpectrumColumn {
+        Uint64 time_ns;                     // Same as its BandSnapshot
+        float spectrum[SPECTRUM_BINS];      // dB relative to the auto-gain envelope, mapped to [0, 1]
+        float waveform[WAVEFORM_SAMPLES];   // Raw samples in [-1, 1]
+    };
+
+    // Per-band auto-gain. Each band's envelope follows its magnitude with these time
+    // constants; a band sitting at its envelope normalizes to its target level
+    struct AutoGainSettings {
+        float attack_time;    // seconds, envelope rising toward a louder band
+        float release_time;   // seconds, envelope falling toward a quieter band
+        float floor;          // Minimum envelope (FFT magnitude), keeps silence from being amplified
+        float bass_target;
+        float mid_target;
+        float high_target;
+    };
+
+    // Estimated capture times (SDL_GetTicksNS) of the primary block read by the last update()
+    struct CaptureTiming {
+        Uint64 oldest_ns;  // First sample of the block
+        Uint64 newest_ns;  // Last sample of the block
+    };
+
 private:
-    SDL_AudioDeviceID mic = 0;
-    SDL_AudioStream* stream = nullptr;
-    SDL_AudioSpec spec;
+    // One opened recording device, captured at its native format
+    struct Capture {
+        SDL_AudioDeviceID mic;
+        SDL_AudioStream* stream;
+        SDL_AudioSpec spec;
+        int buffer_frames;  // Device buffer size, counted as capture latency
+        int first_channel;  // Index of its first channel in `channels`
+    };
+
+    // One input channel across all devices, analyzed separately
+    struct Channel {
+        std::vector<float> samples;  // Captured this update, deinterleaved
+        std::vector<float> history;  // Last analysis_size samples
+        int sample_rate;
+        double* fft_in;
+        fftw_complex* fft_out;
+        FrequencyBands bands;        // Normalized, from the last getFrequencyBands()
+    };
 
+    std::vector<Capture> captures;
+    std::vector<Channel> channels;
+    std::vector<float> interleaved;  // Scratch for reading a device's stream
+    SDL_AudioSpec spec = {};         // Primary (first) device's format
+
+    // Mono mix of the primary device; drives the overall bands, level and onsets
     std::vector<float> audioBuffer;
+    std::vector<float> mono_history;  // Last analysis_size samples of the mix
+    FrequencyBands raw_bands = {0.0f, 0.0f, 0.0f};  // Newest snapshot's mono bands before auto-gain
     int fft_size = 4096;
     int num_bins;
 
+    // Bands are analyzed every snapshot_hop samples of the primary device over the last
+    // analysis_size samples (zero-padded to fft_size), independent of the caller's rate
+    int analysis_size = 2048;
+    int snapshot_hop = 1024;
+    int samples_since_snapshot = 0;
+    std::deque<BandSnapshot> snapshots;  // Oldest first
+    size_t max_snapshots = 64;
+
+    // Spectrogram columns, a ring indexed by column number modulo its size
+    std::vector<SpectrumColumn> columns;
+    Uint64 column_count = 0;
+    std::vector<int> spectrum_edges;  // FFT bin range of each spectrum bin, SPECTRUM_BINS + 1 entries
+    float spectrum_headroom_db = 24.0f;  // Above the envelope (a band average) maps to 1; peaks sit well above it
+    float spectrum_range_db = 60.0f;     // Below that, maps to 0
+
+    // One plan shared by every channel through fftw_execute_dft_r2c()
+    unsigned planner_flags = FFTW_ESTIMATE;
     double* fft_in = nullptr;
     fftw_complex* fft_out = nullptr;
     fftw_plan plan = nullptr;
 
+    // Per-channel FFTs above INLINE_CHANNELS run on one persistent worker per channel,
+    // woken each snapshot by bumping worker_generation; fewer run inline on the caller
+    static const size_t INLINE_CHANNELS = 2;
+    std::vector<std::thread> channel_workers;
+    std::mutex worker_mutex;
+    std::condition_variable worker_wake;
+    std::condition_variable worker_done;
+    Uint64 worker_generation = 0;
+    size_t workers_pending = 0;
+    bool workers_stopping = false;
+
     bool initialized = false;
+    bool hasFormat() const { return initialized && spec.freq > 0; }
 
-    // Sliding window for maximum and minimum value tracking
-    std::vector<float> max_history;
-    std::vector<float> min_history;
-    int max_history_size = 300;  // ~5 seconds at 30 fps
+    // Offline input: no devices, samples come from pushSamples() on an audio-time clock
+    bool offline = false;
+    Uint64 offline_frames = 0;
+
+    // Synthetic input: offline, with low-level noise generated at the wall-clock rate
+    bool synthetic = false;
+    Uint64 synthetic_last_ns = 0;
+    Uint32 noise_state = 22222;
+
+    CaptureTiming capture_timing = {0, 0};
+
+    // Loopback testing: a click mixed into the next captured block
+    bool click_pending = false;
+    Uint64 click_ns = 0;
+    float click_duration = 0.005f;  // seconds
+
+    // RMS of the most recently captured block, used for silence detection
+    float level = 0.0f;
+
+    // Onset detection runs its own short STFT, one FFT per hop, on the raw capture
+    int onset_fft_size = 1024;
+    int onset_hop_size = 512;   // ~11.6 ms at 44.1 kHz
+    float hop_duration = 0.0f;
+    std::vector<float> onset_window;
+    std::vector<float> onset_ring;
+    int onset_ring_pos = 0;
+    int samples_since_hop = 0;
+
+    double* onset_in = nullptr;
+    fftw_complex* onset_out = nullptr;
+    fftw_plan onset_plan = nullptr;
+    std::vector<float> prev_log_magnitudes;
+
+    // Spectral flux with an adaptive threshold (EMA mean + deviation)
+    float flux_mean = 0.0f;
+    float flux_deviation = 0.0f;
+    float prev_flux = 0.0f;
+    float threshold_time = 0.5f;     // seconds
+    float threshold_k = 1.5f;        // deviations above the mean
+    float onset_decay_time = 0.15f;  // seconds
+    float refractory_time = 0.1f;    // seconds
+    float time_since_onset = 0.0f;
+    float onset_envelope = 0.0f;
+    bool onset_pending = false;
+
+    // Tempo: decaying comb scores over a fixed lag range (60-200 BPM) of flux history
+    std::vector<float> flux_history;
+    int flux_history_pos = 0;
+    std::vector<float> tempo_scores;
+    int min_lag = 0;
+    int max_lag = 0;
+    float tempo_memory = 5.0f;  // seconds
+    float beat_period = 0.5f;   // seconds
+    float beat_phase = 0.0f;
+
+    bool openCapture(SDL_AudioDeviceID device);
+    void closeCaptures();
+    void setupAnalysis();
+    int generateSynthetic();
+    void processPrimaryBlock(int frames, Uint64 newest_ns);
+    void startChannelWorkers();
+    void stopChannelWorkers();
+    void channelWorker(size_t index);
+    void analyzeSnapshot(Uint64 time_ns);
+    void addSpectrumColumn(Uint64 time_ns);
+    static void pushHistory(std::vector<float>& history, const float* samples, int count);
+    FrequencyBands computeBands(const float* samples, int count, int sample_rate, double* in, fftw_complex* out);
+    void updateGain(const FrequencyBands& bands, float duration);
+    void normalizeBands(FrequencyBands& bands) const;
+
+    void processOnsetSamples(const float* samples, int count);
+    void processHop();
+    void updateTempo(float flux, bool is_onset);
+
+    // Auto-gain state: one envelope per band, advanced by the duration of audio analyzed
+    AutoGainSettings gain = {0.05f, 5.0f, 0.5f, 2.0f, 1.0f, 0.5f};
+    FrequencyBands envelope = {0.0f, 0.0f, 0.0f};
 
 public:
     AudioAnalyzer();
     ~AudioAnalyzer();
 
+    static void printRecordingDevices();
+    // Decodes a WAV file to interleaved float frames at its own rate and channel count
+    static bool loadWav(const char* path, std::vector<float>& interleaved, int& sample_rate, int& num_channels);
+
+    void setAutoGain(const AutoGainSettings& settings) { gain = settings; }
+    const AutoGainSettings& getAutoGain() const { return gain; }
+
     bool initialize(int device_index = 0);
+    bool initialize(const std::vector<int>& device_indices);
+    // No devices: feed interleaved float frames through pushSamples(), e.g. from a file
+    bool initializeOffline(int sample_rate, int num_channels);
+    void pushSamples(const float* interleaved, int frames);
+    // Mono noise instead of a device, for headless runs and loopback tests
+    bool initializeSynthetic(int sample_rate = 48000);
+
+    // Analysis setup, before initializing. The band FFT is zero-padded 2x over the analysis
+    // window, with snapshots every half window. flags are FFTW planner flags
+    // Sizes must be a power of two from MIN_FFT_SIZE to MAX_FFT_SIZE, so the snapshot hop fits
+    // in the analysis window; false, keeping the current size, otherwise
+    bool setFftSize(int size);
+    static bool isValidFftSize(int size);
+    int getFftSize() const { return fft_size; }
+    void setPlannerFlags(unsigned flags) { planner_flags = flags; }
     void update();
+    // Mono bands of the newest snapshot
     FrequencyBands getFrequencyBands();
+    FrequencyBands getRawBands() const { return raw_bands; }
+
+    // Snapshot at a capture time: interpolated between snapshots, extrapolated at most one
+    // hop past the newest, and held beyond that
+    BandSnapshot getBandsAt(Uint64 time_ns) const;
+    Uint64 getLatestSnapshotTime() const { return snapshots.empty() ? 0 : snapshots.back().time_ns; }
+    // 0 when initialize() failed and there is no format to time against
+    Uint64 getSnapshotIntervalNS() const { return hasFormat() ? (Uint64)snapshot_hop * SDL_NS_PER_SECOND / spec.freq : 0; }
+    Uint64 getAnalysisWindowNS() const { return hasFormat() ? (Uint64)analysis_size * SDL_NS_PER_SECOND / spec.freq : 0; }
+
+    // Columns are numbered from 0 in the order they were produced; only the newest few are kept
+    Uint64 getColumnCount() const { return column_count; }
+    const SpectrumColumn* getColumn(Uint64 index) const;
+
+    // Per-channel bands from the newest snapshot, normalized like the mono bands.
+    // Channels are numbered across devices in the order they were opened
+    int getChannelCount() const { return (int)channels.size(); }
+    FrequencyBands getChannelBands(int channel) const;
     std::array<float, 3> getCoefficients();  // Returns [bass, mid, high]
+    float getLevel() const { return level; }
+    BeatInfo getBeatInfo();
+    float getBpm() const { return 60.0f / beat_period; }
+    CaptureTiming getCaptureTiming() const { return capture_timing; }
+
+    // Mixes a short full-scale burst into the next update(); getClickTime() then
+    // returns the capture time of its first sample (0 before any click)
+    void injectClick() { click_pending = true; }
+    Uint64 getClickTime() const { return click_ns; }
     void cleanup();
 };
 
@@ -0,0 +1,217 @@
+#include "BandFile.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[4] = {'H', 'A', 'B', 'F'};
+
+// Small enough that at most one hop completes per push
+const int BLOCK_FRAMES = 256;
+
+AudioAnalyzer::FrequencyBands mix(const AudioAnalyzer::FrequencyBands& a, const AudioAnalyzer::FrequencyBands& b, float t) {
+    AudioAnalyzer::FrequencyBands result = {
+        a.bass + (b.bass - a.bass) * t,
+        a.mid + (b.mid - a.mid) * t,
+        a.high + (b.high - a.high) * t
+    };
+    return result;
+}
+
+// RMS of the mono mix over the hop_frames frames before end
+float hopLevel(const float* interleaved, Uint64 frames, int num_channels, Uint64 end, Uint64 hop_frames) {
+    end = std::min(end, frames);
+    Uint64 start = end > hop_frames ? end - hop_frames : 0;
+    if (start >= end) return 0.0f;
+
+    double sum_squares = 0.0;
+    for (Uint64 frame = start; frame < end; frame++) {
+        float mono = 0.0f;
+        for (int channel = 0; channel < num_channels; channel++) {
+            mono += interleaved[frame * num_channels + channel];
+        }
+        mono /= num_channels;
+        sum_squares += mono * mono;
+    }
+    return (float)std::sqrt(sum_squares / (end - start));
+}
+
+}
+
+BandFile::~BandFile() {
+    close();
+}
+
+bool BandFile::write(const std::string& path, const float* interleaved, Uint64 frames, int sample_rate, int num_channels) {
+    AudioAnalyzer analyzer;
+    if (!analyzer.initializeOffline(sample_rate, num_channels)) {
+        return false;
+    }
+
+    // Written beside the target and renamed, so a reader never maps a half-written file
+    std::string temp_path = path + ".tmp";
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open " << temp_path << " for writing\n";
+        return false;
+    }
+
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.record_size = sizeof(Record);
+    header.sample_rate = sample_rate;
+    header.num_channels = num_channels;
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    Record record;
+    std::memset(&record, 0, sizeof(record));
+    Uint64 hop_frames = std::max<Uint64>(1, analyzer.getSnapshotIntervalNS() * sample_rate / SDL_NS_PER_SECOND);
+    Uint64 written = 0;
+    bool onset = false;
+    for (Uint64 offset = 0; offset < frames; offset += BLOCK_FRAMES) {
+        int count = (int)std::min((Uint64)BLOCK_FRAMES, frames - offset);
+        analyzer.pushSamples(interleaved + offset * num_channels, count);
+
+        AudioAnalyzer::BeatInfo beat = analyzer.getBeatInfo();
+        onset = onset || beat.onset;
+
+        for (; written < analyzer.getColumnCount(); written++) {
+            const AudioAnalyzer::SpectrumColumn* column = analyzer.getColumn(written);
+            record.snapshot = analyzer.getBandsAt(column->time_ns);
+            record.beat = beat;
+            record.beat.onset = onset;
+            record.column = *column;
+            record.rms = hopLevel(interleaved, frames, num_channels,
+                                  column->time_ns * sample_rate / SDL_NS_PER_SECOND + 1, hop_frames);
+            std::fwrite(&record, sizeof(record), 1, file);
+            onset = false;
+        }
+    }
+
+    header.record_count = written;
+    header.hop_ns = analyzer.getSnapshotIntervalNS();
+    header.duration_ns = frames * SDL_NS_PER_SECOND / sample_rate;
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    bool ok = !std::ferror(file);
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write " << path << "\n";
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool BandFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open " << path << "\n";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Header)) {
+        std::cerr << path << " is not a band file\n";
+        ::close(fd);
+        return false;
+    }
+
+    mapping_size = (size_t)info.st_size;
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map " << path << "\n";
+        mapping = nullptr;
+        return false;
+    }
+
+    const Header* candidate = (const Header*)mapping;
+    if (std::memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) != 0) {
+        std::cerr << path << " is not a band file\n";
+    } else if (candidate->version != VERSION || candidate->record_size != sizeof(Record)) {
+        std::cerr << path << " is band file version " << candidate->version << " (this build reads " << VERSION
+                  << "), re-analyze the audio\n";
+    } else if (candidate->record_count == 0 ||
+               mapping_size < sizeof(Header) + candidate->record_count * sizeof(Record)) {
+        std::cerr << path << " is empty or truncated\n";
+    } else {
+        header = candidate;
+        records = (const Record*)((const char*)mapping + sizeof(Header));
+        return true;
+    }
+
+    close();
+    return false;
+}
+
+void BandFile::close() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = nullptr;
+    mapping_size = 0;
+    header = nullptr;
+    records = nullptr;
+}
+
+Uint64 BandFile::countAt(Uint64 time_ns) const {
+    Uint64 count = getRecordCount();
+    if (count == 0 || time_ns < records[0].snapshot.time_ns) return 0;
+
+    // Hops are exact in audio time; the walk only corrects rounding
+    Uint64 guess = header->hop_ns > 0 ? (time_ns - records[0].snapshot.time_ns) / header->hop_ns + 1 : count;
+    guess = std::min(guess, count);
+    while (guess > 0 && records[guess - 1].snapshot.time_ns > time_ns) guess--;
+    while (guess < count && records[guess].snapshot.time_ns <= time_ns) guess++;
+    return guess;
+}
+
+AudioAnalyzer::BandSnapshot BandFile::getBandsAt(Uint64 time_ns) const {
+    Uint64 index = countAt(time_ns);
+    if (index == 0) return records[0].snapshot;
+    if (index >= getRecordCount()) return records[getRecordCount() - 1].snapshot;
+
+    const AudioAnalyzer::BandSnapshot& a = records[index - 1].snapshot;
+    const AudioAnalyzer::BandSnapshot& b = records[index].snapshot;
+    float t = (float)(time_ns - a.time_ns) / (float)(b.time_ns - a.time_ns);
+
+    AudioAnalyzer::BandSnapshot result;
+    result.time_ns = time_ns;
+    result.bands = mix(a.bands, b.bands, t);
+    result.left = mix(a.left, b.left, t);
+    result.right = mix(a.right, b.right, t);
+    return result;
+}
+
+AudioAnalyzer::BeatInfo BandFile::getBeatAt(Uint64 time_ns) const {
+    Uint64 index = countAt(time_ns);
+    const Record& record = records[index > 0 ? index - 1 : 0];
+
+    AudioAnalyzer::BeatInfo beat = record.beat;
+    if (time_ns > record.snapshot.time_ns && beat.bpm > 0.0f) {
+        double elapsed = (double)(time_ns - record.snapshot.time_ns) / SDL_NS_PER_SECOND;
+        beat.beat_phase = (float)std::fmod(beat.beat_phase + elapsed * beat.bpm / 60.0, 1.0);
+    }
+    if (index < getRecordCount() && index > 0) {
+        const Record& next = records[index];
+        float t = (float)(time_ns - record.snapshot.time_ns) / (float)(next.snapshot.time_ns - record.snapshot.time_ns);
+        beat.onset_strength += (next.beat.onset_strength - beat.onset_strength) * t;
+    }
+    return beat;
+}
+
+float BandFile::getLevelAt(Uint64 time_ns) const {
+    Uint64 index = countAt(time_ns);
+    return records[index > 0 ? index - 1 : 0].rms;
+}
@@ -0,0 +1,71 @@
+#ifndef BAND_FILE_H
+#define BAND_FILE_H
+
+#include "AudioAnalyzer.h"
+#include <string>
+
+// A whole track's analysis, computed once (see analyze.cpp) and shared read-only between
+// render processes through mmap: one record per analyzer hop with the bands, beat state,
+// level and spectrum column at that audio time. Frames sample it at their own audio time
+// instead of running FFTs, and can start anywhere in the track
+class BandFile {
+public:
+    // Bumped whenever Header or Record change; older files must be re-analyzed
+    static const Uint32 VERSION = 2;
+
+    struct Header {
+        char magic[4];        // "HABF"
+        Uint32 version;
+        Uint32 record_size;   // sizeof(Record); a build with a different layout refuses the file
+        Uint32 sample_rate;
+        Uint32 num_channels;
+        Uint32 reserved;
+        Uint64 record_count;
+        Uint64 hop_ns;        // Audio time between records
+        Uint64 duration_ns;   // Length of the analyzed audio
+    };
+
+    struct Record {
+        AudioAnalyzer::BandSnapshot snapshot;  // time_ns is audio time from the start of the track
+        AudioAnalyzer::BeatInfo beat;          // onset: one was detected during this hop
+        AudioAnalyzer::SpectrumColumn column;
+        float rms;                             // Of the mono mix over this hop
+    };
+
+    BandFile() {}
+    ~BandFile();
+
+    // Runs the analyzer over interleaved float frames and writes every hop to path
+    static bool write(const std::string& path, const float* interleaved, Uint64 frames, int sample_rate, int num_channels);
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    Uint64 getRecordCount() const { return header ? header->record_count : 0; }
+    Uint64 getHopNS() const { return header ? header->hop_ns : 0; }
+    Uint64 getDurationNS() const { return header ? header->duration_ns : 0; }
+    int getSampleRate() const { return header ? (int)header->sample_rate : 0; }
+    int getChannelCount() const { return header ? (int)header->num_channels : 0; }
+    const Record& getRecord(Uint64 index) const { return records[index]; }
+
+    // Records at or before time_ns. Records are a hop apart, so this is a direct index
+    Uint64 countAt(Uint64 time_ns) const;
+    // Bands interpolated between the records around time_ns, held past either end
+    AudioAnalyzer::BandSnapshot getBandsAt(Uint64 time_ns) const;
+    // Beat state of the newest record at time_ns, its phase advanced to time_ns
+    AudioAnalyzer::BeatInfo getBeatAt(Uint64 time_ns) const;
+    // RMS of the newest hop at time_ns
+    float getLevelAt(Uint64 time_ns) const;
+
+private:
+    const Header* header = nullptr;
+    const Record* records = nullptr;
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+
+    BandFile(const BandFile&);
+    BandFile& operator=(const BandFile&);
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "CameraDirector.h"
+#include "BandFile.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+CameraPath::Pose lerp(const CameraPath::Pose& a, const CameraPath::Pose& b, float t) {
+    CameraPath::Pose pose = {
+        a.x + (b.x - a.x) * t,
+        a.y + (b.y - a.y) * t,
+        a.z + (b.z - a.z) * t,
+        a.yaw + (b.yaw - a.yaw) * t,
+        a.pitch + (b.pitch - a.pitch) * t
+    };
+    return pose;
+}
+
+float bandEnergy(const AudioAnalyzer::FrequencyBands& bands) {
+    return (bands.bass + bands.mid + bands.high) / 3.0f;
+}
+
+}
+
+CameraDirector::~CameraDirector() {
+    stop();
+}
+
+bool CameraDirector::start(const CameraPath& camera_path, const BandFile* bands, double offset) {
+    if (thread.joinable()) {
+        std::cerr << "CameraDirector already running\n";
+        return false;
+    }
+
+    path = camera_path;
+    band_file = bands;
+    band_offset.store(offset);
+    lookahead = band_file ? BAND_FILE_LOOKAHEAD : LIVE_LOOKAHEAD;
+    next_state = 0;
+    path_time = 0.0;
+    smoothed_energy = 0.0f;
+    last_cut_time = -settings.min_cut_interval;
+    have_current = false;
+    pending_cut = false;
+    render_time.store(0.0f);
+
+    running = true;
+    thread = std::thread(&CameraDirector::run, this);
+    return true;
+}
+
+void CameraDirector::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void CameraDirector::pushFeatures(const Features& value) {
+    // A full ring means the director is stalled; the newest features win once it drains
+    features.push(value);
+}
+
+void CameraDirector::run() {
+    while (running) {
+        const Features* pending;
+        while ((pending = features.front()) != nullptr) {
+            bool onset = live.onset || pending->onset;
+            live = *pending;
+            live.onset = onset;
+            features.pop();
+        }
+
+        float horizon = render_time.load(std::memory_order_relaxed) + lookahead;
+        bool produced = false;
+        while (!states.full() && (float)next_state / STATE_RATE <= horizon) {
+            direct();
+            produced = true;
+        }
+        if (!produced) {
+            SDL_DelayNS(SDL_NS_PER_MS);
+        }
+    }
+}
+
+CameraDirector::Features CameraDirector::featuresAt(float time) {
+    if (!band_file) {
+        Features features = live;
+        live.onset = false;  // Each live onset drives one state
+        return features;
+    }
+
+    Uint64 time_ns = (Uint64)(std::max(time + band_offset.load(std::memory_order_relaxed), 0.0) * SDL_NS_PER_SECOND);
+    Features features = {time, bandEnergy(band_file->getBandsAt(time_ns).bands), band_file->getBeatAt(time_ns).onset};
+    return features;
+}
+
+// One state: the path advances at an energy-driven speed, and a strong enough onset after
+// a quiet spell of cuts jumps it ahead
+void CameraDirector::direct() {
+    const float step = 1.0f / STATE_RATE;
+    float time = (float)next_state / STATE_RATE;
+    Features audio = featuresAt(time);
+
+    float weight = 1.0f - std::exp(-step / settings.energy_smoothing_time);
+    smoothed_energy += (std::min(std::max(audio.energy, 0.0f), 1.0f) - smoothed_energy) * weight;
+
+    bool cut = false;
+    if (audio.onset && next_state > 0 && time - last_cut_time >= settings.min_cut_interval) {
+        path_time += settings.cut_distance;
+        last_cut_time = time;
+        cut = true;
+    }
+
+    State state = {time, path.sample((float)path_time), cut};
+    states.push(state);
+    next_state++;
+
+    float speed = settings.min_speed + (settings.max_speed - settings.min_speed) * smoothed_energy;
+    path_time += step * speed;
+}
+
+const CameraDirector::State* CameraDirector::consumeTo(float time) {
+    render_time.store(time, std::memory_order_relaxed);
+
+    const State* next;
+    while ((next = states.front()) != nullptr && next->time <= time) {
+        current = *next;
+        pending_cut = pending_cut || current.cut;
+        have_current = true;
+        states.pop();
+    }
+    return next;
+}
+
+bool CameraDirector::poseAt(float time, CameraPath::Pose& pose, bool& cut) {
+    const State* next = consumeTo(time);
+    if (!have_current) {
+        return false;
+    }
+
+    // Interpolating into a cut would sweep the camera through the jump
+    if (next && !next->cut && next->time > current.time) {
+        pose = lerp(current.pose, next->pose, (time - current.time) / (next->time - current.time));
+    } else {
+        pose = current.pose;
+    }
+    cut = pending_cut;
+    pending_cut = false;
+    return true;
+}
+
+void CameraDirector::waitFor(float time) {
+    while (running && !consumeTo(time)) {
+        SDL_DelayNS(100 * SDL_NS_PER_US);
+    }
+}
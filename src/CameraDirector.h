@@ -0,0 +1,103 @@
+#ifndef CAMERA_DIRECTOR_H
+#define CAMERA_DIRECTOR_H
+
+#include <SDL3/SDL.h>
+#include <thread>
+#include <atomic>
+#include "CameraPath.h"
+#include "SpscRing.h"
+
+class BandFile;
+
+// Audio-driven automatic camera, computed on its own thread ahead of the frames that need
+// it. The director flies a CameraPath faster on loud passages and cuts to a distant part of
+// the path on strong onsets, publishing timed camera states through a lock-free ring; the
+// render thread interpolates them at each frame's time and never waits for the director
+// (except when recording, where frames have no deadline and must be reproducible)
+class CameraDirector {
+public:
+    // Audio at one moment, pushed by the render thread when there's no band file to read
+    struct Features {
+        float time;    // Camera time (elapsed_time)
+        float energy;  // Mean of the normalized bands, ~0-1
+        bool onset;
+    };
+
+    struct State {
+        float time;
+        CameraPath::Pose pose;
+        bool cut;  // Jumped here from the previous state; nothing carries across
+    };
+
+    struct Settings {
+        float min_speed;              // Path seconds per second in silence
+        float max_speed;              // ... at full energy
+        float energy_smoothing_time;  // seconds
+        float min_cut_interval;       // seconds between cuts
+        float cut_distance;           // Path seconds skipped by a cut
+    };
+
+    CameraDirector() {}
+    ~CameraDirector();
+
+    // Takes its own copy of path. With a band file the director reads the audio ahead of
+    // time itself; band_offset is the track time at camera time 0 (see --start)
+    bool start(const CameraPath& path, const BandFile* band_file, double band_offset);
+    void stop();
+    bool isRunning() const { return thread.joinable(); }
+
+    // Render thread only
+    void pushFeatures(const Features& features);
+    // After a seek; states already queued (up to the lookahead) still use the old offset
+    void setBandOffset(double offset) { band_offset.store(offset, std::memory_order_relaxed); }
+    // Camera pose at time. False until the director has reached time; cut is set once, on
+    // the first frame after a cut
+    bool poseAt(float time, CameraPath::Pose& pose, bool& cut);
+    // Blocks until poseAt(time) can interpolate, for offline rendering
+    void waitFor(float time);
+
+    Settings& getSettings() { return settings; }
+
+private:
+    // Direction states are generated at this rate and interpolated between
+    static const int STATE_RATE = 120;
+    // Live audio only becomes known at present time, so states run just ahead of it; a band
+    // file is known in advance and can fill the ring
+    static constexpr float LIVE_LOOKAHEAD = 0.1f;
+    static constexpr float BAND_FILE_LOOKAHEAD = 2.0f;
+
+    void run();
+    void direct();
+    // Takes states up to time as current; returns the next one, if produced yet
+    const State* consumeTo(float time);
+    Features featuresAt(float time);
+
+    Settings settings = {0.5f, 3.0f, 0.5f, 4.0f, 20.0f};
+
+    // Director thread
+    CameraPath path;
+    const BandFile* band_file = nullptr;
+    std::atomic<double> band_offset{0.0};
+    Uint64 next_state = 0;  // Index of the next state; states are at index / STATE_RATE
+    double path_time = 0.0;
+    float smoothed_energy = 0.0f;
+    float last_cut_time = 0.0f;
+    Features live = {0.0f, 0.0f, false};
+    float lookahead = LIVE_LOOKAHEAD;
+
+    // Render thread
+    State current = {0.0f, {0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, false};
+    bool have_current = false;
+    bool pending_cut = false;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<float> render_time{0.0f};
+    SpscRing<Features, 64> features;
+    SpscRing<State, STATE_RATE * 5 / 2> states;
+
+    CameraDirector(const CameraDirector&);
+    CameraDirector& operator=(const CameraDirector&);
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "CameraPath.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// The old auto-movement: 0.25 units/s along each axis, yaw drifting 0.2 rad/s, every
+// direction possibly flipping after 0.5 - 4 seconds
+const float AUTO_SPEED = 0.25f;
+const float AUTO_YAW_RATE = 0.2f;
+const float MIN_INTERVAL = 0.5f;
+const float MAX_INTERVAL = 4.0f;
+
+CameraPath::Pose lerp(const CameraPath::Pose& a, const CameraPath::Pose& b, float t) {
+    CameraPath::Pose pose = {
+        a.x + (b.x - a.x) * t,
+        a.y + (b.y - a.y) * t,
+        a.z + (b.z - a.z) * t,
+        a.yaw + (b.yaw - a.yaw) * t,
+        a.pitch + (b.pitch - a.pitch) * t
+    };
+    return pose;
+}
+
+// Finite-difference velocity at keys[i], one-sided at the ends
+CameraPath::Pose tangent(const std::vector<CameraPath::Key>& keys, size_t i) {
+    size_t before = i > 0 ? i - 1 : i;
+    size_t after = i + 1 < keys.size() ? i + 1 : i;
+    float span = keys[after].time - keys[before].time;
+    CameraPath::Pose velocity = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    if (span <= 0.0f) return velocity;
+
+    const CameraPath::Pose& a = keys[before].pose;
+    const CameraPath::Pose& b = keys[after].pose;
+    velocity.x = (b.x - a.x) / span;
+    velocity.y = (b.y - a.y) / span;
+    velocity.z = (b.z - a.z) / span;
+    velocity.yaw = (b.yaw - a.yaw) / span;
+    velocity.pitch = (b.pitch - a.pitch) / span;
+    return velocity;
+}
+
+float hermite(float p0, float m0, float p1, float m1, float t, float span) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return (2.0f * t3 - 3.0f * t2 + 1.0f) * p0 + (t3 - 2.0f * t2 + t) * span * m0 +
+           (-2.0f * t3 + 3.0f * t2) * p1 + (t3 - t2) * span * m1;
+}
+
+bool keyBefore(float time, const CameraPath::Key& key) {
+    return time < key.time;
+}
+
+}
+
+void CameraPath::generate(Uint32 path_seed, const Pose& start, float min_y, float max_y) {
+    seed = path_seed;
+    rng_state = seed != 0 ? seed : 1;  // xorshift sticks at 0
+    y_min = min_y;
+    y_max = max_y;
+    direction_x = direction_y = direction_z = yaw_direction = 1.0f;
+    replay = false;
+
+    Key key = {0.0f, start};
+    key.pose.y = std::min(std::max(key.pose.y, y_min), y_max);
+    keys.assign(1, key);
+}
+
+bool CameraPath::load(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) {
+        std::cerr << "Failed to open camera track " << path << "\n";
+        return false;
+    }
+
+    std::vector<Key> loaded;
+    char line[256];
+    int line_number = 0;
+    bool ok = true;
+    while (ok && std::fgets(line, sizeof(line), file)) {
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        Key key;
+        ok = std::sscanf(line, "%f %f %f %f %f %f", &key.time, &key.pose.x, &key.pose.y, &key.pose.z,
+                         &key.pose.yaw, &key.pose.pitch) == 6 &&
+             (loaded.empty() || key.time > loaded.back().time);
+        if (ok) {
+            loaded.push_back(key);
+        } else {
+            std::cerr << path << ":" << line_number << ": expected increasing \"time x y z yaw pitch\"\n";
+        }
+    }
+    std::fclose(file);
+
+    if (!ok || loaded.empty()) {
+        if (ok) std::cerr << "Camera track " << path << " has no keys\n";
+        return false;
+    }
+    keys.swap(loaded);
+    replay = true;
+    return true;
+}
+
+float CameraPath::getDuration() const {
+    return replay && !keys.empty() ? keys.back().time : INFINITY;
+}
+
+float CameraPath::random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (float)(rng_state >> 8) / 16777216.0f;
+}
+
+// Appends one leg of the wander. Keys only ever depend on the ones before them, so the
+// path is the same however far ahead it has been sampled
+void CameraPath::extend() {
+    const Key& last = keys.back();
+    float interval = MIN_INTERVAL + random() * (MAX_INTERVAL - MIN_INTERVAL);
+    if (random() < 0.5f) direction_x = -direction_x;
+    if (random() < 0.5f) direction_y = -direction_y;
+    if (random() < 0.5f) direction_z = -direction_z;
+    if (random() < 0.5f) yaw_direction = -yaw_direction;
+
+    Key key;
+    key.time = last.time + interval;
+    key.pose.yaw = last.pose.yaw + AUTO_YAW_RATE * yaw_direction * interval;
+    key.pose.pitch = last.pose.pitch;
+
+    // Moves along the heading halfway through the leg's turn
+    float heading = 0.5f * (last.pose.yaw + key.pose.yaw);
+    key.pose.x = last.pose.x + std::sin(heading) * direction_x * AUTO_SPEED * interval;
+    key.pose.z = last.pose.z + std::cos(heading) * direction_z * AUTO_SPEED * interval;
+
+    // Bounce off the height limits instead of sliding along them
+    float y = last.pose.y + direction_y * AUTO_SPEED * interval;
+    if (y > y_max) {
+        y = std::max(2.0f * y_max - y, y_min);
+        direction_y = -1.0f;
+    } else if (y < y_min) {
+        y = std::min(2.0f * y_min - y, y_max);
+        direction_y = 1.0f;
+    }
+    key.pose.y = y;
+    keys.push_back(key);
+}
+
+CameraPath::Pose CameraPath::sample(float time) {
+    if (keys.empty()) {
+        Pose origin = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        return origin;
+    }
+    // Generate one key past the segment's end, so its end tangent is final
+    while (!replay && (keys.size() < 2 || keys[keys.size() - 2].time <= time)) {
+        extend();
+    }
+
+    if (time <= keys.front().time) return keys.front().pose;
+    if (time >= keys.back().time) return keys.back().pose;
+
+    size_t next = std::upper_bound(keys.begin(), keys.end(), time, keyBefore) - keys.begin();
+    size_t prev = next - 1;
+    const Key& a = keys[prev];
+    const Key& b = keys[next];
+    float span = b.time - a.time;
+    float t = (time - a.time) / span;
+
+    // Per-frame replay keys are too dense for the tangents to matter
+    if (replay && span < 0.1f) return lerp(a.pose, b.pose, t);
+
+    Pose ma = tangent(keys, prev);
+    Pose mb = tangent(keys, next);
+    Pose pose = {
+        hermite(a.pose.x, ma.x, b.pose.x, mb.x, t, span),
+        hermite(a.pose.y, ma.y, b.pose.y, mb.y, t, span),
+        hermite(a.pose.z, ma.z, b.pose.z, mb.z, t, span),
+        hermite(a.pose.yaw, ma.yaw, b.pose.yaw, mb.yaw, t, span),
+        hermite(a.pose.pitch, ma.pitch, b.pose.pitch, mb.pitch, t, span)
+    };
+    return pose;
+}
+
+void CameraPath::prefetch(float time, float step, int count, std::vector<Pose>& poses) {
+    poses.resize(std::max(count, 0));
+    for (int i = 0; i < count; i++) {
+        poses[i] = sample(time + step * i);
+    }
+}
+
+CameraTrackWriter::~CameraTrackWriter() {
+    close();
+}
+
+bool CameraTrackWriter::open(const std::string& path, Uint32 seed) {
+    close();
+    file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "Failed to open " << path << " for writing\n";
+        return false;
+    }
+    std::fprintf(file, "# huawei_audio camera track, recorded with seed %u\n", seed);
+    std::fprintf(file, "# time x y z yaw pitch\n");
+    return true;
+}
+
+void CameraTrackWriter::write(float time, const CameraPath::Pose& pose) {
+    if (!file) return;
+    // %.9g round-trips a float, so replay lands on exactly the recorded poses
+    std::fprintf(file, "%.9g %.9g %.9g %.9g %.9g %.9g\n", time, pose.x, pose.y, pose.z, pose.yaw, pose.pitch);
+}
+
+void CameraTrackWriter::close() {
+    if (file) {
+        std::fclose(file);
+        file = nullptr;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+// The automatic camera as a spline through timed keys. Keys either come from a seeded
+// generator that wanders the way the old random auto-movement did, or from a recorded
+// track; either way the pose at any time is known in advance, so the same seed (or file)
+// gives the same flight in every run and process, and callers can look ahead
+class CameraPath {
+public:
+    struct Pose {
+        float x, y, z;
+        float yaw, pitch;
+    };
+
+    struct Key {
+        float time;  // seconds
+        Pose pose;
+    };
+
+    CameraPath() {}
+
+    // Generated path from the seed, starting at start and kept within [y_min, y_max]
+    void generate(Uint32 seed, const Pose& start, float y_min, float y_max);
+    // Replays a track written by CameraTrackWriter; holds its last pose past the end
+    bool load(const std::string& path);
+
+    bool isReplay() const { return replay; }
+    Uint32 getSeed() const { return seed; }
+    // End of a loaded track; generated paths never end
+    float getDuration() const;
+
+    // Pose at time; passes through every key, with smooth velocity between them
+    Pose sample(float time);
+    // count poses from time, step seconds apart, e.g. where the camera will be over the next frames
+    void prefetch(float time, float step, int count, std::vector<Pose>& poses);
+
+private:
+    void extend();
+    float random();  // [0, 1)
+
+    std::vector<Key> keys;
+    bool replay = false;
+
+    // Generator state
+    Uint32 seed = 1;
+    Uint32 rng_state = 1;
+    float y_min = 0.0f;
+    float y_max = 0.0f;
+    float direction_x = 1.0f;
+    float direction_y = 1.0f;
+    float direction_z = 1.0f;
+    float yaw_direction = 1.0f;
+};
+
+// Writes the camera's actual pose each frame as a text track CameraPath::load() replays:
+// one "time x y z yaw pitch" line per frame
+class CameraTrackWriter {
+public:
+    CameraTrackWriter() {}
+    ~CameraTrackWriter();
+
+    bool open(const std::string& path, Uint32 seed);
+    void write(float time, const CameraPath::Pose& pose);
+    void close();
+    bool isOpen() const { return file != nullptr; }
+
+private:
+    FILE* file = nullptr;
+
+    CameraTrackWriter(const CameraTrackWriter&);
+    CameraTrackWriter& operator=(const CameraTrackWriter&);
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "ConfigWatcher.h"
+#include <iostream>
+#include <chrono>
+
+namespace {
+
+// 0 when the file doesn't exist
+SDL_Time modifyTime(const std::string& path) {
+    SDL_PathInfo info;
+    if (!SDL_GetPathInfo(path.c_str(), &info) || info.type != SDL_PATHTYPE_FILE) {
+        return 0;
+    }
+    return info.modify_time;
+}
+
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    stop();
+}
+
+bool ConfigWatcher::start(const std::string& watch_path, Callback callback, int poll_interval_ms) {
+    if (running) {
+        std::cerr << "ConfigWatcher already watching " << path << "\n";
+        return false;
+    }
+
+    path = watch_path;
+    on_change = callback;
+    poll_ms = poll_interval_ms;
+    running = true;
+    thread = std::thread(&ConfigWatcher::run, this);
+    return true;
+}
+
+void ConfigWatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+    }
+    wake.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ConfigWatcher::run() {
+    SDL_Time loaded = modifyTime(path);
+    SDL_Time seen = loaded;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        wake.wait_for(lock, std::chrono::milliseconds(poll_ms));
+        if (!running) break;
+
+        lock.unlock();
+        SDL_Time current = modifyTime(path);
+
+        // Editors often save in several writes; wait for one quiet poll before reloading
+        if (current != seen) {
+            seen = current;
+        } else if (current != loaded && current != 0) {
+            loaded = current;
+            on_change(path);
+        }
+        lock.lock();
+    }
+}
+
+std::string ConfigWatcher::findFile(const std::vector<std::string>& candidates) {
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (modifyTime(candidates[i]) != 0) {
+            return candidates[i];
+        }
+    }
+    return std::string();
+}
@@ -0,0 +1,43 @@
+#ifndef CONFIG_WATCHER_H
+#define CONFIG_WATCHER_H
+
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Polls a file's modification time on a background thread and calls back (on that thread)
+// once a change has settled, so parsing never runs on the render thread
+class ConfigWatcher {
+public:
+    typedef std::function<void(const std::string& path)> Callback;
+
+    ConfigWatcher() {}
+    ~ConfigWatcher();
+
+    bool start(const std::string& path, Callback on_change, int poll_ms = 250);
+    void stop();
+
+    // First of the candidates that exists, or an empty string
+    static std::string findFile(const std::vector<std::string>& candidates);
+
+private:
+    void run();
+
+    std::string path;
+    Callback on_change;
+    int poll_ms = 250;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running = false;
+
+    ConfigWatcher(const ConfigWatcher&);
+    ConfigWatcher& operator=(const ConfigWatcher&);
+};
+
+#endif
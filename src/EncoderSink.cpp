@@ -0,0 +1,449 @@
+#include "EncoderSink.h"
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#endif
+
+#ifdef HAVE_LIBAV
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
+}
+#endif
+
+namespace {
+
+// Uncompressed YUV 4:2:0, which ffmpeg and most editors read from a pipe
+class Y4MSink : public EncoderSink {
+    std::string path;
+    FILE* file = nullptr;
+    int width = 0;
+    int height = 0;
+
+public:
+    explicit Y4MSink(const std::string& path) : path(path) {}
+    ~Y4MSink() { close(); }
+
+    bool open(int frame_width, int frame_height, float fps) override {
+        width = frame_width;
+        height = frame_height;
+        file = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Failed to open " << path << " for writing\n";
+            return false;
+        }
+        // Whole frames per write: 1 MB covers a 1024x1024 frame's planes in two writes
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+        int rate = (int)std::lround(fps * 1000.0f);
+        std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, rate);
+        return true;
+    }
+
+    bool write(const Frame& frame) override {
+        int chroma_width = (width + 1) / 2;
+        int chroma_height = (height + 1) / 2;
+
+        std::fputs("FRAME\n", file);
+        for (int y = 0; y < height; y++) {
+            std::fwrite(frame.y + y * frame.y_pitch, 1, width, file);
+        }
+        for (int y = 0; y < chroma_height; y++) {
+            std::fwrite(frame.u + y * frame.uv_pitch, 1, chroma_width, file);
+        }
+        for (int y = 0; y < chroma_height; y++) {
+            std::fwrite(frame.v + y * frame.uv_pitch, 1, chroma_width, file);
+        }
+        if (std::ferror(file)) {
+            std::cerr << "Failed writing Y4M frame " << frame.index << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    void close() override {
+        if (!file) return;
+        std::fflush(file);
+        if (file != stdout) {
+            std::fclose(file);
+        }
+        file = nullptr;
+    }
+
+    bool wantsYUV() const override { return true; }
+    const char* getName() const override { return "y4m"; }
+};
+
+#ifdef HAVE_PNG
+
+// One PNG per frame; compression is the slow part, so a pool of workers writes frames
+// in parallel while the encoder thread moves on
+class PNGSink : public EncoderSink {
+    struct Job {
+        Uint64 index;
+        std::vector<Uint8> rgba;
+    };
+
+    std::string pattern;  // As given, for messages
+    // The pattern split around its one integer conversion
+    std::string prefix;
+    std::string suffix;
+    int digits = 0;
+    bool zero_pad = false;
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+
+    std::vector<std::thread> workers;
+    std::deque<Job> queue;
+    std::vector<std::vector<Uint8> > spare;  // Recycled frame buffers
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable space_ready;
+    size_t max_queued = 0;
+    bool stopping = false;
+    std::atomic<bool> failed;
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            work_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+
+            Job job = std::move(queue.front());
+            queue.pop_front();
+            space_ready.notify_one();
+            lock.unlock();
+
+            char number[32];
+            std::snprintf(number, sizeof(number), zero_pad ? "%0*llu" : "%*llu", digits, (unsigned long long)job.index);
+            std::string filename = prefix + number + suffix;
+
+            png_image image = {};
+            image.version = PNG_IMAGE_VERSION;
+            image.width = width;
+            image.height = height;
+            image.format = PNG_FORMAT_RGBA;
+            if (!png_image_write_to_file(&image, filename.c_str(), 0, job.rgba.data(), width * 4, nullptr)) {
+                std::cerr << "Failed to write " << filename << ": " << image.message << "\n";
+                failed = true;
+            }
+
+            lock.lock();
+            spare.push_back(std::move(job.rgba));
+        }
+    }
+
+public:
+    explicit PNGSink(const std::string& pattern) : pattern(pattern), failed(false) {
+        // A bare directory or name gets a numbered suffix
+        if (pattern.find('%') == std::string::npos) {
+            this->pattern += "%06llu.png";
+        }
+        valid = parsePattern(this->pattern, prefix, digits, zero_pad, suffix);
+    }
+
+    // The pattern is never handed to printf: it may hold exactly one integer conversion,
+    // %[0][width][l|ll|z](d|i|u), for the frame index, and %% for a literal percent sign
+    static bool parsePattern(const std::string& pattern, std::string& prefix, int& digits, bool& zero_pad,
+                             std::string& suffix) {
+        std::string* out = &prefix;
+        bool found = false;
+        prefix.clear();
+        suffix.clear();
+        digits = 0;
+        zero_pad = false;
+
+        for (size_t i = 0; i < pattern.size(); i++) {
+            if (pattern[i] != '%') {
+                *out += pattern[i];
+                continue;
+            }
+            if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+                *out += '%';
+                i++;
+                continue;
+            }
+            if (found) return false;
+
+            size_t j = i + 1;
+            if (j < pattern.size() && pattern[j] == '0') {
+                zero_pad = true;
+                j++;
+            }
+            while (j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9' && digits < 100) {
+                digits = digits * 10 + (pattern[j] - '0');
+                j++;
+            }
+            if (digits > 20) return false;
+            if (pattern.compare(j, 2, "ll") == 0) {
+                j += 2;
+            } else if (j < pattern.size() && (pattern[j] == 'l' || pattern[j] == 'z')) {
+                j++;
+            }
+            if (j >= pattern.size() || (pattern[j] != 'd' && pattern[j] != 'i' && pattern[j] != 'u')) {
+                return false;
+            }
+
+            found = true;
+            out = &suffix;
+            i = j;
+        }
+        return found;
+    }
+    ~PNGSink() { close(); }
+
+    bool isValid() const { return valid; }
+
+    bool open(int frame_width, int frame_height, float fps) override {
+        width = frame_width;
+        height = frame_height;
+
+        // Leave a core for rendering and one for the encoder thread
+        unsigned cores = std::thread::hardware_concurrency();
+        unsigned count = cores > 3 ? cores - 2 : 1;
+        max_queued = count * 2;
+        for (unsigned i = 0; i < count; i++) {
+            workers.push_back(std::thread(&PNGSink::work, this));
+        }
+        std::cerr << "Writing PNGs to " << pattern << " with " << count << " threads\n";
+        return true;
+    }
+
+    bool write(const Frame& frame) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        space_ready.wait(lock, [this] { return queue.size() < max_queued; });
+
+        Job job;
+        job.index = frame.index;
+        if (!spare.empty()) {
+            job.rgba = std::move(spare.back());
+            spare.pop_back();
+        }
+        lock.unlock();
+
+        job.rgba.resize((size_t)width * height * 4);
+        for (int y = 0; y < height; y++) {
+            SDL_memcpy(job.rgba.data() + (size_t)y * width * 4, frame.rgba + (size_t)y * frame.rgba_pitch, width * 4);
+        }
+
+        lock.lock();
+        queue.push_back(std::move(job));
+        work_ready.notify_one();
+        return !failed;
+    }
+
+    void close() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_ready.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        workers.clear();
+    }
+
+    bool wantsYUV() const override { return false; }
+    const char* getName() const override { return "png"; }
+};
+
+#endif
+
+#ifdef HAVE_LIBAV
+
+// Compressed video through libavcodec/libavformat: H.264 via libx264 when available,
+// otherwise the container's default codec
+class LibavSink : public EncoderSink {
+    std::string path;
+    AVFormatContext* format = nullptr;
+    AVCodecContext* codec = nullptr;
+    AVStream* stream = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    int width = 0;
+    int height = 0;
+    bool header_written = false;  // A trailer only belongs after a header
+
+    bool drain() {
+        while (true) {
+            int result = avcodec_receive_packet(codec, packet);
+            if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) return true;
+            if (result < 0) return false;
+
+            av_packet_rescale_ts(packet, codec->time_base, stream->time_base);
+            packet->stream_index = stream->index;
+            if (av_interleaved_write_frame(format, packet) < 0) return false;
+        }
+    }
+
+public:
+    explicit LibavSink(const std::string& path) : path(path) {}
+    ~LibavSink() { close(); }
+
+    bool open(int frame_width, int frame_height, float fps) override {
+        width = frame_width;
+        height = frame_height;
+
+        if (avformat_alloc_output_context2(&format, nullptr, nullptr, path.c_str()) < 0 || !format) {
+            std::cerr << "libav: no container for " << path << "\n";
+            return false;
+        }
+
+        const AVCodec* encoder = avcodec_find_encoder_by_name("libx264");
+        if (!encoder) {
+            encoder = avcodec_find_encoder(format->oformat->video_codec);
+        }
+        if (!encoder) {
+            std::cerr << "libav: no video encoder for " << path << "\n";
+            return false;
+        }
+
+        stream = avformat_new_stream(format, nullptr);
+        codec = avcodec_alloc_context3(encoder);
+        if (!stream || !codec) return false;
+
+        codec->width = width;
+        codec->height = height;
+        codec->time_base = av_d2q(1.0 / fps, 100000);
+        codec->framerate = av_d2q(fps, 100000);
+        codec->pix_fmt = AV_PIX_FMT_YUV420P;
+        codec->color_range = AVCOL_RANGE_MPEG;
+        codec->colorspace = AVCOL_SPC_BT709;
+        codec->color_primaries = AVCOL_PRI_BT709;
+        codec->color_trc = AVCOL_TRC_IEC61966_2_1;
+        codec->gop_size = (int)(fps * 2.0f);
+        if (format->oformat->flags & AVFMT_GLOBALHEADER) {
+            codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        // Keep up with rendering; only x264 knows these, others ignore them
+        av_opt_set(codec->priv_data, "preset", "veryfast", 0);
+        av_opt_set(codec->priv_data, "crf", "18", 0);
+
+        if (avcodec_open2(codec, encoder, nullptr) < 0) {
+            std::cerr << "libav: failed to open " << encoder->name << "\n";
+            return false;
+        }
+        avcodec_parameters_from_context(stream->codecpar, codec);
+        stream->time_base = codec->time_base;
+
+        if (!(format->oformat->flags & AVFMT_NOFILE) && avio_open(&format->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+            std::cerr << "libav: failed to open " << path << " for writing\n";
+            return false;
+        }
+        if (avformat_write_header(format, nullptr) < 0) {
+            std::cerr << "libav: failed to write header\n";
+            return false;
+        }
+        header_written = true;
+
+        frame = av_frame_alloc();
+        packet = av_packet_alloc();
+        if (!frame || !packet) return false;
+        frame->format = codec->pix_fmt;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame, 0) < 0) return false;
+
+        std::cerr << "Encoding " << path << " with " << encoder->name << "\n";
+        return true;
+    }
+
+    bool write(const Frame& input) override {
+        if (av_frame_make_writable(frame) < 0) return false;
+
+        const Uint8* planes[3] = {input.y, input.u, input.v};
+        int pitches[3] = {input.y_pitch, input.uv_pitch, input.uv_pitch};
+        av_image_copy(frame->data, frame->linesize, planes, pitches, AV_PIX_FMT_YUV420P, width, height);
+        frame->pts = (int64_t)input.index;
+
+        if (avcodec_send_frame(codec, frame) < 0 || !drain()) {
+            std::cerr << "libav: failed to encode frame " << input.index << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    void close() override {
+        if (header_written) {
+            if (packet) {
+                avcodec_send_frame(codec, nullptr);
+                drain();
+            }
+            av_write_trailer(format);
+            header_written = false;
+        }
+        if (format && format->pb && !(format->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&format->pb);
+        }
+        av_packet_free(&packet);
+        av_frame_free(&frame);
+        avcodec_free_context(&codec);
+        if (format) {
+            avformat_free_context(format);
+            format = nullptr;
+        }
+    }
+
+    bool wantsYUV() const override { return true; }
+    const char* getName() const override { return "libav"; }
+};
+
+#endif
+
+}
+
+bool EncoderSink::writesToStdout(const std::string& spec) {
+    return spec == "y4m:-" || spec == "y4m";
+}
+
+std::unique_ptr<EncoderSink> EncoderSink::create(const std::string& spec) {
+    size_t colon = spec.find(':');
+    std::string kind = spec.substr(0, colon);
+    std::string path = colon == std::string::npos ? std::string() : spec.substr(colon + 1);
+
+    if (kind == "y4m") {
+        return std::unique_ptr<EncoderSink>(new Y4MSink(path.empty() ? "-" : path));
+    }
+    if (path.empty()) {
+        std::cerr << "Encoder '" << kind << "' needs a path, e.g. " << kind << ":out\n";
+        return nullptr;
+    }
+    if (kind == "png") {
+#ifdef HAVE_PNG
+        std::unique_ptr<PNGSink> sink(new PNGSink(path));
+        if (!sink->isValid()) {
+            std::cerr << "PNG pattern '" << path << "' needs exactly one integer conversion for the frame "
+                      << "index, e.g. frame_%06d.png (write %% for a literal %)\n";
+            return nullptr;
+        }
+        return std::unique_ptr<EncoderSink>(sink.release());
+#else
+        std::cerr << "PNG output needs a build with libpng\n";
+        return nullptr;
+#endif
+    }
+    if (kind == "libav") {
+#ifdef HAVE_LIBAV
+        return std::unique_ptr<EncoderSink>(new LibavSink(path));
+#else
+        std::cerr << "libav output needs a build with libavcodec/libavformat\n";
+        return nullptr;
+#endif
+    }
+
+    std::cerr << "Unknown encoder '" << kind << "', expected y4m, png or libav\n";
+    return nullptr;
+}
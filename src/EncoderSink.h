@@ -0,0 +1,41 @@
+#ifndef ENCODER_SINK_H
+#define ENCODER_SINK_H
+
+#include <SDL3/SDL.h>
+#include <string>
+#include <memory>
+
+// Destination for rendered frames: Y4M to a file or stdout, a PNG sequence, or (when
+// built with libav) a compressed video file. Frames arrive in order from FrameEncoder's
+// thread; their data is only valid during write()
+class EncoderSink {
+public:
+    struct Frame {
+        Uint64 index;
+        const Uint8* rgba;  // sRGB-encoded RGBA8
+        int rgba_pitch;
+        const Uint8* y;     // I420, BT.709 limited range; null unless wantsYUV()
+        const Uint8* u;
+        const Uint8* v;
+        int y_pitch;
+        int uv_pitch;
+    };
+
+    virtual ~EncoderSink() {}
+
+    virtual bool open(int width, int height, float fps) = 0;
+    virtual bool write(const Frame& frame) = 0;
+    virtual void close() = 0;
+
+    virtual bool wantsYUV() const = 0;
+    virtual const char* getName() const = 0;
+
+    // "y4m:-" (stdout), "y4m:out.y4m", "png:frames/frame_%06llu.png", "libav:out.mp4". A png
+    // pattern holds one integer conversion for the frame index; a bare name gets "%06llu.png"
+    // Null, with the reason on stderr, for anything unknown or not built in
+    static std::unique_ptr<EncoderSink> create(const std::string& spec);
+    // True when the sink would write to stdout, so the caller can move its logging
+    static bool writesToStdout(const std::string& spec);
+};
+
+#endif
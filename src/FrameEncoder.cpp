@@ -0,0 +1,164 @@
+#include "FrameEncoder.h"
+#include "YUVConvert.h"
+#include <iostream>
+#include <iomanip>
+
+FrameEncoder::~FrameEncoder() {
+    stop();
+}
+
+bool FrameEncoder::start(std::unique_ptr<EncoderSink> encoder_sink, int frame_width, int frame_height, float fps, int num_slots) {
+    if (running) {
+        std::cerr << "FrameEncoder already running\n";
+        return false;
+    }
+    if (!encoder_sink || !encoder_sink->open(frame_width, frame_height, fps)) {
+        return false;
+    }
+
+    sink = std::move(encoder_sink);
+    width = frame_width;
+    height = frame_height;
+
+    slots.resize(num_slots < 2 ? 2 : num_slots);
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i].rgba.resize((size_t)width * height * 4);
+    }
+    head = 0;
+    queued = 0;
+    frames_submitted = 0;
+    frames_written = 0;
+    report_frames = 0;
+    convert_ns = 0;
+    write_ns = 0;
+    stall_ns = 0;
+
+    if (sink->wantsYUV()) {
+        int chroma_width = (width + 1) / 2;
+        int chroma_height = (height + 1) / 2;
+        y_plane.resize((size_t)width * height);
+        u_plane.resize((size_t)chroma_width * chroma_height);
+        v_plane.resize((size_t)chroma_width * chroma_height);
+    }
+
+    std::cerr << "Recording " << width << "x" << height << " at " << fps << " fps to " << sink->getName();
+    if (sink->wantsYUV()) {
+        std::cerr << " (YUV: " << YUVConvert::getImplementationName() << ")";
+    }
+    std::cerr << "\n";
+
+    stopping = false;
+    failed = false;
+    running = true;
+    thread = std::thread(&FrameEncoder::run, this);
+    return true;
+}
+
+void FrameEncoder::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        stopping = true;
+    }
+    frame_ready.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    sink->close();
+    std::cerr << "Recorded " << frames_written << " frames\n";
+    sink.reset();
+    running = false;
+}
+
+Uint8* FrameEncoder::acquireSlot() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queued == slots.size()) {
+        Uint64 wait_start = SDL_GetTicksNS();
+        slot_free.wait(lock, [this] { return queued < slots.size(); });
+        stall_ns += SDL_GetTicksNS() - wait_start;
+    }
+    acquired = (head + queued) % slots.size();
+    return slots[acquired].rgba.data();
+}
+
+void FrameEncoder::submitSlot() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[acquired].index = first_index + frames_submitted++;
+        queued++;
+    }
+    frame_ready.notify_one();
+}
+
+void FrameEncoder::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        frame_ready.wait(lock, [this] { return stopping || queued > 0; });
+        if (queued == 0) break;
+
+        // The slot stays queued, so the render thread can't reuse it until this frame is written
+        Slot& slot = slots[head];
+        bool keep_going = !failed;
+        lock.unlock();
+
+        Uint64 convert_start = SDL_GetTicksNS();
+        EncoderSink::Frame frame = {};
+        frame.index = slot.index;
+        frame.rgba = slot.rgba.data();
+        frame.rgba_pitch = width * 4;
+        if (keep_going && sink->wantsYUV()) {
+            int chroma_pitch = (width + 1) / 2;
+            YUVConvert::rgbaToI420(frame.rgba, width, height, frame.rgba_pitch,
+                                   y_plane.data(), width, u_plane.data(), v_plane.data(), chroma_pitch);
+            frame.y = y_plane.data();
+            frame.u = u_plane.data();
+            frame.v = v_plane.data();
+            frame.y_pitch = width;
+            frame.uv_pitch = chroma_pitch;
+        }
+        Uint64 write_start = SDL_GetTicksNS();
+        bool written = keep_going && sink->write(frame);
+        Uint64 write_end = SDL_GetTicksNS();
+
+        lock.lock();
+        // After a failure, frames are still consumed so the render thread never blocks forever
+        if (written) {
+            frames_written++;
+            report_frames++;
+            convert_ns += write_start - convert_start;
+            write_ns += write_end - write_start;
+        } else {
+            failed = true;
+        }
+        head = (head + 1) % slots.size();
+        queued--;
+        slot_free.notify_one();
+    }
+}
+
+Uint64 FrameEncoder::getFramesWritten() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames_written;
+}
+
+bool FrameEncoder::hasFailed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+void FrameEncoder::printReport(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) return;
+
+    double frames = report_frames > 0 ? (double)report_frames : 1.0;
+    out << std::fixed << std::setprecision(2)
+        << "Encoder: " << report_frames << " frames, convert " << convert_ns / frames / 1e6
+        << " ms, write " << write_ns / frames / 1e6
+        << " ms, render stalled " << stall_ns / 1e6 << " ms, " << queued << "/" << slots.size() << " queued\n";
+
+    report_frames = 0;
+    convert_ns = 0;
+    write_ns = 0;
+    stall_ns = 0;
+}
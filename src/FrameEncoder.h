@@ -0,0 +1,83 @@
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include "EncoderSink.h"
+#include <SDL3/SDL.h>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Feeds rendered frames to an EncoderSink on its own thread. The render thread copies each
+// frame into one of a few slots and moves on; YUV conversion and the sink's write overlap
+// the next frames' rendering. When every slot is still queued, acquireSlot() blocks, so a
+// slow sink throttles rendering instead of dropping frames
+class FrameEncoder {
+public:
+    FrameEncoder() {}
+    ~FrameEncoder();
+
+    bool start(std::unique_ptr<EncoderSink> sink, int width, int height, float fps, int num_slots = 3);
+    // Drains queued frames and closes the sink
+    void stop();
+    bool isRunning() const { return running; }
+    // Index of the first frame handed to the sink, for sinks that name frames (before start())
+    void setFirstFrameIndex(Uint64 index) { first_index = index; }
+
+    // Render thread: RGBA8 storage for the next frame, width * 4 bytes per row. Must be
+    // followed by submitSlot()
+    Uint8* acquireSlot();
+    void submitSlot();
+
+    Uint64 getFramesWritten();
+    bool hasFailed();
+    // Mean per-frame times since the last report, then resets them
+    void printReport(std::ostream& out);
+
+private:
+    struct Slot {
+        std::vector<Uint8> rgba;
+        Uint64 index;
+    };
+
+    void run();
+
+    std::unique_ptr<EncoderSink> sink;
+    int width = 0;
+    int height = 0;
+
+    // Slots are used round-robin: [head, head + queued) wait for the encoder thread
+    std::vector<Slot> slots;
+    size_t head = 0;
+    size_t queued = 0;
+    size_t acquired = 0;  // Slot handed out by acquireSlot()
+    Uint64 frames_submitted = 0;
+    Uint64 first_index = 0;
+
+    // I420 planes, only touched by the encoder thread
+    std::vector<Uint8> y_plane;
+    std::vector<Uint8> u_plane;
+    std::vector<Uint8> v_plane;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable frame_ready;
+    std::condition_variable slot_free;
+    bool running = false;
+    bool stopping = false;
+    bool failed = false;
+
+    // Stats since the last report
+    Uint64 frames_written = 0;
+    int report_frames = 0;
+    Uint64 convert_ns = 0;
+    Uint64 write_ns = 0;
+    Uint64 stall_ns = 0;  // Render thread blocked in acquireSlot()
+
+    FrameEncoder(const FrameEncoder&);
+    FrameEncoder& operator=(const FrameEncoder&);
+};
+
+#endif
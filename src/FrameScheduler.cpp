@@ -0,0 +1,103 @@
+#include "FrameScheduler.h"
+#include <iostream>
+#include <cstring>
+
+bool FrameScheduler::parsePresentMode(const char* name, PresentMode& mode) {
+    if (std::strcmp(name, "vsync") == 0) {
+        mode = PresentMode::VSync;
+    } else if (std::strcmp(name, "mailbox") == 0) {
+        mode = PresentMode::Mailbox;
+    } else if (std::strcmp(name, "immediate") == 0) {
+        mode = PresentMode::Immediate;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* FrameScheduler::getPresentModeName(PresentMode mode) {
+    switch (mode) {
+        case PresentMode::Mailbox: return "mailbox";
+        case PresentMode::Immediate: return "immediate";
+        default: return "vsync";
+    }
+}
+
+bool FrameScheduler::applyPresentMode(SDL_GPUDevice* device, SDL_Window* window, PresentMode mode, bool prefer_srgb) {
+    SDL_GPUPresentMode gpu_mode = SDL_GPU_PRESENTMODE_VSYNC;
+    if (mode == PresentMode::Mailbox) gpu_mode = SDL_GPU_PRESENTMODE_MAILBOX;
+    if (mode == PresentMode::Immediate) gpu_mode = SDL_GPU_PRESENTMODE_IMMEDIATE;
+
+    // VSYNC is always supported, so it is the fallback for everything else
+    if (!SDL_WindowSupportsGPUPresentMode(device, window, gpu_mode)) {
+        std::cerr << "Warning: present mode '" << getPresentModeName(mode) << "' not supported, using vsync\n";
+        gpu_mode = SDL_GPU_PRESENTMODE_VSYNC;
+        mode = PresentMode::VSync;
+    }
+
+    // SDR is always supported, so it is the fallback for SDR_LINEAR
+    bool srgb = prefer_srgb &&
+                SDL_WindowSupportsGPUSwapchainComposition(device, window, SDL_GPU_SWAPCHAINCOMPOSITION_SDR_LINEAR) &&
+                SDL_SetGPUSwapchainParameters(device, window, SDL_GPU_SWAPCHAINCOMPOSITION_SDR_LINEAR, gpu_mode);
+    if (!srgb && !SDL_SetGPUSwapchainParameters(device, window, SDL_GPU_SWAPCHAINCOMPOSITION_SDR, gpu_mode)) {
+        std::cerr << "Failed to set swapchain parameters: " << SDL_GetError() << "\n";
+        return false;
+    }
+
+    present_mode = mode;
+    srgb_swapchain = srgb;
+    return true;
+}
+
+void FrameScheduler::reportActivity(bool audio_active, bool camera_active) {
+    Uint64 now = SDL_GetTicksNS();
+    if (last_activity_ns == 0 || audio_active || camera_active) {
+        last_activity_ns = now;
+    }
+
+    bool was_idle = idle;
+    idle = idle_fps > 0.0f && (now - last_activity_ns) > (Uint64)(idle_timeout * SDL_NS_PER_SECOND);
+
+    // Waking up shouldn't wait out the rest of a long idle period
+    if (was_idle && !idle) {
+        next_deadline_ns = 0;
+    }
+}
+
+float FrameScheduler::getCurrentTargetFps() const {
+    if (idle && (target_fps <= 0.0f || idle_fps < target_fps)) {
+        return idle_fps;
+    }
+    return target_fps;
+}
+
+Uint64 FrameScheduler::periodNS() const {
+    float fps = getCurrentTargetFps();
+    if (fps <= 0.0f) return 0;
+    return (Uint64)(SDL_NS_PER_SECOND / fps);
+}
+
+void FrameScheduler::waitForNextFrame() {
+    Uint64 period = periodNS();
+    if (period == 0) {
+        next_deadline_ns = 0;
+        return;
+    }
+
+    Uint64 now = SDL_GetTicksNS();
+
+    // Re-anchor on the first frame or after falling more than a frame behind,
+    // otherwise keep a fixed cadence so sleep jitter doesn't accumulate
+    if (next_deadline_ns == 0 || now > next_deadline_ns + period) {
+        next_deadline_ns = now + period;
+    }
+
+    // Sleep for the bulk of the wait, then spin the last bit for precision
+    if (next_deadline_ns > now + spin_threshold_ns) {
+        SDL_DelayNS(next_deadline_ns - now - spin_threshold_ns);
+    }
+    while (SDL_GetTicksNS() < next_deadline_ns) {
+    }
+
+    next_deadline_ns += period;
+}
@@ -0,0 +1,56 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_gpu.h>
+
+// Paces the render loop: present mode selection, FPS cap with sleep+spin
+// waiting, and an idle rate used when nothing on screen is reacting
+class FrameScheduler {
+public:
+    enum class PresentMode {
+        VSync,
+        Mailbox,
+        Immediate
+    };
+
+private:
+    PresentMode present_mode = PresentMode::VSync;
+    bool srgb_swapchain = false;
+
+    float target_fps = 0.0f;      // 0 = uncapped
+    float idle_fps = 15.0f;       // 0 = never throttle when idle
+    float idle_timeout = 5.0f;    // seconds of inactivity before throttling
+    Uint64 spin_threshold_ns = 2 * SDL_NS_PER_MS;  // OS sleep granularity margin
+
+    Uint64 next_deadline_ns = 0;
+    Uint64 last_activity_ns = 0;
+    bool idle = false;
+
+    Uint64 periodNS() const;
+
+public:
+    static bool parsePresentMode(const char* name, PresentMode& mode);
+    static const char* getPresentModeName(PresentMode mode);
+
+    // Applies the requested present mode, falling back to vsync when the window doesn't support it.
+    // With prefer_srgb the swapchain is an sRGB format (SDR_LINEAR) where the window supports it
+    bool applyPresentMode(SDL_GPUDevice* device, SDL_Window* window, PresentMode mode, bool prefer_srgb = false);
+    PresentMode getPresentMode() const { return present_mode; }
+    // True when the swapchain encodes sRGB on store, so shaders write linear colour
+    bool isSRGBSwapchain() const { return srgb_swapchain; }
+
+    void setTargetFps(float fps) { target_fps = fps; }
+    void setIdleFps(float fps) { idle_fps = fps; }
+    void setIdleTimeout(float seconds) { idle_timeout = seconds; }
+
+    // Call once per frame; any activity wakes the scheduler immediately
+    void reportActivity(bool audio_active, bool camera_active);
+    bool isIdle() const { return idle; }
+    float getCurrentTargetFps() const;
+
+    // Blocks until the next frame deadline (no-op when uncapped)
+    void waitForNextFrame();
+};
+
+#endif
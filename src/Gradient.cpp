@@ -0,0 +1,150 @@
+#include "Gradient.h"
+#include "SRGB.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+struct Color {
+    float r, g, b;
+};
+
+// Same as hsv2rgb() in huawei_audio.frag
+Color hsvToRgb(float h, float s, float v) {
+    const float k[4] = {1.0f, 2.0f / 3.0f, 1.0f / 3.0f, 3.0f};
+    float c[3];
+    for (int i = 0; i < 3; i++) {
+        float f = h + k[i];
+        float p = std::fabs((f - std::floor(f)) * 6.0f - k[3]);
+        float channel = std::min(std::max(p - k[0], 0.0f), 1.0f);
+        c[i] = v * (k[0] + (channel - k[0]) * s);
+    }
+    Color out = {c[0], c[1], c[2]};
+    return out;
+}
+
+// Stop hues are picked in display (sRGB) space
+Color toLinear(Color c) {
+    Color out = {SRGB::toLinear(c.r), SRGB::toLinear(c.g), SRGB::toLinear(c.b)};
+    return out;
+}
+
+Color linearToOklab(Color c) {
+    float l = std::cbrt(0.4122214708f * c.r + 0.5363325363f * c.g + 0.0514459929f * c.b);
+    float m = std::cbrt(0.2119034982f * c.r + 0.6806995451f * c.g + 0.1073969566f * c.b);
+    float s = std::cbrt(0.0883024619f * c.r + 0.2817188376f * c.g + 0.6299787005f * c.b);
+
+    Color out = {
+        0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s,
+        1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s,
+        0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s
+    };
+    return out;
+}
+
+Color oklabToLinear(Color lab) {
+    float l = lab.r + 0.3963377774f * lab.g + 0.2158037573f * lab.b;
+    float m = lab.r - 0.1055613458f * lab.g - 0.0638541728f * lab.b;
+    float s = lab.r - 0.0894841775f * lab.g - 1.2914855480f * lab.b;
+    l = l * l * l;
+    m = m * m * m;
+    s = s * s * s;
+
+    Color out = {
+        std::max(4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s, 0.0f),
+        std::max(-1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s, 0.0f),
+        std::max(-0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s, 0.0f)
+    };
+    return out;
+}
+
+Color mix(Color a, Color b, float t) {
+    Color out = {a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t};
+    return out;
+}
+
+}
+
+namespace Gradient {
+
+bool operator==(const Settings& a, const Settings& b) {
+    if (a.saturation != b.saturation || a.brightness != b.brightness || a.space != b.space ||
+        a.stops.size() != b.stops.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.stops.size(); i++) {
+        if (a.stops[i].position != b.stops[i].position || a.stops[i].hue != b.stops[i].hue) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<float> bake(const Settings& settings, int texels) {
+    std::vector<float> rgba(texels * 4, 0.0f);
+    const std::vector<Stop>& stops = settings.stops;
+    if (stops.empty() || texels <= 0) {
+        return rgba;
+    }
+
+    // Stop colours in the interpolation space
+    std::vector<Color> lab(stops.size());
+    for (size_t i = 0; i < stops.size(); i++) {
+        lab[i] = linearToOklab(toLinear(hsvToRgb(stops[i].hue, settings.saturation, settings.brightness)));
+    }
+
+    size_t segment = 0;
+    for (int x = 0; x < texels; x++) {
+        float t = texels > 1 ? (float)x / (texels - 1) : 0.0f;
+        while (segment + 1 < stops.size() && t > stops[segment + 1].position) {
+            segment++;
+        }
+
+        Color color;
+        if (segment + 1 >= stops.size() || t <= stops[segment].position) {
+            // Before the first stop or past the last one
+            size_t nearest = t <= stops[segment].position ? segment : stops.size() - 1;
+            color = toLinear(hsvToRgb(stops[nearest].hue, settings.saturation, settings.brightness));
+        } else {
+            const Stop& a = stops[segment];
+            const Stop& b = stops[segment + 1];
+            float span = b.position - a.position;
+            float f = span > 0.0f ? (t - a.position) / span : 1.0f;
+
+            if (settings.space == SPACE_OKLAB) {
+                color = oklabToLinear(mix(lab[segment], lab[segment + 1], f));
+            } else {
+                float hue = a.hue + (b.hue - a.hue) * f;
+                color = toLinear(hsvToRgb(hue, settings.saturation, settings.brightness));
+            }
+        }
+
+        rgba[x * 4] = color.r;
+        rgba[x * 4 + 1] = color.g;
+        rgba[x * 4 + 2] = color.b;
+        rgba[x * 4 + 3] = 1.0f;
+    }
+    return rgba;
+}
+
+bool parseSpace(const char* name, Space& space) {
+    if (std::strcmp(name, "hsv") == 0) {
+        space = SPACE_HSV;
+    } else if (std::strcmp(name, "oklab") == 0) {
+        space = SPACE_OKLAB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* getSpaceName(Space space) {
+    switch (space) {
+        case SPACE_HSV: return "hsv";
+        case SPACE_OKLAB: return "oklab";
+        default: return "unknown";
+    }
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include <vector>
+
+// Distance colour gradient, baked on the CPU into a lookup texture the shader samples once
+// per hit pixel instead of searching stops and converting HSV itself
+namespace Gradient {
+    struct Stop {
+        float position;  // 0 = close, 1 = max_color_distance
+        float hue;       // [0, 1)
+    };
+
+    enum Space {
+        SPACE_HSV,    // Hue interpolated between stops, as the shader used to
+        SPACE_OKLAB   // Stop colours interpolated in OKLab: even lightness, no muddy midpoints
+    };
+
+    struct Settings {
+        std::vector<Stop> stops;  // Sorted by position
+        float saturation;
+        float brightness;
+        Space space;
+    };
+
+    bool operator==(const Settings& a, const Settings& b);
+    inline bool operator!=(const Settings& a, const Settings& b) { return !(a == b); }
+
+    // Linear-light RGBA, 4 floats per texel. Texel i is position i / (texels - 1);
+    // positions outside the first and last stop take their colour
+    std::vector<float> bake(const Settings& settings, int texels);
+
+    bool parseSpace(const char* name, Space& space);
+    const char* getSpaceName(Space space);
+}
+
+#endif
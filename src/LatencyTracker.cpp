@@ -0,0 +1,68 @@
+#include "LatencyTracker.h"
+#include <algorithm>
+#include <cmath>
+
+LatencyTracker::LatencyTracker(int window_size) : window_size(window_size) {
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        samples[i].reserve(window_size);
+    }
+}
+
+void LatencyTracker::recordStage(Stage stage, double milliseconds) {
+    std::vector<double>& ring = samples[stage];
+    if ((int)ring.size() < window_size) {
+        ring.push_back(milliseconds);
+    } else {
+        ring[write_index] = milliseconds;
+    }
+}
+
+void LatencyTracker::recordFrame(const FrameTimestamps& t) {
+    const double ns_to_ms = 1.0 / SDL_NS_PER_MS;
+    double window_center_ns = t.window_start_ns + (t.capture_ns - t.window_start_ns) * 0.5;
+
+    recordStage(STAGE_WINDOW, (t.capture_ns - window_center_ns) * ns_to_ms);
+    recordStage(STAGE_ANALYSIS, ((double)t.analyzed_ns - t.capture_ns) * ns_to_ms);
+    recordStage(STAGE_UPLOAD, ((double)t.uploaded_ns - t.analyzed_ns) * ns_to_ms);
+    recordStage(STAGE_SUBMIT, ((double)t.submitted_ns - t.uploaded_ns) * ns_to_ms);
+    recordStage(STAGE_PRESENT, ((double)t.presented_ns - t.submitted_ns) * ns_to_ms);
+    recordStage(STAGE_TOTAL, (t.presented_ns - window_center_ns) * ns_to_ms);
+
+    write_index = (write_index + 1) % window_size;
+    count++;
+}
+
+double LatencyTracker::percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+
+    size_t index = (size_t)std::round(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+double LatencyTracker::getPercentile(Stage stage, double p) const {
+    return percentile(samples[stage], p);
+}
+
+const char* LatencyTracker::getStageName(Stage stage) {
+    switch (stage) {
+        case STAGE_WINDOW: return "window";
+        case STAGE_ANALYSIS: return "capture->bands";
+        case STAGE_UPLOAD: return "bands->upload";
+        case STAGE_SUBMIT: return "upload->submit";
+        case STAGE_PRESENT: return "submit->present";
+        case STAGE_TOTAL: return "total";
+        default: return "unknown";
+    }
+}
+
+void LatencyTracker::printReport(std::ostream& out) const {
+    out << "Audio-to-photon latency (ms, p50/p95/p99 over " << std::min(count, window_size) << " frames):\n";
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        Stage stage = (Stage)i;
+        out << "  " << getStageName(stage) << ": "
+            << getPercentile(stage, 0.5) << " / "
+            << getPercentile(stage, 0.95) << " / "
+            << getPercentile(stage, 0.99) << "\n";
+    }
+}
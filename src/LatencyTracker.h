@@ -0,0 +1,53 @@
+#ifndef LATENCY_TRACKER_H
+#define LATENCY_TRACKER_H
+
+#include <SDL3/SDL.h>
+#include <vector>
+#include <ostream>
+
+// Rolling audio-to-photon latency statistics, broken down by pipeline stage
+class LatencyTracker {
+public:
+    // Timestamps (SDL_GetTicksNS) of one frame's audio as it moves through the pipeline
+    struct FrameTimestamps {
+        Uint64 window_start_ns;  // Oldest sample in the analyzed block
+        Uint64 capture_ns;       // Newest sample in the analyzed block
+        Uint64 analyzed_ns;      // Bands computed
+        Uint64 uploaded_ns;      // Audio params upload recorded in the frame's copy pass
+        Uint64 submitted_ns;     // Frame command buffer submitted
+        Uint64 presented_ns;     // GPU finished the frame
+    };
+
+    enum Stage {
+        STAGE_WINDOW,      // Half the analyzed block: how much older its centre is than its newest sample
+        STAGE_ANALYSIS,    // Newest sample -> bands (stream buffering + FFT)
+        STAGE_UPLOAD,      // Bands -> GPU upload
+        STAGE_SUBMIT,      // Upload -> frame submit
+        STAGE_PRESENT,     // Submit -> GPU done
+        STAGE_TOTAL,       // Block centre -> GPU done
+        STAGE_COUNT
+    };
+
+private:
+    std::vector<double> samples[STAGE_COUNT];  // Milliseconds, ring per stage
+    int window_size;
+    int write_index = 0;
+    int count = 0;
+
+public:
+    explicit LatencyTracker(int window_size = 600);
+
+    void recordFrame(const FrameTimestamps& timestamps);
+    void recordStage(Stage stage, double milliseconds);
+
+    // p in [0, 1]; 0 when nothing has been recorded
+    double getPercentile(Stage stage, double p) const;
+    int getCount() const { return count; }
+
+    void printReport(std::ostream& out) const;
+
+    static const char* getStageName(Stage stage);
+    static double percentile(std::vector<double> values, double p);
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "PassProfiler.h"
+#include <iostream>
+
+SDL_GPUCommandBuffer* PassProfiler::endPass(SDL_GPUDevice* device, SDL_GPUCommandBuffer* cmd, const char* name) {
+    if (!enabled) return cmd;
+
+    Uint64 start = SDL_GetTicksNS();
+    SDL_GPUFence* fence = SDL_SubmitGPUCommandBufferAndAcquireFence(cmd);
+    if (!fence) {
+        std::cerr << "Failed to submit " << name << " pass: " << SDL_GetError() << "\n";
+        return SDL_AcquireGPUCommandBuffer(device);
+    }
+    SDL_WaitForGPUFences(device, true, &fence, 1);
+    double elapsed_ms = (double)(SDL_GetTicksNS() - start) / SDL_NS_PER_MS;
+    SDL_ReleaseGPUFence(device, fence);
+
+    Entry* entry = nullptr;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].name == name) {
+            entry = &entries[i];
+            break;
+        }
+    }
+    if (!entry) {
+        Entry added = {name, 0.0, 0};
+        entries.push_back(added);
+        entry = &entries.back();
+    }
+    entry->total_ms += elapsed_ms;
+    entry->count++;
+
+    return SDL_AcquireGPUCommandBuffer(device);
+}
+
+void PassProfiler::printReport(std::ostream& out) {
+    if (entries.empty()) return;
+
+    double total = 0.0;
+    out << "GPU passes (ms):";
+    for (size_t i = 0; i < entries.size(); i++) {
+        double mean = entries[i].count > 0 ? entries[i].total_ms / entries[i].count : 0.0;
+        out << " " << entries[i].name << " " << mean;
+        total += mean;
+        entries[i].total_ms = 0.0;
+        entries[i].count = 0;
+    }
+    out << " | total " << total << "\n";
+}
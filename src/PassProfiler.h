@@ -0,0 +1,36 @@
+#ifndef PASS_PROFILER_H
+#define PASS_PROFILER_H
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_gpu.h>
+#include <vector>
+#include <string>
+#include <ostream>
+
+// Per-pass GPU timing. SDL_gpu has no timestamp queries, so when enabled every pass is
+// submitted in its own command buffer and timed from submit to its fence signalling.
+// That serialises the frame, so it's a profiling mode, not something to leave on
+class PassProfiler {
+private:
+    struct Entry {
+        std::string name;
+        double total_ms;
+        int count;
+    };
+
+    bool enabled = false;
+    std::vector<Entry> entries;  // In the order passes first ran
+
+public:
+    void setEnabled(bool on) { enabled = on; }
+    bool isEnabled() const { return enabled; }
+
+    // Ends a pass recorded into cmd. Disabled: returns cmd untouched. Enabled: submits cmd,
+    // waits for it, charges the time to `name`, and returns a new command buffer to continue in
+    SDL_GPUCommandBuffer* endPass(SDL_GPUDevice* device, SDL_GPUCommandBuffer* cmd, const char* name);
+
+    // Mean milliseconds per pass since the last report, then resets
+    void printReport(std::ostream& out);
+};
+
+#endif
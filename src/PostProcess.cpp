@@ -0,0 +1,252 @@
+#include "PostProcess.h"
+#include "Shader.h"
+#include <iostream>
+#include <cstdio>
+#include <algorithm>
+
+bool PostProcess::isSupported(SDL_GPUDevice* device) {
+    return SDL_GPUTextureSupportsFormat(device, SCENE_FORMAT, SDL_GPU_TEXTURETYPE_2D,
+                                        SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER);
+}
+
+SDL_GPUGraphicsPipeline* PostProcess::createPipeline(const char* fragment, Uint32 num_samplers,
+                                                     SDL_GPUTextureFormat format, bool additive) {
+    SDL_GPUShader* vert_shader = Shader::create(device, "src/shaders/post/fullscreen.vert",
+                                                SDL_GPU_SHADERSTAGE_VERTEX, 0, 0, 0);
+    SDL_GPUShader* frag_shader = Shader::create(device, std::string("src/shaders/post/") + fragment,
+                                                SDL_GPU_SHADERSTAGE_FRAGMENT, num_samplers, 0, 1);
+    if (!vert_shader || !frag_shader) {
+        if (vert_shader) SDL_ReleaseGPUShader(device, vert_shader);
+        if (frag_shader) SDL_ReleaseGPUShader(device, frag_shader);
+        return nullptr;
+    }
+
+    SDL_GPUColorTargetDescription color_target = {};
+    color_target.format = format;
+    if (additive) {
+        color_target.blend_state.enable_blend = true;
+        color_target.blend_state.src_color_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+        color_target.blend_state.dst_color_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+        color_target.blend_state.color_blend_op = SDL_GPU_BLENDOP_ADD;
+        color_target.blend_state.src_alpha_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+        color_target.blend_state.dst_alpha_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+        color_target.blend_state.alpha_blend_op = SDL_GPU_BLENDOP_ADD;
+    }
+
+    // The vertex shader makes a screen-covering triangle from the vertex index
+    SDL_GPUGraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.vertex_shader = vert_shader;
+    pipeline_info.fragment_shader = frag_shader;
+    pipeline_info.primitive_type = SDL_GPU_PRIMITIVETYPE_TRIANGLELIST;
+    pipeline_info.rasterizer_state.fill_mode = SDL_GPU_FILLMODE_FILL;
+    pipeline_info.rasterizer_state.cull_mode = SDL_GPU_CULLMODE_NONE;
+    pipeline_info.rasterizer_state.front_face = SDL_GPU_FRONTFACE_COUNTER_CLOCKWISE;
+    pipeline_info.target_info.num_color_targets = 1;
+    pipeline_info.target_info.color_target_descriptions = &color_target;
+    pipeline_info.target_info.has_depth_stencil_target = false;
+
+    SDL_GPUGraphicsPipeline* pipeline = SDL_CreateGPUGraphicsPipeline(device, &pipeline_info);
+    SDL_ReleaseGPUShader(device, vert_shader);
+    SDL_ReleaseGPUShader(device, frag_shader);
+
+    if (!pipeline) {
+        std::cerr << "Failed to create " << fragment << " pipeline: " << SDL_GetError() << "\n";
+    }
+    return pipeline;
+}
+
+bool PostProcess::initialize(SDL_GPUDevice* gpu_device, SDL_GPUTextureFormat output_format, bool srgb) {
+    device = gpu_device;
+    output_srgb = srgb;
+
+    // Bloom only needs positive colour; the packed float format halves its bandwidth
+    bloom_format = SCENE_FORMAT;
+    if (SDL_GPUTextureSupportsFormat(device, SDL_GPU_TEXTUREFORMAT_R11G11B10_UFLOAT, SDL_GPU_TEXTURETYPE_2D,
+                                     SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER)) {
+        bloom_format = SDL_GPU_TEXTUREFORMAT_R11G11B10_UFLOAT;
+    }
+
+    downsample_pipeline = createPipeline("bloom_down.frag", 1, bloom_format, false);
+    upsample_pipeline = createPipeline("bloom_up.frag", 1, bloom_format, true);
+    tonemap_pipeline = createPipeline("tonemap.frag", 2, output_format, false);
+    if (!downsample_pipeline || !upsample_pipeline || !tonemap_pipeline) {
+        return false;
+    }
+
+    SDL_GPUSamplerCreateInfo sampler_info = {};
+    sampler_info.min_filter = SDL_GPU_FILTER_LINEAR;
+    sampler_info.mag_filter = SDL_GPU_FILTER_LINEAR;
+    sampler_info.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
+    sampler_info.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+    sampler_info.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+    sampler_info.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+
+    sampler = SDL_CreateGPUSampler(device, &sampler_info);
+    if (!sampler) {
+        std::cerr << "Failed to create post-process sampler: " << SDL_GetError() << "\n";
+        return false;
+    }
+    return true;
+}
+
+void PostProcess::releaseTargets() {
+    if (scene_target) {
+        SDL_ReleaseGPUTexture(device, scene_target);
+        scene_target = nullptr;
+    }
+    for (int i = 0; i < MAX_BLOOM_LEVELS; i++) {
+        if (bloom[i]) {
+            SDL_ReleaseGPUTexture(device, bloom[i]);
+            bloom[i] = nullptr;
+        }
+    }
+    bloom_levels = 0;
+    width = 0;
+    height = 0;
+}
+
+bool PostProcess::resize(Uint32 new_width, Uint32 new_height) {
+    if (scene_target && width == new_width && height == new_height) {
+        return true;
+    }
+
+    releaseTargets();
+
+    SDL_GPUTextureCreateInfo texture_info = {};
+    texture_info.type = SDL_GPU_TEXTURETYPE_2D;
+    texture_info.format = SCENE_FORMAT;
+    texture_info.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER;
+    texture_info.width = new_width;
+    texture_info.height = new_height;
+    texture_info.layer_count_or_depth = 1;
+    texture_info.num_levels = 1;
+
+    scene_target = SDL_CreateGPUTexture(device, &texture_info);
+    if (!scene_target) {
+        std::cerr << "Failed to create scene target: " << SDL_GetError() << "\n";
+        return false;
+    }
+
+    // Halve until the next level would be too small to be worth a pass
+    texture_info.format = bloom_format;
+    Uint32 level_width = new_width;
+    Uint32 level_height = new_height;
+    while (bloom_levels < MAX_BLOOM_LEVELS &&
+           level_width / 2 >= MIN_BLOOM_SIZE && level_height / 2 >= MIN_BLOOM_SIZE) {
+        level_width /= 2;
+        level_height /= 2;
+        texture_info.width = level_width;
+        texture_info.height = level_height;
+
+        bloom[bloom_levels] = SDL_CreateGPUTexture(device, &texture_info);
+        if (!bloom[bloom_levels]) {
+            std::cerr << "Failed to create bloom level " << bloom_levels << ": " << SDL_GetError() << "\n";
+            releaseTargets();
+            return false;
+        }
+        bloom_width[bloom_levels] = level_width;
+        bloom_height[bloom_levels] = level_height;
+        bloom_levels++;
+    }
+
+    width = new_width;
+    height = new_height;
+    return true;
+}
+
+void PostProcess::drawFullscreen(SDL_GPUCommandBuffer* cmd, SDL_GPUTexture* target, SDL_GPULoadOp load_op,
+                                 SDL_GPUGraphicsPipeline* pipeline, SDL_GPUTexture* const* sources, int num_sources,
+                                 const void* uniforms, Uint32 uniforms_size) {
+    SDL_GPUColorTargetInfo color_target = {};
+    color_target.texture = target;
+    color_target.load_op = load_op;
+    color_target.store_op = SDL_GPU_STOREOP_STORE;
+
+    SDL_GPURenderPass* pass = SDL_BeginGPURenderPass(cmd, &color_target, 1, nullptr);
+    SDL_BindGPUGraphicsPipeline(pass, pipeline);
+
+    SDL_GPUTextureSamplerBinding bindings[2] = {};
+    for (int i = 0; i < num_sources; i++) {
+        bindings[i].texture = sources[i];
+        bindings[i].sampler = sampler;
+    }
+    SDL_BindGPUFragmentSamplers(pass, 0, bindings, num_sources);
+    SDL_PushGPUFragmentUniformData(cmd, 0, uniforms, uniforms_size);
+
+    SDL_DrawGPUPrimitives(pass, 3, 1, 0, 0);
+    SDL_EndGPURenderPass(pass);
+}
+
+void PostProcess::renderBloom(SDL_GPUCommandBuffer*& cmd, PassProfiler& profiler) {
+    if (!scene_target || bloom_levels == 0) return;
+
+    char name[32];
+    BloomParams params = {};
+    params.threshold = settings.bloom_threshold;
+    params.knee = std::max(settings.bloom_knee, 1e-4f);
+
+    // Down the chain; the first step also keeps only what's over the threshold
+    for (int i = 0; i < bloom_levels; i++) {
+        SDL_GPUTexture* source = i == 0 ? scene_target : bloom[i - 1];
+        Uint32 source_width = i == 0 ? width : bloom_width[i - 1];
+        Uint32 source_height = i == 0 ? height : bloom_height[i - 1];
+
+        params.source_texel[0] = 1.0f / source_width;
+        params.source_texel[1] = 1.0f / source_height;
+        params.prefilter = i == 0 ? 1.0f : 0.0f;
+
+        drawFullscreen(cmd, bloom[i], SDL_GPU_LOADOP_DONT_CARE, downsample_pipeline, &source, 1,
+                       &params, sizeof(params));
+        std::snprintf(name, sizeof(name), "bloom_down%d", i);
+        cmd = profiler.endPass(device, cmd, name);
+    }
+
+    // Back up, each level blurred and added onto the one above it
+    for (int i = bloom_levels - 1; i > 0; i--) {
+        params.source_texel[0] = 1.0f / bloom_width[i];
+        params.source_texel[1] = 1.0f / bloom_height[i];
+        params.prefilter = 0.0f;
+
+        drawFullscreen(cmd, bloom[i - 1], SDL_GPU_LOADOP_LOAD, upsample_pipeline, &bloom[i], 1,
+                       &params, sizeof(params));
+        std::snprintf(name, sizeof(name), "bloom_up%d", i);
+        cmd = profiler.endPass(device, cmd, name);
+    }
+}
+
+void PostProcess::renderTonemap(SDL_GPUCommandBuffer* cmd, SDL_GPUTexture* output) {
+    if (!scene_target) return;
+
+    TonemapParams params = {};
+    params.exposure = settings.exposure;
+    // The top level holds every level's contribution
+    params.bloom_strength = bloom_levels > 0 ? settings.bloom_strength / bloom_levels : 0.0f;
+    params.encode_srgb = output_srgb ? 0.0f : 1.0f;
+
+    // Without bloom the scene is bound twice and contributes nothing extra
+    SDL_GPUTexture* sources[2] = {scene_target, bloom_levels > 0 ? bloom[0] : scene_target};
+    drawFullscreen(cmd, output, SDL_GPU_LOADOP_DONT_CARE, tonemap_pipeline, sources, 2, &params, sizeof(params));
+}
+
+void PostProcess::cleanup() {
+    if (!device) return;
+
+    releaseTargets();
+    if (downsample_pipeline) {
+        SDL_ReleaseGPUGraphicsPipeline(device, downsample_pipeline);
+        downsample_pipeline = nullptr;
+    }
+    if (upsample_pipeline) {
+        SDL_ReleaseGPUGraphicsPipeline(device, upsample_pipeline);
+        upsample_pipeline = nullptr;
+    }
+    if (tonemap_pipeline) {
+        SDL_ReleaseGPUGraphicsPipeline(device, tonemap_pipeline);
+        tonemap_pipeline = nullptr;
+    }
+    if (sampler) {
+        SDL_ReleaseGPUSampler(device, sampler);
+        sampler = nullptr;
+    }
+    device = nullptr;
+}
@@ -0,0 +1,91 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_gpu.h>
+#include "PassProfiler.h"
+
+// HDR post-processing: the scene renders linear colour into a float target, a bloom chain
+// blurs what's over the threshold at progressively halved resolutions (dual-filter
+// down/upsampling, a handful of taps per pixel), and a tonemap pass composes both into
+// the output. Everything past the scene runs at half resolution or less, except the
+// single tonemap pass
+class PostProcess {
+public:
+    struct Settings {
+        float exposure;         // Scene scale before tonemapping
+        float bloom_strength;   // Bloom mixed into the scene, averaged over the chain
+        float bloom_threshold;  // Brightness (max channel) where bloom starts
+        float bloom_knee;       // Soft transition below the threshold
+    };
+
+    static const SDL_GPUTextureFormat SCENE_FORMAT = SDL_GPU_TEXTUREFORMAT_R16G16B16A16_FLOAT;
+    static const int MAX_BLOOM_LEVELS = 6;
+    static const Uint32 MIN_BLOOM_SIZE = 8;  // Stop halving below this
+
+private:
+    SDL_GPUDevice* device = nullptr;
+    SDL_GPUGraphicsPipeline* downsample_pipeline = nullptr;
+    SDL_GPUGraphicsPipeline* upsample_pipeline = nullptr;   // Additive onto the level above
+    SDL_GPUGraphicsPipeline* tonemap_pipeline = nullptr;
+    SDL_GPUSampler* sampler = nullptr;
+    SDL_GPUTextureFormat bloom_format = SCENE_FORMAT;
+    bool output_srgb = false;
+
+    SDL_GPUTexture* scene_target = nullptr;
+    SDL_GPUTexture* bloom[MAX_BLOOM_LEVELS] = {};
+    Uint32 bloom_width[MAX_BLOOM_LEVELS] = {};
+    Uint32 bloom_height[MAX_BLOOM_LEVELS] = {};
+    int bloom_levels = 0;
+    Uint32 width = 0;
+    Uint32 height = 0;
+
+    Settings settings = {1.0f, 0.6f, 0.8f, 0.4f};
+
+    // Uniforms, std140 (set = 3, binding = 0)
+    struct BloomParams {
+        float source_texel[2];  // 1 / source size
+        float threshold;
+        float knee;
+        float prefilter;        // 1 on the first downsample, from the scene
+        float padding0, padding1, padding2;
+    };
+
+    struct TonemapParams {
+        float exposure;
+        float bloom_strength;
+        float encode_srgb;      // 1 when the output is UNORM
+        float padding;
+    };
+
+    SDL_GPUGraphicsPipeline* createPipeline(const char* fragment, Uint32 num_samplers,
+                                            SDL_GPUTextureFormat format, bool additive);
+    void releaseTargets();
+    void drawFullscreen(SDL_GPUCommandBuffer* cmd, SDL_GPUTexture* target, SDL_GPULoadOp load_op,
+                        SDL_GPUGraphicsPipeline* pipeline, SDL_GPUTexture* const* sources, int num_sources,
+                        const void* uniforms, Uint32 uniforms_size);
+
+public:
+    // output_format is what the tonemap writes; an *_SRGB output encodes in hardware
+    bool initialize(SDL_GPUDevice* device, SDL_GPUTextureFormat output_format, bool output_srgb);
+    void cleanup();
+
+    // (Re)creates the scene target and bloom chain for this output size
+    bool resize(Uint32 width, Uint32 height);
+    SDL_GPUTexture* getSceneTarget() const { return scene_target; }
+    int getBloomLevels() const { return bloom_levels; }
+
+    void setSettings(const Settings& s) { settings = s; }
+    const Settings& getSettings() const { return settings; }
+
+    // Bloom chain from the scene target. With profiling on, each pass is submitted on its
+    // own and cmd is replaced by a fresh command buffer
+    void renderBloom(SDL_GPUCommandBuffer*& cmd, PassProfiler& profiler);
+    // Scene plus bloom, tonemapped into output
+    void renderTonemap(SDL_GPUCommandBuffer* cmd, SDL_GPUTexture* output);
+
+    // True when the device can render and sample the scene format
+    static bool isSupported(SDL_GPUDevice* device);
+};
+
+#endif
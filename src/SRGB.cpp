@@ -0,0 +1,39 @@
+#include "SRGB.h"
+#include <cmath>
+
+namespace {
+
+struct ByteTable {
+    float values[256];
+
+    ByteTable() {
+        for (int i = 0; i < 256; i++) {
+            values[i] = SRGB::toLinear(i / 255.0f);
+        }
+    }
+};
+
+}
+
+namespace SRGB {
+
+float toLinear(float encoded) {
+    if (encoded <= 0.04045f) {
+        return encoded / 12.92f;
+    }
+    return std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+}
+
+float fromLinear(float linear) {
+    if (linear <= 0.0031308f) {
+        return linear * 12.92f;
+    }
+    return 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+}
+
+float byteToLinear(Uint8 encoded) {
+    static const ByteTable table;
+    return table.values[encoded];
+}
+
+}
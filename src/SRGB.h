@@ -0,0 +1,16 @@
+#ifndef SRGB_H
+#define SRGB_H
+
+#include <SDL3/SDL.h>
+
+// sRGB transfer function on the CPU, matching what *_UNORM_SRGB targets do on store
+// and the shader's fallback encode
+namespace SRGB {
+    float toLinear(float encoded);
+    float fromLinear(float linear);
+
+    // 8-bit encoded value to linear through a 256-entry table, for readback
+    float byteToLinear(Uint8 encoded);
+}
+
+#endif
@@ -0,0 +1,539 @@
+#include "SceneGraph.h"
+#include <yaml-cpp/yaml.h>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+const float SceneGraph::UNBOUNDED = 1e30f;
+
+namespace {
+
+const float DEGREES = 3.14159265358979f / 180.0f;
+
+struct Bounds {
+    float min[3];
+    float max[3];
+};
+
+// A parsed node: transforms around either a shape or a CSG op over children. Going inward
+// the point is translated, rotated, scaled and then folded into the nearest repeat cell
+struct Node {
+    YAML::Mark mark;
+    int op = SceneGraph::OP_UNION;
+    float args[4] = {0.0f, 0.0f, 0.0f, 0.0f};  // Shape parameters, or the CSG smoothing first
+    std::vector<Node> children;
+
+    bool has_translate = false;
+    float translate[3] = {0.0f, 0.0f, 0.0f};
+    bool has_rotate = false;
+    float rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};  // Quaternion (x, y, z, w), local to parent
+    float scale = 1.0f;
+    bool has_repeat = false;
+    float period[3] = {0.0f, 0.0f, 0.0f};
+    float cells[3] = {0.0f, 0.0f, 0.0f};  // Each side of the origin's cell; UNBOUNDED = forever
+};
+
+struct Shape {
+    const char* name;
+    int op;
+    const char* keys[3];  // Parameters it reads, besides the common keys
+};
+
+const Shape SHAPES[] = {
+    {"sphere", SceneGraph::OP_SPHERE, {"radius", nullptr, nullptr}},
+    {"box", SceneGraph::OP_BOX, {"size", "rounding", nullptr}},
+    {"torus", SceneGraph::OP_TORUS, {"radius", "thickness", nullptr}},
+    {"cylinder", SceneGraph::OP_CYLINDER, {"radius", "height", nullptr}},
+    {"plane", SceneGraph::OP_PLANE, {nullptr, nullptr, nullptr}}
+};
+
+const char* COMMON_KEYS[] = {"name", "translate", "rotate", "scale", "repeat", "shape", "union", "intersect", "subtract", "smooth"};
+
+YAML::Exception error(const YAML::Node& node, const std::string& message) {
+    return YAML::Exception(node.Mark(), message);
+}
+
+float readFloat(const YAML::Node& node, const char* key, float fallback, float min_value) {
+    if (!node[key]) return fallback;
+    float value = node[key].as<float>();
+    if (!(value >= min_value) || !std::isfinite(value)) {
+        throw error(node[key], std::string(key) + " must be at least " + std::to_string(min_value));
+    }
+    return value;
+}
+
+// A number for all three axes, or [x, y, z]
+void readVec3(const YAML::Node& value, float out[3]) {
+    if (value.IsScalar()) {
+        out[0] = out[1] = out[2] = value.as<float>();
+        return;
+    }
+    if (!value.IsSequence() || value.size() != 3) {
+        throw error(value, "expected a number or [x, y, z]");
+    }
+    for (int i = 0; i < 3; i++) {
+        out[i] = value[i].as<float>();
+    }
+}
+
+void multiply(const float a[4], const float b[4], float out[4]) {
+    float result[4] = {
+        a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1],
+        a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0],
+        a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3],
+        a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2]
+    };
+    std::memcpy(out, result, sizeof(result));
+}
+
+// v + 2 q.xyz x (q.xyz x v + w v), as the shader does it
+void rotate(const float q[4], const float v[3], float out[3]) {
+    float t[3] = {
+        q[1] * v[2] - q[2] * v[1] + q[3] * v[0],
+        q[2] * v[0] - q[0] * v[2] + q[3] * v[1],
+        q[0] * v[1] - q[1] * v[0] + q[3] * v[2]
+    };
+    out[0] = v[0] + 2.0f * (q[1] * t[2] - q[2] * t[1]);
+    out[1] = v[1] + 2.0f * (q[2] * t[0] - q[0] * t[2]);
+    out[2] = v[2] + 2.0f * (q[0] * t[1] - q[1] * t[0]);
+}
+
+bool isUnbounded(float value) {
+    return std::fabs(value) >= SceneGraph::UNBOUNDED * 0.5f;
+}
+
+bool isUnbounded(const Bounds& bounds) {
+    for (int axis = 0; axis < 3; axis++) {
+        if (isUnbounded(bounds.min[axis]) || isUnbounded(bounds.max[axis])) return true;
+    }
+    return false;
+}
+
+void checkKeys(const YAML::Node& node, const Shape* shape) {
+    for (YAML::const_iterator it = node.begin(); it != node.end(); ++it) {
+        std::string key = it->first.as<std::string>();
+        bool known = false;
+        for (size_t i = 0; i < sizeof(COMMON_KEYS) / sizeof(COMMON_KEYS[0]) && !known; i++) {
+            known = key == COMMON_KEYS[i];
+        }
+        for (int i = 0; shape && i < 3 && shape->keys[i] && !known; i++) {
+            known = key == shape->keys[i];
+        }
+        if (!known) {
+            throw error(it->first, "unknown key '" + key + "'" + (shape ? std::string(" for a ") + shape->name : std::string()));
+        }
+    }
+}
+
+void parseShape(const YAML::Node& yaml, const Shape& shape, Node& node) {
+    node.op = shape.op;
+    switch (shape.op) {
+    case SceneGraph::OP_SPHERE:
+        node.args[0] = readFloat(yaml, "radius", 1.0f, 0.0f);
+        break;
+    case SceneGraph::OP_BOX: {
+        float size[3] = {1.0f, 1.0f, 1.0f};
+        if (yaml["size"]) readVec3(yaml["size"], size);
+        for (int axis = 0; axis < 3; axis++) {
+            if (!(size[axis] > 0.0f)) throw error(yaml["size"], "box size must be positive");
+            node.args[axis] = size[axis] * 0.5f;
+        }
+        node.args[3] = readFloat(yaml, "rounding", 0.0f, 0.0f);
+        if (node.args[3] > std::min(node.args[0], std::min(node.args[1], node.args[2]))) {
+            throw error(yaml["rounding"], "rounding is more than half the box's smallest side");
+        }
+        break;
+    }
+    case SceneGraph::OP_TORUS:
+        node.args[0] = readFloat(yaml, "radius", 1.0f, 0.0f);
+        node.args[1] = readFloat(yaml, "thickness", 0.25f, 0.0f);
+        break;
+    case SceneGraph::OP_CYLINDER:
+        node.args[0] = readFloat(yaml, "radius", 1.0f, 0.0f);
+        node.args[1] = readFloat(yaml, "height", 2.0f, 0.0f) * 0.5f;
+        break;
+    }
+}
+
+void parseNode(const YAML::Node& yaml, Node& node) {
+    if (!yaml.IsMap()) {
+        throw error(yaml, "expected a node: a shape, or union/intersect/subtract over a list");
+    }
+    node.mark = yaml.Mark();
+
+    const char* csg_names[] = {"union", "intersect", "subtract"};
+    const int csg_ops[] = {SceneGraph::OP_UNION, SceneGraph::OP_INTERSECT, SceneGraph::OP_SUBTRACT};
+    int bodies = 0;
+    const Shape* shape = nullptr;
+
+    if (yaml["shape"]) {
+        std::string name = yaml["shape"].as<std::string>();
+        for (size_t i = 0; i < sizeof(SHAPES) / sizeof(SHAPES[0]); i++) {
+            if (name == SHAPES[i].name) shape = &SHAPES[i];
+        }
+        if (!shape) {
+            throw error(yaml["shape"], "unknown shape '" + name + "', expected sphere, box, torus, cylinder or plane");
+        }
+        parseShape(yaml, *shape, node);
+        bodies++;
+    }
+    for (int i = 0; i < 3; i++) {
+        YAML::Node children = yaml[csg_names[i]];
+        if (!children) continue;
+        if (!children.IsSequence() || children.size() == 0) {
+            throw error(children, std::string(csg_names[i]) + " needs a list of nodes");
+        }
+        node.op = csg_ops[i];
+        node.args[0] = readFloat(yaml, "smooth", 0.0f, 0.0f);
+        node.children.resize(children.size());
+        for (size_t child = 0; child < children.size(); child++) {
+            parseNode(children[child], node.children[child]);
+        }
+        bodies++;
+    }
+    if (bodies != 1) {
+        throw error(yaml, "a node needs exactly one of shape, union, intersect or subtract");
+    }
+    checkKeys(yaml, shape);
+
+    if (yaml["translate"]) {
+        readVec3(yaml["translate"], node.translate);
+        node.has_translate = true;
+    }
+    if (yaml["rotate"]) {
+        // Degrees about x, then y, then z
+        float angles[3];
+        readVec3(yaml["rotate"], angles);
+        for (int axis = 0; axis < 3; axis++) {
+            float half = angles[axis] * DEGREES * 0.5f;
+            float q[4] = {0.0f, 0.0f, 0.0f, std::cos(half)};
+            q[axis] = std::sin(half);
+            multiply(q, node.rotation, node.rotation);
+        }
+        node.has_rotate = true;
+    }
+    node.scale = readFloat(yaml, "scale", 1.0f, 1e-6f);
+
+    YAML::Node repeat = yaml["repeat"];
+    if (repeat) {
+        if (!repeat.IsMap() || !repeat["period"]) {
+            throw error(repeat, "repeat needs a period: [x, y, z], 0 on axes that don't repeat");
+        }
+        readVec3(repeat["period"], node.period);
+        float count[3] = {SceneGraph::UNBOUNDED, SceneGraph::UNBOUNDED, SceneGraph::UNBOUNDED};
+        if (repeat["count"]) readVec3(repeat["count"], count);
+        for (int axis = 0; axis < 3; axis++) {
+            if (!(node.period[axis] >= 0.0f) || !(count[axis] >= 0.0f)) {
+                throw error(repeat, "repeat period and count can't be negative");
+            }
+            node.cells[axis] = node.period[axis] > 0.0f ? std::floor(count[axis]) : 0.0f;
+        }
+        node.has_repeat = true;
+    }
+}
+
+// Where the node's surface can be, in its parent's space
+Bounds nodeBounds(const Node& node) {
+    const float U = SceneGraph::UNBOUNDED;
+    Bounds bounds = {{-U, -U, -U}, {U, U, U}};
+
+    switch (node.op) {
+    case SceneGraph::OP_SPHERE:
+        bounds = {{-node.args[0], -node.args[0], -node.args[0]}, {node.args[0], node.args[0], node.args[0]}};
+        break;
+    case SceneGraph::OP_BOX:
+        bounds = {{-node.args[0], -node.args[1], -node.args[2]}, {node.args[0], node.args[1], node.args[2]}};
+        break;
+    case SceneGraph::OP_TORUS: {
+        float outer = node.args[0] + node.args[1];
+        bounds = {{-outer, -node.args[1], -outer}, {outer, node.args[1], outer}};
+        break;
+    }
+    case SceneGraph::OP_CYLINDER:
+        bounds = {{-node.args[0], -node.args[1], -node.args[0]}, {node.args[0], node.args[1], node.args[0]}};
+        break;
+    case SceneGraph::OP_PLANE:
+        bounds.max[1] = 0.0f;
+        break;
+    case SceneGraph::OP_UNION:
+    case SceneGraph::OP_INTERSECT:
+    case SceneGraph::OP_SUBTRACT: {
+        bounds = nodeBounds(node.children[0]);
+        for (size_t i = 1; i < node.children.size() && node.op != SceneGraph::OP_SUBTRACT; i++) {
+            Bounds child = nodeBounds(node.children[i]);
+            for (int axis = 0; axis < 3; axis++) {
+                if (node.op == SceneGraph::OP_UNION) {
+                    bounds.min[axis] = std::min(bounds.min[axis], child.min[axis]);
+                    bounds.max[axis] = std::max(bounds.max[axis], child.max[axis]);
+                } else {
+                    bounds.min[axis] = std::max(bounds.min[axis], child.min[axis]);
+                    bounds.max[axis] = std::min(bounds.max[axis], child.max[axis]);
+                }
+            }
+        }
+        // A smooth union bulges out by at most a quarter of its smoothing; the others only shrink
+        if (node.op == SceneGraph::OP_UNION) {
+            for (int axis = 0; axis < 3; axis++) {
+                if (!isUnbounded(bounds.min[axis])) bounds.min[axis] -= node.args[0] * 0.25f;
+                if (!isUnbounded(bounds.max[axis])) bounds.max[axis] += node.args[0] * 0.25f;
+            }
+        }
+        break;
+    }
+    }
+
+    if (node.has_repeat) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (node.period[axis] <= 0.0f) continue;
+            if (isUnbounded(node.cells[axis])) {
+                bounds.min[axis] = -U;
+                bounds.max[axis] = U;
+            } else {
+                bounds.min[axis] -= node.period[axis] * node.cells[axis];
+                bounds.max[axis] += node.period[axis] * node.cells[axis];
+            }
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (!isUnbounded(bounds.min[axis])) bounds.min[axis] *= node.scale;
+        if (!isUnbounded(bounds.max[axis])) bounds.max[axis] *= node.scale;
+    }
+
+    if (node.has_rotate) {
+        if (isUnbounded(bounds)) {
+            bounds = {{-U, -U, -U}, {U, U, U}};
+        } else {
+            Bounds rotated = {{U, U, U}, {-U, -U, -U}};
+            for (int corner = 0; corner < 8; corner++) {
+                float point[3] = {
+                    (corner & 1) ? bounds.max[0] : bounds.min[0],
+                    (corner & 2) ? bounds.max[1] : bounds.min[1],
+                    (corner & 4) ? bounds.max[2] : bounds.min[2]
+                };
+                rotate(node.rotation, point, point);
+                for (int axis = 0; axis < 3; axis++) {
+                    rotated.min[axis] = std::min(rotated.min[axis], point[axis]);
+                    rotated.max[axis] = std::max(rotated.max[axis], point[axis]);
+                }
+            }
+            bounds = rotated;
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (!isUnbounded(bounds.min[axis])) bounds.min[axis] += node.translate[axis];
+        if (!isUnbounded(bounds.max[axis])) bounds.max[axis] += node.translate[axis];
+    }
+    return bounds;
+}
+
+SceneGraph::Record record(float a0, float a1, float a2, float a3,
+                          float b0 = 0.0f, float b1 = 0.0f, float b2 = 0.0f, float b3 = 0.0f) {
+    SceneGraph::Record result = {{a0, a1, a2, a3}, {b0, b1, b2, b3}};
+    return result;
+}
+
+// Postfix program for one object, tracking how deep its stacks get
+struct Compiler {
+    std::vector<SceneGraph::Record> code;
+    int distances = 0;
+    int max_distances = 0;
+    int points = 0;
+    int max_points = 0;
+
+    void emit(const Node& node, bool save_point) {
+        bool transformed = node.has_translate || node.has_rotate || node.scale != 1.0f || node.has_repeat;
+        // The root's point isn't needed afterwards
+        if (transformed && save_point) {
+            code.push_back(record(SceneGraph::OP_PUSH_POINT, 0.0f, 0.0f, 0.0f));
+            max_points = std::max(max_points, ++points);
+        }
+        if (node.has_translate) {
+            code.push_back(record(SceneGraph::OP_TRANSLATE, node.translate[0], node.translate[1], node.translate[2]));
+        }
+        if (node.has_rotate) {
+            // The shader takes the point into the node, so it rotates by the inverse
+            code.push_back(record(SceneGraph::OP_ROTATE, 0.0f, 0.0f, 0.0f,
+                                  -node.rotation[0], -node.rotation[1], -node.rotation[2], node.rotation[3]));
+        }
+        if (node.scale != 1.0f) {
+            code.push_back(record(SceneGraph::OP_SCALE, node.scale, 0.0f, 0.0f));
+        }
+        if (node.has_repeat) {
+            code.push_back(record(SceneGraph::OP_REPEAT, node.period[0], node.period[1], node.period[2],
+                                  node.cells[0], node.cells[1], node.cells[2]));
+        }
+
+        if (node.children.empty()) {
+            code.push_back(record((float)node.op, node.args[0], node.args[1], node.args[2], node.args[3]));
+            max_distances = std::max(max_distances, ++distances);
+        } else {
+            for (size_t i = 0; i < node.children.size(); i++) {
+                emit(node.children[i], true);
+                if (i > 0) {
+                    code.push_back(record((float)node.op, node.args[0], 0.0f, 0.0f));
+                    distances--;
+                }
+            }
+        }
+
+        if (transformed && save_point) {
+            code.push_back(record(SceneGraph::OP_POP_POINT, 0.0f, 0.0f, 0.0f));
+            points--;
+        }
+    }
+};
+
+struct Object {
+    Bounds bounds;
+    std::vector<SceneGraph::Record> code;
+};
+
+Bounds merge(const std::vector<Object>& objects, const std::vector<int>& order, int begin, int end) {
+    const float U = SceneGraph::UNBOUNDED;
+    Bounds bounds = {{U, U, U}, {-U, -U, -U}};
+    for (int i = begin; i < end; i++) {
+        const Bounds& b = objects[order[i]].bounds;
+        for (int axis = 0; axis < 3; axis++) {
+            bounds.min[axis] = std::min(bounds.min[axis], b.min[axis]);
+            bounds.max[axis] = std::max(bounds.max[axis], b.max[axis]);
+        }
+    }
+    return bounds;
+}
+
+// Median split on the widest axis of the centres: balanced, so depth stays near log2(n)
+int buildNode(std::vector<SceneGraph::Record>& nodes, const std::vector<Object>& objects, std::vector<int>& order,
+              int index, int begin, int end, int first_object) {
+    Bounds bounds = merge(objects, order, begin, end);
+    if (end - begin <= SceneGraph::LEAF_OBJECTS) {
+        nodes[index] = record(bounds.min[0], bounds.min[1], bounds.min[2], (float)(first_object + begin),
+                              bounds.max[0], bounds.max[1], bounds.max[2], (float)(end - begin));
+        return 1;
+    }
+
+    const float U = SceneGraph::UNBOUNDED;
+    Bounds centres = {{U, U, U}, {-U, -U, -U}};
+    for (int i = begin; i < end; i++) {
+        const Bounds& b = objects[order[i]].bounds;
+        for (int axis = 0; axis < 3; axis++) {
+            float centre = (b.min[axis] + b.max[axis]) * 0.5f;
+            centres.min[axis] = std::min(centres.min[axis], centre);
+            centres.max[axis] = std::max(centres.max[axis], centre);
+        }
+    }
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+        if (centres.max[a] - centres.min[a] > centres.max[axis] - centres.min[axis]) axis = a;
+    }
+
+    int middle = (begin + end) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](int a, int b) {
+        return objects[a].bounds.min[axis] + objects[a].bounds.max[axis] <
+               objects[b].bounds.min[axis] + objects[b].bounds.max[axis];
+    });
+
+    int left = (int)nodes.size();
+    nodes.resize(nodes.size() + 2);
+    int depth = std::max(buildNode(nodes, objects, order, left, begin, middle, first_object),
+                         buildNode(nodes, objects, order, left + 1, middle, end, first_object));
+    nodes[index] = record(bounds.min[0], bounds.min[1], bounds.min[2], (float)left,
+                          bounds.max[0], bounds.max[1], bounds.max[2], 0.0f);
+    return depth + 1;
+}
+
+}
+
+SceneGraph::SceneGraph() {
+    clear();
+}
+
+void SceneGraph::clear() {
+    records.assign(1, record(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f));
+    object_count = 0;
+    unbounded_count = 0;
+    node_count = 0;
+    instruction_count = 0;
+    depth = 0;
+}
+
+bool SceneGraph::load(const std::string& path) {
+    std::vector<Object> objects;
+    std::vector<int> unbounded;
+    std::vector<int> bounded;
+
+    try {
+        YAML::Node root = YAML::LoadFile(path);
+        YAML::Node list = root["objects"];
+        if (!list || !list.IsSequence()) {
+            throw error(root, "expected an objects: list");
+        }
+
+        for (size_t i = 0; i < list.size(); i++) {
+            Node node;
+            parseNode(list[i], node);
+
+            Compiler compiler;
+            compiler.emit(node, false);
+            if (compiler.max_distances > MAX_STACK || compiler.max_points > MAX_STACK) {
+                throw YAML::Exception(node.mark, "object nests more than " + std::to_string(MAX_STACK) + " levels deep");
+            }
+
+            Object object;
+            object.bounds = nodeBounds(node);
+            object.code.swap(compiler.code);
+            (isUnbounded(object.bounds) ? unbounded : bounded).push_back((int)objects.size());
+            objects.push_back(object);
+        }
+    } catch (const YAML::Exception& e) {
+        std::cerr << "Warning: Could not load scene " << path << ": " << e.what() << "\n";
+        return false;
+    }
+
+    std::vector<Record> nodes;
+    int tree_depth = 0;
+    if (!bounded.empty()) {
+        nodes.resize(1);
+        tree_depth = buildNode(nodes, objects, bounded, 0, 0, (int)bounded.size(), (int)unbounded.size());
+        if (tree_depth + 1 > BVH_STACK) {
+            std::cerr << "Warning: Could not load scene " << path << ": too many objects\n";
+            return false;
+        }
+    }
+
+    // Header, nodes, objects (unbounded first, then in leaf order), instructions
+    std::vector<int> order(unbounded);
+    order.insert(order.end(), bounded.begin(), bounded.end());
+    std::vector<Record> program;
+    std::vector<Record> object_records;
+    for (size_t i = 0; i < order.size(); i++) {
+        const Object& object = objects[order[i]];
+        object_records.push_back(record(object.bounds.min[0], object.bounds.min[1], object.bounds.min[2], (float)program.size(),
+                                        object.bounds.max[0], object.bounds.max[1], object.bounds.max[2], (float)object.code.size()));
+        program.insert(program.end(), object.code.begin(), object.code.end());
+    }
+
+    int node_offset = 1;
+    int object_offset = node_offset + (int)nodes.size();
+    int instruction_offset = object_offset + (int)object_records.size();
+
+    records.clear();
+    records.push_back(record((float)nodes.size(), (float)object_records.size(), (float)unbounded.size(), (float)program.size(),
+                             (float)node_offset, (float)object_offset, (float)instruction_offset, 0.0f));
+    records.insert(records.end(), nodes.begin(), nodes.end());
+    records.insert(records.end(), object_records.begin(), object_records.end());
+    records.insert(records.end(), program.begin(), program.end());
+
+    object_count = (int)object_records.size();
+    unbounded_count = (int)unbounded.size();
+    node_count = (int)nodes.size();
+    instruction_count = (int)program.size();
+    depth = tree_depth;
+
+    std::cout << "Loaded scene " << path << ": " << object_count << " objects (" << unbounded_count
+              << " unbounded), " << instruction_count << " instructions, " << node_count
+              << " BVH nodes, depth " << depth << "\n";
+    return true;
+}
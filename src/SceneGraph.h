@@ -0,0 +1,81 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <string>
+#include <vector>
+
+// Signed distance scene read from YAML: primitives under CSG and domain repetition, each
+// top-level object carrying its own transforms. It compiles to one flat buffer the shader
+// walks: a bounding volume hierarchy over the objects, and per object a short stack
+// program. A ray step only runs the programs of objects whose bounds are closer than the
+// step it would take anyway, so cost follows what's near the ray, not the object count
+class SceneGraph {
+public:
+    // 32 bytes, std430: the shader reads the buffer as an array of { vec4 a; vec4 b; }
+    struct Record {
+        float a[4];
+        float b[4];
+    };
+    static_assert(sizeof(Record) == 8 * sizeof(float), "Record must match the shader's SceneRecord");
+
+    // Instruction opcodes, matching SCENE_OP_* in huawei_audio.frag. Point ops move the
+    // evaluation point, shapes push a distance, CSG ops combine the top two
+    enum Op {
+        OP_PUSH_POINT,   // Save the point (and its scale) for the next sibling
+        OP_POP_POINT,
+        OP_TRANSLATE,    // a[1..3] = offset
+        OP_ROTATE,       // b = inverse rotation quaternion (x, y, z, w)
+        OP_SCALE,        // a[1] = uniform scale
+        OP_REPEAT,       // a[1..3] = period (0 = none), b[0..2] = cells each side
+        OP_SPHERE,       // a[1] = radius
+        OP_BOX,          // a[1..3] = half size, b[0] = rounding
+        OP_TORUS,        // a[1] = ring radius, a[2] = tube radius, around y
+        OP_CYLINDER,     // a[1] = radius, a[2] = half height, along y
+        OP_PLANE,        // y = 0, solid below
+        OP_UNION,        // a[1] = smoothing (0 = sharp)
+        OP_INTERSECT,
+        OP_SUBTRACT      // Second from first
+    };
+
+    // Fixed array sizes in the shader; deeper scenes are rejected at load
+    static const int MAX_STACK = 8;    // Distances, and saved points, per object
+    static const int BVH_STACK = 32;   // Traversal holds at most depth + 1 nodes
+    static const int LEAF_OBJECTS = 2;
+
+    // Stands in for infinity in bounds, which shaders don't reliably keep
+    static const float UNBOUNDED;
+
+    SceneGraph();
+
+    // Parses and compiles path. Returns false, leaving the scene as it was, on any error
+    bool load(const std::string& path);
+    void clear();
+
+    // Header record, then BVH nodes, objects and instructions:
+    //   header:      a = {node count, object count, unbounded objects, instruction count}
+    //                b = {node offset, object offset, instruction offset, 0}
+    //   node:        a = {min xyz, first}, b = {max xyz, object count}; 0 objects = inner node
+    //                whose children are nodes first and first + 1
+    //   object:      a = {min xyz, first instruction}, b = {max xyz, instruction count};
+    //                unbounded objects come first and sit outside the hierarchy
+    //   instruction: a = {op, args}, b = {args}
+    // Offsets are in records from the start of the buffer; indices inside a section are relative
+    const std::vector<Record>& getRecords() const { return records; }
+
+    int getObjectCount() const { return object_count; }
+    int getUnboundedCount() const { return unbounded_count; }
+    int getNodeCount() const { return node_count; }
+    int getInstructionCount() const { return instruction_count; }
+    int getDepth() const { return depth; }
+    bool isEmpty() const { return object_count == 0; }
+
+private:
+    std::vector<Record> records;
+    int object_count = 0;
+    int unbounded_count = 0;
+    int node_count = 0;
+    int instruction_count = 0;
+    int depth = 0;
+};
+
+#endif
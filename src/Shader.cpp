@@ -0,0 +1,73 @@
+#include "Shader.h"
+#include <fstream>
+#include <iostream>
+
+namespace Shader {
+
+SDL_GPUShaderFormat getFormat() {
+#ifdef __APPLE__
+    return SDL_GPU_SHADERFORMAT_MSL;
+#else
+    return SDL_GPU_SHADERFORMAT_SPIRV;
+#endif
+}
+
+const char* getExtension() {
+#ifdef __APPLE__
+    return ".metal";
+#else
+    return ".spv";
+#endif
+}
+
+const char* getEntrypoint() {
+#ifdef __APPLE__
+    return "main0";
+#else
+    return "main";
+#endif
+}
+
+std::vector<Uint8> load(const char* filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open shader file: " << filename << "\n";
+        return {};
+    }
+
+    size_t size = file.tellg();
+    std::vector<Uint8> buffer(size);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), size);
+    file.close();
+
+    return buffer;
+}
+
+SDL_GPUShader* create(SDL_GPUDevice* device, const std::string& path, SDL_GPUShaderStage stage,
+                      Uint32 num_samplers, Uint32 num_storage_buffers, Uint32 num_uniform_buffers) {
+    std::string filename = path + getExtension();
+    std::vector<Uint8> code = load(filename.c_str());
+    if (code.empty()) {
+        return nullptr;
+    }
+
+    SDL_GPUShaderCreateInfo info = {};
+    info.code = code.data();
+    info.code_size = code.size();
+    info.entrypoint = getEntrypoint();
+    info.format = getFormat();
+    info.stage = stage;
+    info.num_samplers = num_samplers;
+    info.num_storage_textures = 0;
+    info.num_storage_buffers = num_storage_buffers;
+    info.num_uniform_buffers = num_uniform_buffers;
+
+    SDL_GPUShader* shader = SDL_CreateGPUShader(device, &info);
+    if (!shader) {
+        std::cerr << "Failed to create shader " << filename << ": " << SDL_GetError() << "\n";
+    }
+    return shader;
+}
+
+}
@@ -0,0 +1,23 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_gpu.h>
+#include <vector>
+#include <string>
+
+// Loading compiled shaders for the platform's backend: SPIR-V, or MSL on Apple
+namespace Shader {
+    SDL_GPUShaderFormat getFormat();
+    const char* getExtension();
+    const char* getEntrypoint();
+
+    std::vector<Uint8> load(const char* filename);
+
+    // Loads `path` plus the platform extension (e.g. "src/shaders/post/tonemap.frag")
+    // with its resource counts; nullptr on failure
+    SDL_GPUShader* create(SDL_GPUDevice* device, const std::string& path, SDL_GPUShaderStage stage,
+                          Uint32 num_samplers, Uint32 num_storage_buffers, Uint32 num_uniform_buffers);
+}
+
+#endif
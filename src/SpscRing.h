@@ -0,0 +1,45 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+// Fixed-capacity queue between exactly one producer thread and one consumer thread.
+// Neither side ever blocks or locks: push fails when full, front() is null when empty
+template <typename T, size_t Capacity>
+class SpscRing {
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // Producer
+    bool push(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+        items[t % Capacity] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool full() const {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) == Capacity;
+    }
+
+    // Consumer: oldest item, valid until pop()
+    const T* front() const {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &items[h % Capacity];
+    }
+
+    void pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    T items[Capacity];
+    // On separate cache lines so the two threads don't false-share
+    alignas(64) std::atomic<size_t> head;  // Next to read, written by the consumer
+    alignas(64) std::atomic<size_t> tail;  // Next to write, written by the producer
+};
+
+#endif
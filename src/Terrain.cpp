@@ -0,0 +1,220 @@
+#include "Terrain.h"
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+namespace Terrain {
+
+namespace {
+
+float fract(float x) {
+    return x - std::floor(x);
+}
+
+float smoothstep(float edge0, float edge1, float x) {
+    float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// pcg2d() in huawei_audio.frag: integer only, so the two agree bit for bit
+void pcg2d(uint32_t& x, uint32_t& y) {
+    x = x * 1664525u + 1013904223u;
+    y = y * 1664525u + 1013904223u;
+    x += y * 1664525u;
+    y += x * 1664525u;
+    x ^= x >> 16;
+    y ^= y >> 16;
+    x += y * 1664525u;
+    y += x * 1664525u;
+    x ^= x >> 16;
+    y ^= y >> 16;
+}
+
+// Triangle wave in [-1, 1]: continuous, so rounding differences in t stay small instead of wrapping
+float triangle(float t) {
+    return 1.0f - 4.0f * std::fabs(fract(t) - 0.5f);
+}
+
+// Lattice gradient as hash2() in the shader: a phase and a drift rate per component
+void hash2(float px, float py, float time, float& gx, float& gy) {
+    uint32_t hx = (uint32_t)(int32_t)px;
+    uint32_t hy = (uint32_t)(int32_t)py;
+    pcg2d(hx, hy);
+    uint32_t rx = hx;
+    uint32_t ry = hy;
+    pcg2d(rx, ry);
+
+    float drift = time * HASH_DRIFT;
+    gx = triangle((float)(hx >> 8) * (1.0f / 16777216.0f) + ((float)(rx >> 8) * (2.0f / 16777216.0f) - 1.0f) * drift);
+    gy = triangle((float)(hy >> 8) * (1.0f / 16777216.0f) + ((float)(ry >> 8) * (2.0f / 16777216.0f) - 1.0f) * drift);
+}
+
+}
+
+float fbmOctaves(float footprint) {
+    if (footprint <= 0.0f) return (float)FBM_OCTAVES;
+    float octaves = std::log2(2.0f / (LOD_PIXELS * footprint)) + 1.0f;
+    return std::min(std::max(octaves, 1.0f), (float)FBM_OCTAVES);
+}
+
+float perlinNoise(float x, float y, float time) {
+    float ix = std::floor(x);
+    float iy = std::floor(y);
+    float fx = x - ix;
+    float fy = y - iy;
+
+    float g00x, g00y, g10x, g10y, g01x, g01y, g11x, g11y;
+    hash2(ix, iy, time, g00x, g00y);
+    hash2(ix + 1.0f, iy, time, g10x, g10y);
+    hash2(ix, iy + 1.0f, time, g01x, g01y);
+    hash2(ix + 1.0f, iy + 1.0f, time, g11x, g11y);
+
+    float n00 = g00x * fx + g00y * fy;
+    float n10 = g10x * (fx - 1.0f) + g10y * fy;
+    float n01 = g01x * fx + g01y * (fy - 1.0f);
+    float n11 = g11x * (fx - 1.0f) + g11y * (fy - 1.0f);
+
+    float ux = fx * fx * (3.0f - 2.0f * fx);
+    float uy = fy * fy * (3.0f - 2.0f * fy);
+    float nx0 = n00 + (n10 - n00) * ux;
+    float nx1 = n01 + (n11 - n01) * ux;
+    float nxy = nx0 + (nx1 - nx0) * uy;
+
+    return nxy * 0.5f + 0.5f;
+}
+
+float fbm(float x, float y, float time, float footprint) {
+    float value = 0.0f;
+    float amplitude = FBM_AMPLITUDE;
+    float freq = 1.0f;
+    float octaves = fbmOctaves(footprint);
+
+    for (int i = 0; i < FBM_OCTAVES; i++) {
+        float weight = std::min(std::max(octaves - (float)i, 0.0f), 1.0f);
+        if (weight <= 0.0f) {
+            // Culled octaves contribute their mean, as in the shader
+            value += 0.5f * amplitude * (1.0f - std::pow(FBM_GAIN, (float)(FBM_OCTAVES - i))) / (1.0f - FBM_GAIN);
+            break;
+        }
+
+        float noise = perlinNoise(x * freq, y * freq, time);
+        value += (0.5f + (noise - 0.5f) * weight) * amplitude;
+        amplitude *= FBM_GAIN;
+        freq *= 2.0f;
+    }
+
+    return value;
+}
+
+float height(float x, float z, float cam_x, float cam_z, float cam_yaw,
+             const std::array<float, 3>& left_bands, const std::array<float, 3>& right_bands,
+             float time, float footprint) {
+    float value = fbm(x * 0.5f, z * 0.5f, time, footprint);
+
+    float dx = x - cam_x;
+    float dz = z - cam_z;
+    float distance = std::sqrt(dx * dx + dz * dz);
+
+    // Stereo pan by side of the view
+    float side = (dx * std::cos(cam_yaw) - dz * std::sin(cam_yaw)) / std::max(distance, 1e-10f);
+    float right_weight = side * 0.5f + 0.5f;
+    std::array<float, 3> bands;
+    for (int i = 0; i < 3; i++) {
+        bands[i] = left_bands[i] + (right_bands[i] - left_bands[i]) * right_weight;
+    }
+
+    float third = MAX_DISTANCE / 3.0f;
+    float close_weight = smoothstep(third, 0.0f, distance);
+    float mid_weight = smoothstep(0.0f, third, distance) * smoothstep(2.0f * third, third, distance);
+    float far_weight = smoothstep(third, 2.0f * third, distance);
+
+    float multiplier = close_weight * bands[2] * HIGH_GAIN
+                     + mid_weight * bands[1] * MID_GAIN
+                     + far_weight * bands[0] * BASS_GAIN;
+    multiplier *= std::min(AUDIO_FALLOFF_CAP, distance / AUDIO_FALLOFF_DISTANCE);
+
+    return value * (1.0f + multiplier);
+}
+
+float maxFbm() {
+    float value = 0.0f;
+    float amplitude = FBM_AMPLITUDE;
+    for (int i = 0; i < FBM_OCTAVES; i++) {
+        value += NOISE_MAX * amplitude;
+        amplitude *= FBM_GAIN;
+    }
+    return value;
+}
+
+float maxAudioMultiplier(const std::array<float, 3>& bands) {
+    // The distance weights each stay in [0, 1], so summing every band is conservative
+    float weighted = BASS_GAIN * std::fabs(bands[0]) + MID_GAIN * std::fabs(bands[1]) + HIGH_GAIN * std::fabs(bands[2]);
+    return (weighted + WAVE_GAIN) * AUDIO_FALLOFF_CAP;
+}
+
+float maxHeight(const std::array<float, 3>& bands) {
+    return maxFbm() * (1.0f + maxAudioMultiplier(bands)) + WAVEFORM_GAIN;
+}
+
+float maxSlope(const std::array<float, 3>& left_bands, const std::array<float, 3>& right_bands) {
+    // perlinNoise() per axis: the fade-weighted corner gradients give at most 1, and the fade
+    // (slope up to 1.5) across corner differences of at most 2 adds 3. Halved by the remap to
+    // [0, 1], then combined over both axes. fbm() samples xz * 0.5
+    const float noise_slope = 2.0f * std::sqrt(2.0f);
+    float fbm_slope = 0.0f;
+    float amplitude = FBM_AMPLITUDE;
+    float freq = 0.5f;
+    for (int i = 0; i < FBM_OCTAVES; i++) {
+        fbm_slope += noise_slope * amplitude * freq;
+        amplitude *= FBM_GAIN;
+        freq *= 2.0f;
+    }
+
+    std::array<float, 3> bands;
+    for (int i = 0; i < 3; i++) {
+        bands[i] = std::max(std::fabs(left_bands[i]), std::fabs(right_bands[i]));
+    }
+    float weighted = BASS_GAIN * bands[0] + MID_GAIN * bands[1] + HIGH_GAIN * bands[2];
+    float pan_range = BASS_GAIN * std::fabs(right_bands[0] - left_bands[0])
+                    + MID_GAIN * std::fabs(right_bands[1] - left_bands[1])
+                    + HIGH_GAIN * std::fabs(right_bands[2] - left_bands[2]);
+
+    // How fast the audio multiplier changes across the ground: the band weights and falloff as
+    // in maxHeightChange(); the pan, whose side term turns at 1 / distance while the falloff is
+    // at most distance / AUDIO_FALLOFF_DISTANCE; and the linearly filtered spectrum history,
+    // one column per WAVE_SPEED along the distance and SPECTRUM_ROWS over MAX_DISTANCE across it
+    float weight_slope = AUDIO_FALLOFF_CAP * 3.0f / (MAX_DISTANCE / 3.0f) + 1.0f / AUDIO_FALLOFF_DISTANCE;
+    float history_slope = 1.0f / WAVE_SPEED + SPECTRUM_ROWS / MAX_DISTANCE;
+    float multiplier_slope = weighted * weight_slope + 0.5f * pan_range / AUDIO_FALLOFF_DISTANCE
+                           + WAVE_GAIN * (AUDIO_FALLOFF_CAP * history_slope + 1.0f / AUDIO_FALLOFF_DISTANCE);
+
+    // height = fbm * (1 + multiplier) + waveform * WAVEFORM_GAIN, the waveform spanning [-1, 1]
+    return fbm_slope * (1.0f + maxAudioMultiplier(bands)) + maxFbm() * multiplier_slope
+         + 2.0f * WAVEFORM_GAIN * history_slope;
+}
+
+float maxHeightChange(const std::array<float, 3>& prev_bands, const std::array<float, 3>& bands,
+                      float camera_move, float time_step) {
+    float fbm_max = maxFbm();
+
+    // New audio values scale the whole heightfield. maxAudioMultiplier() counts the full
+    // range of the spectrum history term, which can change anywhere from one frame to the next
+    std::array<float, 3> band_delta = {bands[0] - prev_bands[0], bands[1] - prev_bands[1], bands[2] - prev_bands[2]};
+    float audio_change = fbm_max * maxAudioMultiplier(band_delta) + 2.0f * WAVEFORM_GAIN;
+
+    // The audio weights depend on distance to the camera, so moving it reshapes the terrain.
+    // Steepest slopes: smoothstep over MAX_DISTANCE / 3 is 1.5 / width (twice that for the
+    // mid band product), and the near-camera falloff is 1 / AUDIO_FALLOFF_DISTANCE
+    float weighted = BASS_GAIN * std::fabs(bands[0]) + MID_GAIN * std::fabs(bands[1]) + HIGH_GAIN * std::fabs(bands[2]);
+    float weight_slope = AUDIO_FALLOFF_CAP * 3.0f / (MAX_DISTANCE / 3.0f) + 1.0f / AUDIO_FALLOFF_DISTANCE;
+    float camera_change = fbm_max * weighted * weight_slope * camera_move;
+
+    // hash2() drifts with time along a triangle wave (slope 4), moving each gradient
+    // component by at most this much
+    float gradient_drift = 4.0f * HASH_DRIFT * time_step;
+    float time_change = fbm_max * std::fmin(gradient_drift, 2.0f) * (1.0f + maxAudioMultiplier(bands));
+
+    return audio_change + camera_change + time_change;
+}
+
+}
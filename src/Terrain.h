@@ -0,0 +1,83 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <array>
+
+// CPU mirror of the terrain model in huawei_audio.frag
+// Keep these constants in sync with fbm() and terrainHeightMap()
+namespace Terrain {
+    const int FBM_OCTAVES = 8;
+    const float FBM_AMPLITUDE = 1.6f;   // First octave amplitude
+    const float FBM_GAIN = 0.4f;        // Amplitude falloff per octave
+    const float NOISE_MAX = 1.0f;       // perlinNoise() output is in [0, 1]
+
+    // Audio height multipliers per band
+    const float HIGH_GAIN = 2.5f;
+    const float MID_GAIN = 1.5f;
+    const float BASS_GAIN = 1.5f;
+    const float AUDIO_FALLOFF_CAP = 0.25f;      // min(0.25, d / 8)
+    const float AUDIO_FALLOFF_DISTANCE = 8.0f;
+
+    // Audio history sampled by distance (a wave travelling outward)
+    const float WAVE_GAIN = 1.0f;       // Spectrum value [0, 1] joins the band multiplier
+    const float WAVEFORM_GAIN = 0.1f;   // Waveform [-1, 1] added to the height directly
+    const float WAVE_SPEED = 0.5f;      // World units per spectrum column
+    const float SPECTRUM_ROWS = 128.0f; // spectrumHistory height (AudioAnalyzer::SPECTRUM_BINS) over MAX_DISTANCE
+
+    const float MAX_DISTANCE = 100.0f;          // u_max_distance
+    const float LOD_PIXELS = 1.0f;              // lod_pixels at the default (high) quality tier
+    const float HASH_DRIFT = 1.1f;              // Fastest gradient drift, triangle-wave periods per second of camera.time
+    const float HEIGHT_BOUND_MARGIN = 0.01f;    // Float rounding, and octaves the GPU culls to their mean near the camera
+
+    // Octaves worth evaluating for a world-space pixel footprint (fractional: last one fades in)
+    float fbmOctaves(float footprint);
+
+    // Reference implementations of the shader's noise, for CPU-side queries.
+    // A footprint of 0 evaluates every octave
+    float perlinNoise(float x, float y, float time);
+    float fbm(float x, float y, float time, float footprint = 0.0f);
+    // Bands are [bass, mid, high] for each stereo side; pass the mono bands twice for mono input.
+    // The travelling spectrum/waveform term needs the GPU history texture and is left out;
+    // the bounds below include it
+    float height(float x, float z, float cam_x, float cam_z, float cam_yaw,
+                 const std::array<float, 3>& left_bands, const std::array<float, 3>& right_bands,
+                 float time, float footprint = 0.0f);
+
+    // Everything a batched query needs besides the points: the frame's camera and audio
+    struct Frame {
+        float cam_x, cam_z, cam_yaw;
+        std::array<float, 3> left_bands;
+        std::array<float, 3> right_bands;
+        float time;
+        float footprint;  // 0 evaluates every octave
+    };
+
+    // height() at count points, four at a time with SSE2 or NEON (TerrainBatch.cpp)
+    void heightBatch(const Frame& frame, const float* xs, const float* zs, int count, float* heights);
+    // heightBatch() plus the most the spectrum and waveform history can add at each point,
+    // plus HEIGHT_BOUND_MARGIN. The lattice hash is integer, so the shader computes the same
+    // heights up to float rounding; the margin covers that at the queried points only
+    void heightBoundBatch(const Frame& frame, const float* xs, const float* zs, int count, float* heights);
+    // Unit normals (xyz triples) by central differences half a footprint wide, as getNormal()
+    void normalBatch(const Frame& frame, const float* xs, const float* zs, int count, float* normals);
+    const char* getBatchImplementationName();
+
+    // Upper bound of fbm() over all inputs
+    float maxFbm();
+
+    // Upper bound of the audio height multiplier for the given [bass, mid, high], spectrum term included
+    float maxAudioMultiplier(const std::array<float, 3>& bands);
+
+    // Highest point terrainHeightMap() can reach with these bands
+    float maxHeight(const std::array<float, 3>& bands);
+
+    // Upper bound of the terrain's horizontal slope (rise per unit run) for these bands,
+    // spectrum and waveform history included
+    float maxSlope(const std::array<float, 3>& left_bands, const std::array<float, 3>& right_bands);
+
+    // Upper bound on how far any terrain point can rise between two frames
+    float maxHeightChange(const std::array<float, 3>& prev_bands, const std::array<float, 3>& bands,
+                          float camera_move, float time_step);
+}
+
+#endif
@@ -0,0 +1,323 @@
+#include "Terrain.h"
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TERRAIN_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TERRAIN_NEON 1
+#endif
+
+// Batched terrain queries: the same arithmetic as height() in Terrain.cpp, four points per
+// instruction. The lattice hash is integer, so the two agree up to float rounding
+namespace Terrain {
+
+namespace {
+
+const float NORMAL_EPSILON = 0.01f;  // Difference half-width when the footprint is 0
+
+#if TERRAIN_SSE2 || TERRAIN_NEON
+
+#if TERRAIN_SSE2
+
+struct F4 {
+    __m128 v;
+};
+
+inline F4 set(float x) { F4 r = {_mm_set1_ps(x)}; return r; }
+inline F4 load(const float* p) { F4 r = {_mm_loadu_ps(p)}; return r; }
+inline void store(float* p, F4 a) { _mm_storeu_ps(p, a.v); }
+inline F4 operator+(F4 a, F4 b) { F4 r = {_mm_add_ps(a.v, b.v)}; return r; }
+inline F4 operator-(F4 a, F4 b) { F4 r = {_mm_sub_ps(a.v, b.v)}; return r; }
+inline F4 operator*(F4 a, F4 b) { F4 r = {_mm_mul_ps(a.v, b.v)}; return r; }
+inline F4 operator/(F4 a, F4 b) { F4 r = {_mm_div_ps(a.v, b.v)}; return r; }
+inline F4 min(F4 a, F4 b) { F4 r = {_mm_min_ps(a.v, b.v)}; return r; }
+inline F4 max(F4 a, F4 b) { F4 r = {_mm_max_ps(a.v, b.v)}; return r; }
+inline F4 sqrt(F4 a) { F4 r = {_mm_sqrt_ps(a.v)}; return r; }
+
+// SSE2 has no floor; truncate and step down where that rounded up (coordinates stay far
+// inside int range)
+inline F4 floor(F4 a) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    F4 r = {_mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)))};
+    return r;
+}
+
+struct U4 {
+    __m128i v;
+};
+
+inline U4 setu(uint32_t x) { U4 r = {_mm_set1_epi32((int)x)}; return r; }
+inline U4 operator+(U4 a, U4 b) { U4 r = {_mm_add_epi32(a.v, b.v)}; return r; }
+inline U4 operator^(U4 a, U4 b) { U4 r = {_mm_xor_si128(a.v, b.v)}; return r; }
+inline U4 operator>>(U4 a, int n) { U4 r = {_mm_srli_epi32(a.v, n)}; return r; }
+
+// SSE2 only multiplies even lanes to 64 bits; do both halves and keep the low words
+inline U4 operator*(U4 a, U4 b) {
+    __m128i even = _mm_mul_epu32(a.v, b.v);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+    U4 r = {_mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                               _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)))};
+    return r;
+}
+
+// Whole floats (already floored) to their two's complement bits, and values under 2^24 back
+inline U4 toBits(F4 a) { U4 r = {_mm_cvttps_epi32(a.v)}; return r; }
+inline F4 toFloat(U4 a) { F4 r = {_mm_cvtepi32_ps(a.v)}; return r; }
+inline F4 abs(F4 a) { F4 r = {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; return r; }
+
+#else
+
+struct F4 {
+    float32x4_t v;
+};
+
+inline F4 set(float x) { F4 r = {vdupq_n_f32(x)}; return r; }
+inline F4 load(const float* p) { F4 r = {vld1q_f32(p)}; return r; }
+inline void store(float* p, F4 a) { vst1q_f32(p, a.v); }
+inline F4 operator+(F4 a, F4 b) { F4 r = {vaddq_f32(a.v, b.v)}; return r; }
+inline F4 operator-(F4 a, F4 b) { F4 r = {vsubq_f32(a.v, b.v)}; return r; }
+inline F4 operator*(F4 a, F4 b) { F4 r = {vmulq_f32(a.v, b.v)}; return r; }
+inline F4 operator/(F4 a, F4 b) { F4 r = {vdivq_f32(a.v, b.v)}; return r; }
+inline F4 min(F4 a, F4 b) { F4 r = {vminq_f32(a.v, b.v)}; return r; }
+inline F4 max(F4 a, F4 b) { F4 r = {vmaxq_f32(a.v, b.v)}; return r; }
+inline F4 sqrt(F4 a) { F4 r = {vsqrtq_f32(a.v)}; return r; }
+inline F4 floor(F4 a) { F4 r = {vrndmq_f32(a.v)}; return r; }
+
+struct U4 {
+    uint32x4_t v;
+};
+
+inline U4 setu(uint32_t x) { U4 r = {vdupq_n_u32(x)}; return r; }
+inline U4 operator+(U4 a, U4 b) { U4 r = {vaddq_u32(a.v, b.v)}; return r; }
+inline U4 operator*(U4 a, U4 b) { U4 r = {vmulq_u32(a.v, b.v)}; return r; }
+inline U4 operator^(U4 a, U4 b) { U4 r = {veorq_u32(a.v, b.v)}; return r; }
+inline U4 operator>>(U4 a, int n) { U4 r = {vshlq_u32(a.v, vdupq_n_s32(-n))}; return r; }
+
+// Whole floats (already floored) to their two's complement bits, and values under 2^24 back
+inline U4 toBits(F4 a) { U4 r = {vreinterpretq_u32_s32(vcvtq_s32_f32(a.v))}; return r; }
+inline F4 toFloat(U4 a) { F4 r = {vcvtq_f32_u32(a.v)}; return r; }
+inline F4 abs(F4 a) { F4 r = {vabsq_f32(a.v)}; return r; }
+
+#endif
+
+inline F4 fract(F4 a) {
+    return a - floor(a);
+}
+
+inline F4 clamp01(F4 a) {
+    return min(max(a, set(0.0f)), set(1.0f));
+}
+
+inline F4 smoothstep(float edge0, float edge1, F4 x) {
+    F4 t = clamp01((x - set(edge0)) * set(1.0f / (edge1 - edge0)));
+    return t * t * (set(3.0f) - set(2.0f) * t);
+}
+
+struct Hash {
+    F4 gx, gy;
+};
+
+// pcg2d() in huawei_audio.frag, as in Terrain.cpp
+inline void pcg2d(U4& x, U4& y) {
+    U4 multiplier = setu(1664525u);
+    x = x * multiplier + setu(1013904223u);
+    y = y * multiplier + setu(1013904223u);
+    x = x + y * multiplier;
+    y = y + x * multiplier;
+    x = x ^ (x >> 16);
+    y = y ^ (y >> 16);
+    x = x + y * multiplier;
+    y = y + x * multiplier;
+    x = x ^ (x >> 16);
+    y = y ^ (y >> 16);
+}
+
+inline F4 triangle(F4 t) {
+    return set(1.0f) - set(4.0f) * abs(fract(t) - set(0.5f));
+}
+
+inline Hash hash2(F4 px, F4 py, F4 drift) {
+    U4 hx = toBits(px);
+    U4 hy = toBits(py);
+    pcg2d(hx, hy);
+    U4 rx = hx;
+    U4 ry = hy;
+    pcg2d(rx, ry);
+
+    F4 unit = set(1.0f / 16777216.0f);
+    F4 twice = set(2.0f / 16777216.0f);
+    Hash g = {
+        triangle(toFloat(hx >> 8) * unit + (toFloat(rx >> 8) * twice - set(1.0f)) * drift),
+        triangle(toFloat(hy >> 8) * unit + (toFloat(ry >> 8) * twice - set(1.0f)) * drift)
+    };
+    return g;
+}
+
+inline F4 perlinNoise(F4 x, F4 y, F4 drift) {
+    F4 ix = floor(x);
+    F4 iy = floor(y);
+    F4 fx = x - ix;
+    F4 fy = y - iy;
+    F4 one = set(1.0f);
+
+    Hash g00 = hash2(ix, iy, drift);
+    Hash g10 = hash2(ix + one, iy, drift);
+    Hash g01 = hash2(ix, iy + one, drift);
+    Hash g11 = hash2(ix + one, iy + one, drift);
+
+    F4 n00 = g00.gx * fx + g00.gy * fy;
+    F4 n10 = g10.gx * (fx - one) + g10.gy * fy;
+    F4 n01 = g01.gx * fx + g01.gy * (fy - one);
+    F4 n11 = g11.gx * (fx - one) + g11.gy * (fy - one);
+
+    F4 ux = fx * fx * (set(3.0f) - set(2.0f) * fx);
+    F4 uy = fy * fy * (set(3.0f) - set(2.0f) * fy);
+    F4 nx0 = n00 + (n10 - n00) * ux;
+    F4 nx1 = n01 + (n11 - n01) * ux;
+    F4 nxy = nx0 + (nx1 - nx0) * uy;
+
+    return nxy * set(0.5f) + set(0.5f);
+}
+
+inline F4 fbm(F4 x, F4 y, float time, float footprint) {
+    F4 value = set(0.0f);
+    F4 drift = set(time * HASH_DRIFT);
+    float amplitude = FBM_AMPLITUDE;
+    float freq = 1.0f;
+    float octaves = fbmOctaves(footprint);
+
+    for (int i = 0; i < FBM_OCTAVES; i++) {
+        float weight = std::min(std::max(octaves - (float)i, 0.0f), 1.0f);
+        if (weight <= 0.0f) {
+            value = value + set(0.5f * amplitude * (1.0f - std::pow(FBM_GAIN, (float)(FBM_OCTAVES - i))) / (1.0f - FBM_GAIN));
+            break;
+        }
+
+        F4 noise = perlinNoise(x * set(freq), y * set(freq), drift);
+        value = value + (set(0.5f) + (noise - set(0.5f)) * set(weight)) * set(amplitude);
+        amplitude *= FBM_GAIN;
+        freq *= 2.0f;
+    }
+    return value;
+}
+
+// height() for four points; with bound, plus the most the history terms can add
+inline F4 height4(const Frame& frame, F4 x, F4 z, bool bound) {
+    F4 value = fbm(x * set(0.5f), z * set(0.5f), frame.time, frame.footprint);
+
+    F4 dx = x - set(frame.cam_x);
+    F4 dz = z - set(frame.cam_z);
+    F4 distance = sqrt(dx * dx + dz * dz);
+
+    F4 side = (dx * set(std::cos(frame.cam_yaw)) - dz * set(std::sin(frame.cam_yaw))) / max(distance, set(1e-10f));
+    F4 right_weight = side * set(0.5f) + set(0.5f);
+    F4 bands[3];
+    for (int i = 0; i < 3; i++) {
+        bands[i] = set(frame.left_bands[i]) + set(frame.right_bands[i] - frame.left_bands[i]) * right_weight;
+    }
+
+    float third = MAX_DISTANCE / 3.0f;
+    F4 close_weight = smoothstep(third, 0.0f, distance);
+    F4 mid_weight = smoothstep(0.0f, third, distance) * smoothstep(2.0f * third, third, distance);
+    F4 far_weight = smoothstep(third, 2.0f * third, distance);
+
+    F4 multiplier = close_weight * bands[2] * set(HIGH_GAIN)
+                  + mid_weight * bands[1] * set(MID_GAIN)
+                  + far_weight * bands[0] * set(BASS_GAIN);
+    if (bound) {
+        multiplier = multiplier + set(WAVE_GAIN);
+    }
+    multiplier = multiplier * min(set(AUDIO_FALLOFF_CAP), distance * set(1.0f / AUDIO_FALLOFF_DISTANCE));
+
+    F4 result = value * (set(1.0f) + multiplier);
+    return bound ? result + set(WAVEFORM_GAIN + HEIGHT_BOUND_MARGIN) : result;
+}
+
+#endif
+
+void heights(const Frame& frame, const float* xs, const float* zs, int count, float* out, bool bound) {
+#if TERRAIN_SSE2 || TERRAIN_NEON
+    int whole = count & ~3;
+    for (int i = 0; i < whole; i += 4) {
+        store(out + i, height4(frame, load(xs + i), load(zs + i), bound));
+    }
+    if (whole < count) {
+        // Pad the last group by repeating its final point
+        float x[4], z[4], h[4];
+        for (int lane = 0; lane < 4; lane++) {
+            int source = std::min(whole + lane, count - 1);
+            x[lane] = xs[source];
+            z[lane] = zs[source];
+        }
+        store(h, height4(frame, load(x), load(z), bound));
+        std::copy(h, h + (count - whole), out + whole);
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        out[i] = height(xs[i], zs[i], frame.cam_x, frame.cam_z, frame.cam_yaw, frame.left_bands, frame.right_bands,
+                        frame.time, frame.footprint);
+        if (bound) {
+            float dx = xs[i] - frame.cam_x;
+            float dz = zs[i] - frame.cam_z;
+            float falloff = std::min(AUDIO_FALLOFF_CAP, std::sqrt(dx * dx + dz * dz) / AUDIO_FALLOFF_DISTANCE);
+            out[i] += fbm(xs[i] * 0.5f, zs[i] * 0.5f, frame.time, frame.footprint) * WAVE_GAIN * falloff + WAVEFORM_GAIN + HEIGHT_BOUND_MARGIN;
+        }
+    }
+#endif
+}
+
+}
+
+void heightBatch(const Frame& frame, const float* xs, const float* zs, int count, float* out) {
+    heights(frame, xs, zs, count, out, false);
+}
+
+void heightBoundBatch(const Frame& frame, const float* xs, const float* zs, int count, float* out) {
+    heights(frame, xs, zs, count, out, true);
+}
+
+void normalBatch(const Frame& frame, const float* xs, const float* zs, int count, float* normals) {
+    float eps = frame.footprint > 0.0f ? 0.5f * frame.footprint : NORMAL_EPSILON;
+
+    // All four neighbours of a group go through one batch
+    const int GROUP = 64;
+    float px[GROUP * 4], pz[GROUP * 4], h[GROUP * 4];
+    for (int first = 0; first < count; first += GROUP) {
+        int n = std::min(count - first, GROUP);
+        for (int i = 0; i < n; i++) {
+            float x = xs[first + i], z = zs[first + i];
+            px[i] = x - eps;         pz[i] = z;
+            px[n + i] = x + eps;     pz[n + i] = z;
+            px[2 * n + i] = x;       pz[2 * n + i] = z - eps;
+            px[3 * n + i] = x;       pz[3 * n + i] = z + eps;
+        }
+        heightBatch(frame, px, pz, 4 * n, h);
+
+        for (int i = 0; i < n; i++) {
+            float nx = h[i] - h[n + i];
+            float ny = 2.0f * eps;
+            float nz = h[2 * n + i] - h[3 * n + i];
+            float scale = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz);
+            float* normal = normals + (first + i) * 3;
+            normal[0] = nx * scale;
+            normal[1] = ny * scale;
+            normal[2] = nz * scale;
+        }
+    }
+}
+
+const char* getBatchImplementationName() {
+#if TERRAIN_SSE2
+    return "SSE2";
+#elif TERRAIN_NEON
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+}
@@ -0,0 +1,223 @@
+#include "YUVConvert.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define YUV_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define YUV_NEON 1
+#endif
+
+// BT.709 limited range in 8.8 fixed point:
+//   Y = ( 47 R + 157 G +  16 B) / 256 + 16
+//   U = (-26 R -  86 G + 112 B) / 256 + 128
+//   V = (112 R - 102 G -  10 B) / 256 + 128
+namespace {
+
+inline Uint8 lumaOf(const Uint8* p) {
+    return (Uint8)(((47 * p[0] + 157 * p[1] + 16 * p[2] + 128) >> 8) + 16);
+}
+
+inline Uint8 clampByte(int value) {
+    return (Uint8)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// Chroma of the 2x2 block at (x, y), clamped to the image
+inline void chromaOf(const Uint8* rgba, int width, int height, int pitch, int x, int y, Uint8* u, Uint8* v) {
+    int x1 = x + 1 < width ? x + 1 : x;
+    int y1 = y + 1 < height ? y + 1 : y;
+    const Uint8* p[4] = {
+        rgba + y * pitch + x * 4, rgba + y * pitch + x1 * 4,
+        rgba + y1 * pitch + x * 4, rgba + y1 * pitch + x1 * 4
+    };
+    int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+    int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+    int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+    *u = clampByte(((-26 * r - 86 * g + 112 * b + 128) >> 8) + 128);
+    *v = clampByte(((112 * r - 102 * g - 10 * b + 128) >> 8) + 128);
+}
+
+void lumaRowScalar(const Uint8* row, Uint8* y_row, int from, int width) {
+    for (int x = from; x < width; x++) {
+        y_row[x] = lumaOf(row + x * 4);
+    }
+}
+
+void chromaRowScalar(const Uint8* rgba, int width, int height, int pitch, int y, int from_x,
+                     Uint8* u_row, Uint8* v_row) {
+    for (int x = from_x; x < width; x += 2) {
+        chromaOf(rgba, width, height, pitch, x, y, &u_row[x / 2], &v_row[x / 2]);
+    }
+}
+
+#if YUV_SSE2
+
+// 8 pixels' R, G, B as 16-bit lanes
+inline void unpackRGB8(const Uint8* p, __m128i& r, __m128i& g, __m128i& b) {
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i a = _mm_loadu_si128((const __m128i*)p);
+    __m128i c = _mm_loadu_si128((const __m128i*)(p + 16));
+    r = _mm_packs_epi32(_mm_and_si128(a, mask), _mm_and_si128(c, mask));
+    g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), mask), _mm_and_si128(_mm_srli_epi32(c, 8), mask));
+    b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), mask), _mm_and_si128(_mm_srli_epi32(c, 16), mask));
+}
+
+// 16 pixels per step; every term is positive and the sum stays under 2^16, so
+// wrapping 16-bit multiplies with a logical shift are exact
+int lumaRowSIMD(const Uint8* row, Uint8* y_row, int width) {
+    const __m128i kr = _mm_set1_epi16(47), kg = _mm_set1_epi16(157), kb = _mm_set1_epi16(16);
+    const __m128i round = _mm_set1_epi16(128), offset = _mm_set1_epi16(16);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i half[2];
+        for (int h = 0; h < 2; h++) {
+            __m128i r, g, b;
+            unpackRGB8(row + (x + h * 8) * 4, r, g, b);
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, kr), _mm_mullo_epi16(g, kg)),
+                                        _mm_add_epi16(_mm_mullo_epi16(b, kb), round));
+            half[h] = _mm_add_epi16(_mm_srli_epi16(sum, 8), offset);
+        }
+        _mm_storeu_si128((__m128i*)(y_row + x), _mm_packus_epi16(half[0], half[1]));
+    }
+    return x;
+}
+
+// 4 horizontally averaged pixel pairs from 8 pixels of two rows
+inline __m128i averageBlock4(const Uint8* row0, const Uint8* row1) {
+    __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)row0), _mm_loadu_si128((const __m128i*)row1));
+    __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(row0 + 16)), _mm_loadu_si128((const __m128i*)(row1 + 16)));
+    __m128i even = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_avg_epu8(even, odd);
+}
+
+// 16 pixels (8 chroma samples) of a row pair per step. Byte averaging rounds up twice,
+// which the scalar path's single rounding can differ from by one
+int chromaRowSIMD(const Uint8* row0, const Uint8* row1, Uint8* u_row, Uint8* v_row, int width) {
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128i ur = _mm_set1_epi16(-26), ug = _mm_set1_epi16(-86), ub = _mm_set1_epi16(112);
+    const __m128i vr = _mm_set1_epi16(112), vg = _mm_set1_epi16(-102), vb = _mm_set1_epi16(-10);
+    const __m128i round = _mm_set1_epi16(128), offset = _mm_set1_epi16(128);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i lo = averageBlock4(row0 + x * 4, row1 + x * 4);
+        __m128i hi = averageBlock4(row0 + (x + 8) * 4, row1 + (x + 8) * 4);
+        __m128i r = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+        __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+        __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+
+        __m128i u = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, ur), _mm_mullo_epi16(g, ug)),
+                                  _mm_add_epi16(_mm_mullo_epi16(b, ub), round));
+        __m128i v = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, vr), _mm_mullo_epi16(g, vg)),
+                                  _mm_add_epi16(_mm_mullo_epi16(b, vb), round));
+        u = _mm_add_epi16(_mm_srai_epi16(u, 8), offset);
+        v = _mm_add_epi16(_mm_srai_epi16(v, 8), offset);
+
+        _mm_storel_epi64((__m128i*)(u_row + x / 2), _mm_packus_epi16(u, u));
+        _mm_storel_epi64((__m128i*)(v_row + x / 2), _mm_packus_epi16(v, v));
+    }
+    return x;
+}
+
+#elif YUV_NEON
+
+int lumaRowSIMD(const Uint8* row, Uint8* y_row, int width) {
+    const uint8x8_t kr = vdup_n_u8(47), kg = vdup_n_u8(157), kb = vdup_n_u8(16), offset = vdup_n_u8(16);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t px = vld4q_u8(row + x * 4);
+        uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), kr);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[1]), kg);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[2]), kb);
+        uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), kr);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[1]), kg);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[2]), kb);
+
+        // Rounding narrow adds the 128 before the shift
+        uint8x16_t y = vcombine_u8(vadd_u8(vrshrn_n_u16(lo, 8), offset), vadd_u8(vrshrn_n_u16(hi, 8), offset));
+        vst1q_u8(y_row + x, y);
+    }
+    return x;
+}
+
+int chromaRowSIMD(const Uint8* row0, const Uint8* row1, Uint8* u_row, Uint8* v_row, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t a = vld4q_u8(row0 + x * 4);
+        uint8x16x4_t b = vld4q_u8(row1 + x * 4);
+
+        // Sum of each 2x2 block, then its rounded mean
+        int16x8_t rgb[3];
+        for (int c = 0; c < 3; c++) {
+            uint16x8_t sum = vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c]));
+            rgb[c] = vreinterpretq_s16_u16(vrshrq_n_u16(sum, 2));
+        }
+
+        int16x8_t u = vmulq_n_s16(rgb[0], -26);
+        u = vmlaq_n_s16(u, rgb[1], -86);
+        u = vmlaq_n_s16(u, rgb[2], 112);
+        int16x8_t v = vmulq_n_s16(rgb[0], 112);
+        v = vmlaq_n_s16(v, rgb[1], -102);
+        v = vmlaq_n_s16(v, rgb[2], -10);
+
+        const int16x8_t offset = vdupq_n_s16(128);
+        vst1_u8(u_row + x / 2, vqmovun_s16(vaddq_s16(vrshrq_n_s16(u, 8), offset)));
+        vst1_u8(v_row + x / 2, vqmovun_s16(vaddq_s16(vrshrq_n_s16(v, 8), offset)));
+    }
+    return x;
+}
+
+#else
+
+int lumaRowSIMD(const Uint8*, Uint8*, int) { return 0; }
+int chromaRowSIMD(const Uint8*, const Uint8*, Uint8*, Uint8*, int) { return 0; }
+
+#endif
+
+}
+
+namespace YUVConvert {
+
+void rgbaToI420Scalar(const Uint8* rgba, int width, int height, int rgba_pitch,
+                      Uint8* y_plane, int y_pitch, Uint8* u_plane, Uint8* v_plane, int uv_pitch) {
+    for (int y = 0; y < height; y++) {
+        lumaRowScalar(rgba + y * rgba_pitch, y_plane + y * y_pitch, 0, width);
+    }
+    for (int y = 0; y < height; y += 2) {
+        chromaRowScalar(rgba, width, height, rgba_pitch, y, 0, u_plane + (y / 2) * uv_pitch, v_plane + (y / 2) * uv_pitch);
+    }
+}
+
+void rgbaToI420(const Uint8* rgba, int width, int height, int rgba_pitch,
+                Uint8* y_plane, int y_pitch, Uint8* u_plane, Uint8* v_plane, int uv_pitch) {
+    for (int y = 0; y < height; y++) {
+        const Uint8* row = rgba + y * rgba_pitch;
+        Uint8* y_row = y_plane + y * y_pitch;
+        lumaRowScalar(row, y_row, lumaRowSIMD(row, y_row, width), width);
+    }
+
+    for (int y = 0; y < height; y += 2) {
+        Uint8* u_row = u_plane + (y / 2) * uv_pitch;
+        Uint8* v_row = v_plane + (y / 2) * uv_pitch;
+        int done = 0;
+        if (y + 1 < height) {
+            done = chromaRowSIMD(rgba + y * rgba_pitch, rgba + (y + 1) * rgba_pitch, u_row, v_row, width);
+        }
+        chromaRowScalar(rgba, width, height, rgba_pitch, y, done, u_row, v_row);
+    }
+}
+
+const char* getImplementationName() {
+#if YUV_SSE2
+    return "SSE2";
+#elif YUV_NEON
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+}
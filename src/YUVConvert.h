@@ -0,0 +1,21 @@
+#ifndef YUV_CONVERT_H
+#define YUV_CONVERT_H
+
+#include <SDL3/SDL.h>
+
+// RGBA8 (sRGB-encoded, as read back from the render target) to planar YUV 4:2:0,
+// BT.709 limited range, the layout Y4M and most encoders take directly.
+// SSE2 or NEON where the compiler targets them, scalar otherwise
+namespace YUVConvert {
+    // Chroma planes are (width + 1) / 2 by (height + 1) / 2; odd edges repeat the last pixel
+    void rgbaToI420(const Uint8* rgba, int width, int height, int rgba_pitch,
+                    Uint8* y_plane, int y_pitch, Uint8* u_plane, Uint8* v_plane, int uv_pitch);
+
+    // Reference conversion, for tests and the tails the SIMD paths leave
+    void rgbaToI420Scalar(const Uint8* rgba, int width, int height, int rgba_pitch,
+                          Uint8* y_plane, int y_pitch, Uint8* u_plane, Uint8* v_plane, int uv_pitch);
+
+    const char* getImplementationName();
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include <SDL3/SDL.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include "AudioAnalyzer.h"
+#include "BandFile.h"
+
+// Writes a track's feature file (BandFile) once, so renders, seeking and render farm workers
+// read its analysis instead of running FFTs over the audio again
+
+namespace {
+
+void printInfo(const std::string& path, const BandFile& track) {
+    double duration = track.getDurationNS() / (double)SDL_NS_PER_SECOND;
+    std::cout << path << ": version " << BandFile::VERSION << ", " << track.getSampleRate() << " Hz, "
+              << track.getChannelCount() << " ch, " << duration << " s\n";
+    std::cout << "  " << track.getRecordCount() << " hops of " << track.getHopNS() / 1e6 << " ms, "
+              << sizeof(BandFile::Record) << " bytes each\n";
+
+    Uint64 onsets = 0;
+    float peak = 0.0f;
+    for (Uint64 i = 0; i < track.getRecordCount(); i++) {
+        const BandFile::Record& record = track.getRecord(i);
+        onsets += record.beat.onset ? 1 : 0;
+        peak = std::max(peak, record.rms);
+    }
+    const BandFile::Record& last = track.getRecord(track.getRecordCount() - 1);
+    std::cout << "  " << onsets << " onsets, peak hop RMS " << peak << ", final tempo " << last.beat.bpm << " bpm\n";
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " <input.wav> <output>   Analyze a track into a feature file\n";
+    std::cout << "       " << program << " --info <file>           Describe an existing feature file\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && std::strcmp(argv[1], "--info") == 0) {
+        BandFile track;
+        if (!track.open(argv[2])) {
+            return 1;
+        }
+        printInfo(argv[2], track);
+        return 0;
+    }
+    if (argc != 3 || argv[1][0] == '-') {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<float> samples;
+    int sample_rate = 0, channels = 0;
+    if (!AudioAnalyzer::loadWav(argv[1], samples, sample_rate, channels)) {
+        return 1;
+    }
+
+    Uint64 frames = samples.size() / channels;
+    Uint64 start = SDL_GetTicksNS();
+    if (!BandFile::write(argv[2], samples.data(), frames, sample_rate, channels)) {
+        return 1;
+    }
+    double seconds = (SDL_GetTicksNS() - start) / 1e9;
+    std::cout << "Analyzed " << (double)frames / sample_rate << " s in " << seconds << " s ("
+              << (double)frames / sample_rate / seconds << "x realtime)\n";
+
+    BandFile track;
+    if (!track.open(argv[2])) {
+        return 1;
+    }
+    printInfo(argv[2], track);
+    return 0;
+}
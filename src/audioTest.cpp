@@ -2,197 +2,416 @@
 #include <fftw3.h>
 #include <iostream>
 #include <vector>
+#include <string>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <algorithm>
-
-int main(int argc, char* argv[]) {
-    // Initialize SDL audio subsystem
-    if (!SDL_Init(SDL_INIT_AUDIO)) {
-        std::cerr << "Failed to initialize SDL: " << SDL_GetError() << std::endl;
-        return 1;
+#include "AudioAnalyzer.h"
+
+// Offline driver for AudioAnalyzer: analyzes a WAV file or a generated signal as fast as
+// possible, benchmarks the analysis path per FFT size and planner, and checks band values
+// against known fixtures so analysis changes have a regression gate
+
+namespace {
+
+struct Signal {
+    std::vector<float> samples;  // Interleaved
+    int sample_rate;
+    int channels;
+
+    int frames() const { return (int)(samples.size() / channels); }
+};
+
+// Frames handed to the analyzer per call, about one capture read
+const int BLOCK_FRAMES = 1024;
+
+struct Planner {
+    const char* name;
+    unsigned flags;
+};
+
+const Planner PLANNERS[] = {
+    {"estimate", FFTW_ESTIMATE},
+    {"measure", FFTW_MEASURE},
+};
+
+Signal makeSine(float frequency, float amplitude, int sample_rate, float seconds) {
+    Signal signal;
+    signal.sample_rate = sample_rate;
+    signal.channels = 1;
+    signal.samples.resize((size_t)(seconds * sample_rate));
+    for (size_t i = 0; i < signal.samples.size(); i++) {
+        signal.samples[i] = amplitude * (float)std::sin(2.0 * M_PI * frequency * i / sample_rate);
     }
+    return signal;
+}
 
-    // List available recording devices
-    int count;
-    SDL_AudioDeviceID *devices = SDL_GetAudioRecordingDevices(&count);
-
-    std::cout << "Available recording devices (" << count << "):" << std::endl;
-    for (int i = 0; i < count; i++) {
-        const char* name = SDL_GetAudioDeviceName(devices[i]);
-        std::cout << "  [" << i << "] " << (name ? name : "Unknown") << std::endl;
+Signal makeNoise(float amplitude, int sample_rate, float seconds) {
+    Signal signal;
+    signal.sample_rate = sample_rate;
+    signal.channels = 1;
+    signal.samples.resize((size_t)(seconds * sample_rate));
+
+    // Fixed seed so fixtures are reproducible
+    Uint32 state = 12345;
+    for (size_t i = 0; i < signal.samples.size(); i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        signal.samples[i] = amplitude * ((float)state / 4294967295.0f * 2.0f - 1.0f);
     }
+    return signal;
+}
 
-    // Prompt user to select device
-    int selected_device = 0;
-    if (count > 1) {
-        std::cout << "\nSelect device number (0-" << (count - 1) << "): ";
-        std::cin >> selected_device;
-        if (selected_device < 0 || selected_device >= count) {
-            std::cerr << "Invalid device selection" << std::endl;
-            SDL_free(devices);
-            SDL_Quit();
-            return 1;
+// 5 ms full-scale bursts at a fixed tempo over silence
+Signal makeClicks(float bpm, int sample_rate, float seconds) {
+    Signal signal;
+    signal.sample_rate = sample_rate;
+    signal.channels = 1;
+    signal.samples.assign((size_t)(seconds * sample_rate), 0.0f);
+
+    int interval = (int)(sample_rate * 60.0f / bpm);
+    int length = sample_rate / 200;
+    for (size_t start = 0; start < signal.samples.size(); start += interval) {
+        for (int i = 0; i < length && start + i < signal.samples.size(); i++) {
+            signal.samples[start + i] = (i % 2 == 0) ? 1.0f : -1.0f;
         }
     }
+    return signal;
+}
 
-    SDL_AudioDeviceID selected = devices[selected_device];
-    SDL_free(devices);
-
-    // Set up audio specification
-    SDL_AudioSpec spec = {
-        .format = SDL_AUDIO_F32,  // 32-bit float samples
-        .channels = 1,             // Mono
-        .freq = 44100              // 44.1kHz sample rate
-    };
+Signal makeStereo(const Signal& left, const Signal& right) {
+    Signal signal;
+    signal.sample_rate = left.sample_rate;
+    signal.channels = 2;
+    size_t frames = std::min(left.samples.size(), right.samples.size());
+    signal.samples.resize(frames * 2);
+    for (size_t i = 0; i < frames; i++) {
+        signal.samples[i * 2] = left.samples[i];
+        signal.samples[i * 2 + 1] = right.samples[i];
+    }
+    return signal;
+}
 
-    // Open selected recording device
-    SDL_AudioDeviceID mic = SDL_OpenAudioDevice(selected, &spec);
+bool loadWav(const char* path, Signal& signal) {
+    return AudioAnalyzer::loadWav(path, signal.samples, signal.sample_rate, signal.channels);
+}
 
-    if (!mic) {
-        std::cerr << "Failed to open recording device: " << SDL_GetError() << std::endl;
-        SDL_Quit();
-        return 1;
+// Parses sine:<hz>, noise, silence, clicks:<bpm>, or otherwise loads a WAV file
+bool loadInput(const std::string& input, int sample_rate, float seconds, Signal& signal) {
+    if (input.compare(0, 5, "sine:") == 0) {
+        signal = makeSine((float)std::atof(input.c_str() + 5), 0.5f, sample_rate, seconds);
+    } else if (input == "noise") {
+        signal = makeNoise(0.3f, sample_rate, seconds);
+    } else if (input == "silence") {
+        signal = makeSine(0.0f, 0.0f, sample_rate, seconds);
+    } else if (input.compare(0, 7, "clicks:") == 0) {
+        signal = makeClicks((float)std::atof(input.c_str() + 7), sample_rate, seconds);
+    } else {
+        return loadWav(input.c_str(), signal);
     }
+    return true;
+}
 
-    // Create audio stream for capturing
-    SDL_AudioStream* stream = SDL_CreateAudioStream(&spec, &spec);
-    if (!stream) {
-        std::cerr << "Failed to create audio stream: " << SDL_GetError() << std::endl;
-        SDL_CloseAudioDevice(mic);
-        SDL_Quit();
-        return 1;
+bool setupAnalyzer(AudioAnalyzer& analyzer, const Signal& signal, int fft_size, unsigned flags) {
+    if (!analyzer.setFftSize(fft_size)) return false;
+    analyzer.setPlannerFlags(flags);
+    return analyzer.initializeOffline(signal.sample_rate, signal.channels);
+}
+
+void feed(AudioAnalyzer& analyzer, const Signal& signal) {
+    int frames = signal.frames();
+    for (int offset = 0; offset < frames; offset += BLOCK_FRAMES) {
+        int count = std::min(BLOCK_FRAMES, frames - offset);
+        analyzer.pushSamples(signal.samples.data() + (size_t)offset * signal.channels, count);
     }
+}
 
-    // Bind stream to device
-    SDL_BindAudioStream(mic, stream);
+int peakSpectrumBin(const AudioAnalyzer& analyzer) {
+    const AudioAnalyzer::SpectrumColumn* column = analyzer.getColumn(analyzer.getColumnCount() - 1);
+    if (!column) return -1;
+    return (int)(std::max_element(column->spectrum, column->spectrum + AudioAnalyzer::SPECTRUM_BINS) - column->spectrum);
+}
 
-    std::cout << "\nRecording started (5 seconds)..." << std::endl;
+float binFrequency(int bin) {
+    return 20.0f * (float)std::pow(1000.0, (bin + 0.5) / AudioAnalyzer::SPECTRUM_BINS);
+}
 
-    // Start recording
-    SDL_ResumeAudioDevice(mic);
+int analyze(const Signal& signal, int fft_size) {
+    AudioAnalyzer analyzer;
+    if (!setupAnalyzer(analyzer, signal, fft_size, FFTW_ESTIMATE)) {
+        return 1;
+    }
 
-    // Record for 5 seconds and process audio
-    std::vector<float> audioBuffer;
-    const int duration_ms = 5000;
-    const int chunk_ms = 100;
-    const int samples_per_chunk = (spec.freq * chunk_ms) / 1000;
-    std::vector<float> chunk_buffer(samples_per_chunk);
+    std::cout << "Analyzing " << signal.frames() << " frames, " << signal.channels << " ch at "
+              << signal.sample_rate << " Hz, FFT " << fft_size << "\n";
+
+    // Band summary every half second of audio
+    int frames = signal.frames();
+    int report_interval = signal.sample_rate / 2;
+    int next_report = report_interval;
+    int onsets = 0;
+    for (int offset = 0; offset < frames; offset += BLOCK_FRAMES) {
+        int count = std::min(BLOCK_FRAMES, frames - offset);
+        analyzer.pushSamples(signal.samples.data() + (size_t)offset * signal.channels, count);
+        if (analyzer.getBeatInfo().onset) {
+            onsets++;
+        }
 
-    for (int i = 0; i < duration_ms / chunk_ms; i++) {
-        SDL_Delay(chunk_ms);
+        if (offset + count >= next_report) {
+            AudioAnalyzer::FrequencyBands bands = analyzer.getFrequencyBands();
+            printf("%6.2f s  Bass: %6.3f  Mid: %6.3f  High: %6.3f  Level: %.4f\n",
+                   (double)(offset + count) / signal.sample_rate, bands.bass, bands.mid, bands.high, analyzer.getLevel());
+            next_report += report_interval;
+        }
+    }
 
-        // Get available audio from stream
-        int available = SDL_GetAudioStreamAvailable(stream);
-        if (available > 0) {
-            int to_read = std::min(available, (int)(chunk_buffer.size() * sizeof(float)));
-            int bytes_read = SDL_GetAudioStreamData(stream, chunk_buffer.data(), to_read);
+    const AudioAnalyzer::SpectrumColumn* column = analyzer.getColumn(analyzer.getColumnCount() - 1);
+    if (column) {
+        // Display the newest spectrum, four log bins per row
+        std::cout << "\n=== Spectrum (newest snapshot) ===\n\n";
+        const int bar_width = 50;
+        for (int bin = 0; bin < AudioAnalyzer::SPECTRUM_BINS; bin += 4) {
+            float level = *std::max_element(column->spectrum + bin, column->spectrum + bin + 4);
+            int bars = (int)(level * bar_width);
+            printf("%6.0f-%6.0f Hz [", binFrequency(bin) , binFrequency(bin + 3));
+            for (int j = 0; j < bar_width; j++) {
+                std::cout << (j < bars ? '=' : ' ');
+            }
+            printf("] %.2f\n", level);
+        }
+        std::cout << "\nDominant frequency: ~" << binFrequency(peakSpectrumBin(analyzer)) << " Hz\n";
+    }
 
-            if (bytes_read > 0) {
-                int sample_count = bytes_read / sizeof(float);
+    std::cout << "Onsets: " << onsets << ", tempo: " << analyzer.getBpm() << " BPM\n";
+    return 0;
+}
 
-                // Calculate RMS (volume level)
-                float rms = 0.0f;
-                for (int j = 0; j < sample_count; j++) {
-                    rms += chunk_buffer[j] * chunk_buffer[j];
-                }
-                rms = std::sqrt(rms / sample_count);
+int benchmark(const Signal& signal, const std::vector<int>& fft_sizes) {
+    double audio_seconds = (double)signal.frames() / signal.sample_rate;
+    std::cout << "Benchmarking " << audio_seconds << " s of audio, " << signal.channels << " ch at "
+              << signal.sample_rate << " Hz (planning excluded)\n";
+    printf("%8s  %-9s %8s %12s %12s %10s\n", "FFT", "planner", "hops", "hops/s", "ns/hop", "x realtime");
+
+    for (size_t s = 0; s < fft_sizes.size(); s++) {
+        for (size_t p = 0; p < sizeof(PLANNERS) / sizeof(PLANNERS[0]); p++) {
+            AudioAnalyzer analyzer;
+            if (!setupAnalyzer(analyzer, signal, fft_sizes[s], PLANNERS[p].flags)) {
+                return 1;
+            }
 
-                // Print volume meter
-                int bars = (int)(rms * 50);
-                std::cout << "\rVolume: [";
-                for (int k = 0; k < 50; k++) {
-                    std::cout << (k < bars ? '=' : ' ');
-                }
-                std::cout << "] " << rms << "    " << std::flush;
+            Uint64 start = SDL_GetPerformanceCounter();
+            feed(analyzer, signal);
+            Uint64 end = SDL_GetPerformanceCounter();
 
-                audioBuffer.insert(audioBuffer.end(), chunk_buffer.begin(), chunk_buffer.begin() + sample_count);
-            }
+            double seconds = (double)(end - start) / SDL_GetPerformanceFrequency();
+            double hops = (double)analyzer.getColumnCount();
+            printf("%8d  %-9s %8.0f %12.0f %12.0f %10.1f\n", fft_sizes[s], PLANNERS[p].name, hops,
+                   seconds > 0.0 ? hops / seconds : 0.0,
+                   hops > 0.0 ? seconds * 1e9 / hops : 0.0,
+                   seconds > 0.0 ? audio_seconds / seconds : 0.0);
         }
     }
+    return 0;
+}
 
-    std::cout << "\n\nRecording stopped." << std::endl;
-    std::cout << "Captured " << audioBuffer.size() << " samples" << std::endl;
+int failures = 0;
 
-    // Perform FFT analysis
-    if (audioBuffer.size() > 0) {
-        int fft_size = 4096;
-        int num_bins = fft_size / 2 + 1;
+void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "  PASS  " : "  FAIL  ") << what << "\n";
+    if (!ok) failures++;
+}
 
-        // Allocate FFT buffers
-        double *fft_in = fftw_alloc_real(fft_size);
-        fftw_complex *fft_out = fftw_alloc_complex(num_bins);
+std::string describe(const char* format, double a, double b) {
+    char text[160];
+    snprintf(text, sizeof(text), format, a, b);
+    return text;
+}
 
-        // Create FFT plan
-        fftw_plan plan = fftw_plan_dft_r2c_1d(fft_size, fft_in, fft_out, FFTW_ESTIMATE);
+AudioAnalyzer::FrequencyBands rawBands(const Signal& signal) {
+    AudioAnalyzer analyzer;
+    setupAnalyzer(analyzer, signal, 4096, FFTW_ESTIMATE);
+    feed(analyzer, signal);
+    return analyzer.getRawBands();
+}
 
-        // Copy audio samples to FFT input
-        int samples_to_process = std::min((int)audioBuffer.size(), fft_size);
-        for (int i = 0; i < samples_to_process; i++) {
-            fft_in[i] = audioBuffer[i];
-        }
-        // Zero-pad if needed
-        for (int i = samples_to_process; i < fft_size; i++) {
-            fft_in[i] = 0.0;
-        }
+// Sine fixtures are compared against white noise of the same amplitude, which whitens
+// the bands' different widths: a sine must stand out most in its own band
+void checkSine(float frequency, int band, const AudioAnalyzer::FrequencyBands& noise, int sample_rate) {
+    Signal sine = makeSine(frequency, 0.3f, sample_rate, 3.0f);
+
+    AudioAnalyzer analyzer;
+    setupAnalyzer(analyzer, sine, 4096, FFTW_ESTIMATE);
+    feed(analyzer, sine);
+
+    AudioAnalyzer::FrequencyBands raw = analyzer.getRawBands();
+    float relative[3] = {raw.bass / noise.bass, raw.mid / noise.mid, raw.high / noise.high};
+    int dominant = (int)(std::max_element(relative, relative + 3) - relative);
+    float others = 0.0f;
+    for (int b = 0; b < 3; b++) {
+        if (b != band) others = std::max(others, relative[b]);
+    }
+    const char* names[3] = {"bass", "mid", "high"};
+    check(dominant == band && relative[band] > 1.5f * others,
+          describe("sine %.0f Hz dominates its band (%.1fx the next)", frequency, relative[band] / std::max(others, 1e-9f))
+          + " [" + names[band] + "]");
+
+    // Within a log bin, or an FFT bin where those are wider (low frequencies)
+    int peak = peakSpectrumBin(analyzer);
+    float fft_bin_width = (float)sample_rate / analyzer.getFftSize();
+    float log_bin_width = frequency * (float)(std::pow(1000.0, 1.0 / AudioAnalyzer::SPECTRUM_BINS) - 1.0);
+    check(std::fabs(binFrequency(peak) - frequency) <= 1.5f * std::max(fft_bin_width, log_bin_width),
+          describe("sine %.0f Hz spectrum peak at ~%.0f Hz", frequency, binFrequency(peak)));
+
+    // Steady input settles at the band's auto-gain target
+    AudioAnalyzer::FrequencyBands bands = analyzer.getFrequencyBands();
+    float values[3] = {bands.bass, bands.mid, bands.high};
+    const AudioAnalyzer::AutoGainSettings& gain = analyzer.getAutoGain();
+    float targets[3] = {gain.bass_target, gain.mid_target, gain.high_target};
+    check(std::fabs(values[band] - targets[band]) < 0.05f * targets[band],
+          describe("sine %.0f Hz normalizes to its target (%.3f)", frequency, values[band]));
+}
 
-        // Execute FFT
-        fftw_execute(plan);
+int validate() {
+    const int sample_rate = 48000;
+    std::cout << "Validating band analysis at " << sample_rate << " Hz, FFT 4096\n";
+
+    AudioAnalyzer::FrequencyBands noise = rawBands(makeNoise(0.3f, sample_rate, 3.0f));
+    float noise_max = std::max(noise.bass, std::max(noise.mid, noise.high));
+    float noise_min = std::min(noise.bass, std::min(noise.mid, noise.high));
+    check(noise_min > 0.0f && noise_max < 2.0f * noise_min,
+          describe("white noise bands are flat within 2x (%.2f / %.2f)", noise_max, noise_min));
+
+    checkSine(100.0f, 0, noise, sample_rate);
+    checkSine(1000.0f, 1, noise, sample_rate);
+    checkSine(8000.0f, 2, noise, sample_rate);
+
+    // Silence must stay at zero rather than be amplified
+    {
+        Signal silence = makeSine(0.0f, 0.0f, sample_rate, 2.0f);
+        AudioAnalyzer analyzer;
+        setupAnalyzer(analyzer, silence, 4096, FFTW_ESTIMATE);
+        feed(analyzer, silence);
+        AudioAnalyzer::FrequencyBands bands = analyzer.getFrequencyBands();
+        check(bands.bass == 0.0f && bands.mid == 0.0f && bands.high == 0.0f, "silence normalizes to zero");
+    }
 
-        // Calculate magnitudes
-        std::vector<double> magnitudes(num_bins);
-        double max_magnitude = 0.0;
+    // Stereo channels are analyzed separately
+    {
+        Signal stereo = makeStereo(makeSine(100.0f, 0.3f, sample_rate, 3.0f), makeSine(8000.0f, 0.3f, sample_rate, 3.0f));
+        AudioAnalyzer analyzer;
+        setupAnalyzer(analyzer, stereo, 4096, FFTW_ESTIMATE);
+        feed(analyzer, stereo);
+        AudioAnalyzer::FrequencyBands left = analyzer.getChannelBands(0);
+        AudioAnalyzer::FrequencyBands right = analyzer.getChannelBands(1);
+        check(left.bass > 4.0f * right.bass && right.high > 4.0f * left.high,
+              describe("stereo channels keep their own bands (bass L/R %.1fx, high R/L %.1fx)",
+                       left.bass / std::max(right.bass, 1e-9f), right.high / std::max(left.high, 1e-9f)));
+    }
 
-        for (int i = 0; i < num_bins; i++) {
-            double real = fft_out[i][0];
-            double imag = fft_out[i][1];
-            magnitudes[i] = std::sqrt(real * real + imag * imag);
-            max_magnitude = std::max(max_magnitude, magnitudes[i]);
+    // Onsets and tempo from a click track
+    {
+        Signal clicks = makeClicks(120.0f, sample_rate, 12.0f);
+        AudioAnalyzer analyzer;
+        setupAnalyzer(analyzer, clicks, 4096, FFTW_ESTIMATE);
+        int onsets = 0;
+        int frames = clicks.frames();
+        for (int offset = 0; offset < frames; offset += BLOCK_FRAMES) {
+            analyzer.pushSamples(clicks.samples.data() + offset, std::min(BLOCK_FRAMES, frames - offset));
+            if (analyzer.getBeatInfo().onset) onsets++;
         }
+        check(onsets >= 20 && onsets <= 25, describe("120 BPM clicks: %.0f onsets in %.0f s", onsets, 12.0));
+        check(std::fabs(analyzer.getBpm() - 120.0f) < 2.0f, describe("120 BPM clicks: tempo %.1f BPM (expected %.0f)", analyzer.getBpm(), 120.0));
+    }
 
-        // Display frequency histogram
-        std::cout << "\n=== Frequency Histogram ===\n" << std::endl;
+    std::cout << (failures == 0 ? "All checks passed\n" : "Some checks failed\n");
+    return failures == 0 ? 0 : 1;
+}
 
-        const int num_display_bins = 40;
-        const int bar_width = 50;
-        const double freq_per_bin = (double)spec.freq / fft_size;
+bool checkFftSize(int size) {
+    if (AudioAnalyzer::isValidFftSize(size)) return true;
+    std::cerr << "FFT size " << size << " must be a power of two from " << AudioAnalyzer::MIN_FFT_SIZE
+              << " to " << AudioAnalyzer::MAX_FFT_SIZE << "\n";
+    return false;
+}
 
-        for (int i = 0; i < num_display_bins && i < num_bins; i++) {
-            double freq_start = i * freq_per_bin;
-            double freq_end = (i + 1) * freq_per_bin;
+// False if any size isn't one AudioAnalyzer accepts
+bool parseSizes(const char* list, std::vector<int>& sizes) {
+    sizes.clear();
+    for (const char* p = list; *p;) {
+        int size = std::atoi(p);
+        if (!checkFftSize(size)) return false;
+        sizes.push_back(size);
+        const char* comma = std::strchr(p, ',');
+        if (!comma) break;
+        p = comma + 1;
+    }
+    return !sizes.empty();
+}
 
-            // Normalize magnitude
-            double normalized = (max_magnitude > 0) ? (magnitudes[i] / max_magnitude) : 0.0;
-            int bars = (int)(normalized * bar_width);
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n";
+    std::cout << "  --input <file.wav|sine:HZ|noise|silence|clicks:BPM>  Signal to analyze (default sine:440)\n";
+    std::cout << "  --seconds <n>        Length of generated signals (default 10)\n";
+    std::cout << "  --rate <hz>          Sample rate of generated signals (default 48000)\n";
+    std::cout << "  --fft <n>            FFT size for analysis (default 4096)\n";
+    std::cout << "  --bench              Time the analysis per FFT size and FFTW planner\n";
+    std::cout << "  --fft-sizes <a,b,..> FFT sizes to benchmark (default 1024,2048,4096,8192)\n";
+    std::cout << "  --validate           Check bands against sine/noise/click fixtures; exits 1 on failure\n";
+}
 
-            // Print frequency range and bar
-            printf("%6.0f-%6.0f Hz [", freq_start, freq_end);
-            for (int j = 0; j < bar_width; j++) {
-                std::cout << (j < bars ? '=' : ' ');
-            }
-            printf("] %.2f\n", magnitudes[i]);
-        }
+}
 
-        // Find dominant frequency
-        int max_bin = 0;
-        for (int i = 1; i < num_bins; i++) {
-            if (magnitudes[i] > magnitudes[max_bin]) {
-                max_bin = i;
+int main(int argc, char* argv[]) {
+    std::string input = "sine:440";
+    float seconds = 10.0f;
+    int sample_rate = 48000;
+    int fft_size = 4096;
+    bool bench = false;
+    bool run_validation = false;
+    std::vector<int> fft_sizes;
+    parseSizes("1024,2048,4096,8192", fft_sizes);
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--input") == 0 && has_value) {
+            input = argv[++i];
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {
+            seconds = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rate") == 0 && has_value) {
+            sample_rate = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--fft") == 0 && has_value) {
+            fft_size = std::atoi(argv[++i]);
+            if (!checkFftSize(fft_size)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--bench") == 0) {
+            bench = true;
+        } else if (std::strcmp(argv[i], "--fft-sizes") == 0 && has_value) {
+            if (!parseSizes(argv[++i], fft_sizes)) {
+                return 1;
             }
+        } else if (std::strcmp(argv[i], "--validate") == 0) {
+            run_validation = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
         }
-        double dominant_freq = max_bin * freq_per_bin;
+    }
 
-        std::cout << "\nDominant frequency: " << dominant_freq << " Hz" << std::endl;
+    if (run_validation) {
+        return validate();
+    }
 
-        // Clean up FFT
-        fftw_destroy_plan(plan);
-        fftw_free(fft_in);
-        fftw_free(fft_out);
+    Signal signal;
+    if (!loadInput(input, sample_rate, seconds, signal) || signal.samples.empty()) {
+        std::cerr << "No audio to analyze\n";
+        return 1;
     }
 
-    // Clean up
-    SDL_DestroyAudioStream(stream);
-    SDL_CloseAudioDevice(mic);
+    int result = bench ? benchmark(signal, fft_sizes) : analyze(signal, fft_size);
     SDL_Quit();
-
-    return 0;
+    return result;
 }
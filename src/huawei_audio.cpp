@@ -1,25 +1,212 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_gpu.h>
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <cmath>
 #include <array>
+#include <algorithm>
 #include <yaml-cpp/yaml.h>
 #include <ctime>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <mutex>
+#include <csignal>
 #include "AudioAnalyzer.h"
+#include "FrameScheduler.h"
+#include "Terrain.h"
+#include "LatencyTracker.h"
+#include "ConfigWatcher.h"
+#include "Gradient.h"
+#include "SRGB.h"
+#include "Shader.h"
+#include "PostProcess.h"
+#include "PassProfiler.h"
+#include "EncoderSink.h"
+#include "FrameEncoder.h"
+#include "BandFile.h"
+#include "CameraPath.h"
+#include "CameraDirector.h"
+#include "SceneGraph.h"
+
+// IEEE half, rounded to nearest even, for 16-bit float textures: every GPU filters those,
+// while linear filtering of 32-bit float formats is optional (and missing on some mobile parts)
+static Uint16 floatToHalf(float value) {
+    Uint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    Uint16 sign = (Uint16)((bits >> 16) & 0x8000);
+    Uint32 magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {
+        return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);  // Inf, or quiet NaN
+    }
+    if (magnitude >= 0x477ff000) {
+        return sign | 0x7c00;  // Rounds past the largest half
+    }
+    if (magnitude < 0x38800000) {
+        // Subnormal half, or zero: shift the full mantissa down, rounding on the bits lost
+        if (magnitude < 0x33000000) return sign;
+        Uint32 mantissa = (magnitude & 0x7fffff) | 0x800000;
+        int shift = 126 - (int)(magnitude >> 23);
+        Uint32 half = mantissa >> shift;
+        Uint32 rest = mantissa & ((1u << shift) - 1);
+        Uint32 halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return sign | (Uint16)half;
+    }
+
+    // Rebias the exponent; a mantissa carry from rounding correctly bumps it
+    Uint32 half = (magnitude - 0x38000000) >> 13;
+    Uint32 rest = magnitude & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return sign | (Uint16)half;
+}
+
+// Set by SIGINT and SIGTERM in headless runs, which poll no events: the run loop then ends
+// normally, so the encoder drains and finishes the file instead of dying mid-stream
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void requestStop(int) {
+    stop_requested = 1;
+}
 
 class HuaweiAudioDemo {
 private:
-    SDL_Window* window = nullptr;
     SDL_GPUDevice* gpu_device = nullptr;
     SDL_GPUGraphicsPipeline* pipeline = nullptr;
     SDL_GPUBuffer* vertex_buffer = nullptr;
-    SDL_GPUBuffer* camera_buffer = nullptr;
-    SDL_GPUBuffer* audio_buffer = nullptr;
     SDL_GPUBuffer* color_buffer = nullptr;
     bool running = true;
 
+    // Uniforms, std140 (set = 3): camera at binding 0, audio at binding 1. Scalars only, so
+    // each float sits at 4 * its index and neither block needs padding past a 16 byte multiple
+    struct CameraParams {
+        float pos_x, pos_y, pos_z;
+        float yaw;
+        float pitch;
+        float time;
+        float prev_pos_x, prev_pos_y, prev_pos_z;
+        float prev_yaw;
+        float history_valid;  // 1 when depth_history holds last frame at this size
+        float height_slack;   // Max terrain rise since last frame
+        float resolution_x, resolution_y;
+        float pixel_angle;    // Cone angle covered by one pixel
+        float encode_srgb;    // 1 when the target is UNORM and the shader must encode sRGB itself
+    };
+
+    struct AudioParams {
+        float bass;
+        float mid;
+        float high;
+        float smoothed_bass;
+        float max_height;     // Terrain bounding slab for the sky early-out
+        float onset;          // Onset envelope, ~1 right after an onset
+        float beat_phase;     // 0 on the beat, rising to 1
+        float spectrum_head;  // Column of spectrum_texture shown as now, fractional, modulo SPECTRUM_COLUMNS
+        float bass_left, mid_left, high_left;     // Channel 0 (or mono)
+        float bass_right, mid_right, high_right;  // Channel 1 (or mono)
+        float spectrum_columns;  // Columns of spectrum_texture written so far
+        float max_slope;      // Steepest terrain this frame or last, bounding how a rise moves hits
+	};
+
+    static_assert(sizeof(CameraParams) == 16 * sizeof(float), "CameraParams must match the shader's std140 block");
+    static_assert(offsetof(CameraParams, history_valid) == 10 * sizeof(float) &&
+                  offsetof(CameraParams, encode_srgb) == 15 * sizeof(float), "CameraParams must be tightly packed");
+    static_assert(sizeof(AudioParams) == 16 * sizeof(float), "AudioParams must match the shader's std140 block");
+    static_assert(offsetof(AudioParams, bass_left) == 8 * sizeof(float) &&
+                  offsetof(AudioParams, spectrum_columns) == 14 * sizeof(float), "AudioParams must be tightly packed");
+    static_assert(sizeof(CameraParams) % 16 == 0 && sizeof(AudioParams) % 16 == 0,
+                  "std140 uniform blocks are a multiple of 16 bytes");
+
+    // One output: a window or offscreen target looking out from the shared camera at its own
+    // yaw offset. Audio analysis, the audio/color parameters and the frame's command buffer are
+    // shared, so each extra view costs its shading plus one small camera uniform push
+    struct View {
+        SDL_Window* window = nullptr;
+        SDL_GPUTexture* offscreen_target = nullptr;
+        PostProcess post_process;
+        CameraParams camera_params = {};  // This frame's, pushed when its scene is drawn
+        float yaw_offset = 0.0f;
+
+        // Ping-ponged hit distance buffers: one written this frame, the other read as history
+        SDL_GPUTexture* depth_history[2] = {nullptr, nullptr};
+        int depth_write_index = 0;
+        Uint32 depth_width = 0;
+        Uint32 depth_height = 0;
+        bool depth_history_valid = false;
+
+        // This frame's target; with post-processing a window's is acquired just before the tonemap
+        SDL_GPUTexture* target = nullptr;
+        Uint32 width = 0;
+        Uint32 height = 0;
+        bool active = false;
+        bool rendered = false;  // The scene reached target this frame
+
+        // Camera as uploaded for this view last frame, for reprojection
+        float prev_x = 0.0f;
+        float prev_y = 0.0f;
+        float prev_z = 0.0f;
+        float prev_yaw = 0.0f;
+        float prev_time = 0.0f;
+    };
+    std::vector<View> views;
+    int view_count = 1;
+    float view_spacing = -1.0f;  // Yaw between neighbouring views in radians; < 0 = one view's horizontal FOV
+    SDL_GPUSampler* depth_sampler = nullptr;
+
+    // Audio history ring: one column per analyzer snapshot (R spectrum, G waveform), uploaded
+    // as it arrives so history is never re-sent. Wraps horizontally
+    static const Uint32 SPECTRUM_COLUMNS = 256;
+    static const Uint32 MAX_COLUMN_UPLOADS = 16;  // Per frame; a longer stall skips the oldest
+    Uint32 max_column_uploads = MAX_COLUMN_UPLOADS;  // All SPECTRUM_COLUMNS with a band file, which can seek
+    SDL_GPUTexture* spectrum_texture = nullptr;
+    SDL_GPUSampler* spectrum_sampler = nullptr;
+    SDL_GPUTransferBuffer* spectrum_transfer = nullptr;
+    Uint64 uploaded_columns = 0;
+
+    // Distance colour gradient, baked from the config whenever it changes
+    static const Uint32 GRADIENT_TEXELS = 256;
+    SDL_GPUTexture* gradient_texture = nullptr;
+    SDL_GPUSampler* gradient_sampler = nullptr;
+    SDL_GPUTransferBuffer* gradient_transfer = nullptr;
+    Gradient::Settings gradient;
+    bool gradient_dirty = false;
+
+    // Offscreen target size when headless, initial window size otherwise
+    Uint32 render_width = 1024;
+    Uint32 render_height = 1024;
+
+    // Headless: render to offscreen targets instead of windows. The loopback test and the
+    // recorder read back the first view
+    bool headless = false;
+    SDL_GPUTextureFormat color_format = SDL_GPU_TEXTUREFORMAT_B8G8R8A8_UNORM;
+    SDL_GPUTransferBuffer* readback_buffer = nullptr;  // Top half of each frame, for the loopback test
+
+    // Recording: every headless frame is downloaded whole and handed to the encoder thread.
+    // The camera advances 1 / record_fps per frame so the video plays at real speed
+    std::string record_spec;
+    float record_fps = 60.0f;
+    int record_frame_limit = 0;  // 0 = until stopped
+    int recorded_frames = 0;
+    FrameEncoder frame_encoder;
+    SDL_GPUTransferBuffer* record_buffer = nullptr;
+
+    // With an sRGB target the hardware encodes on store; otherwise the shader does it
+    bool prefer_srgb = true;
+    bool srgb_target = false;
+
+    // HDR scene target, bloom and tonemapping; off renders straight into the output
+    bool post_enabled = true;
+    PassProfiler pass_profiler;
+
+    // Audio as uploaded last frame, for reprojection
+    std::array<float, 3> prev_left = {0.0f, 0.0f, 0.0f};
+    std::array<float, 3> prev_right = {0.0f, 0.0f, 0.0f};
+    std::array<float, 3> current_left = {0.0f, 0.0f, 0.0f};
+    std::array<float, 3> current_right = {0.0f, 0.0f, 0.0f};
+
     Uint64 last_time = 0;
     int frame_count = 0;
     float elapsed_time = 0.0f;
@@ -43,150 +230,478 @@ private:
     bool key_space = false;
     bool key_shift = false;
 
-    // Auto movement
-    float auto_direction_x = 1.0f;
-    float auto_direction_y = 1.0f;
-    float auto_direction_z = 1.0f;
-    float auto_yaw_direction = 1.0f;
-    float auto_movement_timer = 0.0f;
-    float auto_direction_change_interval = 2.0f;
+    // Set by any keyboard/mouse input this frame, used for idle detection
+    bool user_input = false;
+
+    // Auto movement follows camera_path, a function of elapsed_time; keyboard and mouse
+    // steer by offsetting from it, except while replaying a recorded track
+    CameraPath camera_path;
+    Uint32 camera_seed = 1;
+    std::string camera_replay_path;
+    std::string camera_record_path;
+    CameraTrackWriter camera_recorder;
+    // --audio-camera: the path is flown by camera_director, off the render thread
+    bool audio_camera = false;
+    CameraDirector camera_director;
+    CameraPath::Pose director_pose = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};  // Held until the director catches up
+    // Ground following: path heights are altitudes over ground_level, which jumps up to the
+    // highest the terrain can reach around and ahead of the camera and eases back down
+    float camera_altitude_min = 2.0f;
+    float camera_altitude_max = 8.0f;
+    float ground_radius = 1.5f;          // Ring of terrain samples around the camera
+    float ground_lookahead = 1.0f;       // seconds of path sampled ahead
+    float ground_fall_time = 1.0f;       // seconds; easing down after the terrain drops away
+    float ground_level = 0.0f;
+    bool ground_valid = false;
+    float manual_x = 0.0f;
+    float manual_y = 0.0f;
+    float manual_z = 0.0f;
+    float manual_yaw = 0.0f;
+    float manual_pitch = 0.0f;
 
     // Audio analyzer
     float smoothed_bass = 0.0f;
-    float bass_smoothing_factor = 0.25f;
+    float bass_smoothing_time = 0.06f;  // seconds; matches the old 0.25-per-frame factor at 60 fps
+
+    // Band snapshots are sampled at (present time - audio_delay_ns), which tracks the
+    // newest snapshot's age so playback advances steadily at any frame rate
+    double audio_delay_ns = 0.0;
+    float audio_delay_smoothing_time = 1.0f;  // seconds
+    Uint64 last_audio_sample_ns = 0;
+    float audio_frame_time = 0.0f;           // seconds since the previous frame's sample
     AudioAnalyzer audio_analyzer;
+    std::vector<int> audio_devices;  // Recording device indices; empty = device 0
+
+    // Offline audio: a precomputed band file sampled at each frame's audio time (elapsed_time
+    // plus band_offset) instead of running the analyzer. With the camera on the fixed record
+    // timestep, any frame of a track renders the same in any process
+    std::string band_file_path;
+    BandFile band_file;
+    float last_band_time = 0.0f;
+    double band_offset = 0.0;  // seconds; --start and seeking move the track against the camera
+    float seek_step = 10.0f;   // seconds per arrow key press
+    Uint64 camera_steps = 0;  // Timesteps the camera has taken
+    bool worker = false;      // Render farm worker, see runWorker()
+    float silence_level = 0.001f;  // RMS below this counts as silence (~-60 dBFS)
+
+    // Frame pacing
+    FrameScheduler frame_scheduler;
+    FrameScheduler::PresentMode requested_present_mode = FrameScheduler::PresentMode::VSync;
+
+    // Audio-to-photon latency. SDL has no present timestamps, so a frame counts as
+    // presented once the GPU finishes it; a vsync'd swapchain adds up to a refresh on top
+    bool latency_report = false;
+    LatencyTracker latency_tracker;
+    LatencyTracker::FrameTimestamps frame_timestamps = {};
+
+    // Loopback test: inject clicks and time how long until the sky brightens in the readback
+    int latency_test_clicks = 0;
+    int clicks_sent = 0;
+    int clicks_missed = 0;
+    bool click_in_flight = false;
+    Uint64 click_sent_ns = 0;
+    Uint64 last_click_time = 0;     // AudioAnalyzer::getClickTime() of the previous click
+    float click_interval = 1.0f;    // seconds between clicks
+    float click_timeout = 1.0f;     // seconds before a click counts as missed
+    float click_warmup = 2.0f;      // seconds of normal frames before the first click
+    float luminance_mean = -1.0f;
+    float luminance_deviation = 0.0f;
+    std::vector<double> click_latencies;  // ms
 
     struct Vertex {
         float x, y;
         float u, v;
     };
 
-    struct CameraParams {
-        float pos_x, pos_y, pos_z;
-        float yaw;
-        float pitch;
-        float time;
-        float padding[2];  // Align to 32 bytes
+    // Storage buffer (set = 2, binding 3): rarely changes, so it's only uploaded when it does
+    struct ColorParams {
+        float max_color_distance;  // Distance at the far end of the gradient texture
+        float max_steps;       // Ray march iteration cap
+        float march_distance;  // Far end of the march
+        float fog;             // Fog strength at march_distance, 0 = none
+        float hit_pixels;      // Surface hit tolerance, in pixel footprints
+        float lod_pixels;      // Smallest fbm wavelength kept, in pixel footprints
+        float quality_tier;    // QualityTier the march settings started from
+        float padding;
     };
 
-    struct AudioParams {
-        float bass;
-        float mid;
-        float high;
-        float smoothed_bass;  
-	};
+    enum QualityTier { QUALITY_LOW, QUALITY_MEDIUM, QUALITY_HIGH, QUALITY_ULTRA, QUALITY_TIER_COUNT };
 
-    struct ColorParams {
-        float max_color_distance;
-        float saturation;
-        float brightness;
-        float num_stops;
-        float stops[16];  // 8 vec2 pairs (position, hue)
+    // Everything read from color_config.yaml
+    struct RenderConfig {
+        ColorParams color;
+        Gradient::Settings gradient;
+        PostProcess::Settings post;
+        AudioAnalyzer::AutoGainSettings gain;
     };
 
-    std::vector<uint8_t> loadShader(const char* filename) {
-        std::ifstream file(filename, std::ios::binary | std::ios::ate);
-        if (!file.is_open()) {
-            std::cerr << "Failed to open shader file: " << filename << "\n";
-            return {};
+    // Color config: found at startup, re-parsed on the watcher thread whenever it changes,
+    // and picked up by the render thread at the start of a frame without ever blocking it
+    std::string config_path;
+    RenderConfig default_config;  // What a key missing from the file falls back to
+    ConfigWatcher config_watcher;
+    std::mutex config_mutex;
+    RenderConfig pending_config;
+    bool config_pending = false;   // Guarded by config_mutex
+    AudioParams audio_params = {};  // This frame's, pushed with every view's scene
+    ColorParams color_params = {};
+    ColorParams uploaded_color = {};  // As the GPU last saw it, to upload only what changed
+    bool color_uploaded = false;
+
+    // SDF objects from --scene, compiled at startup or on the watcher thread when the file
+    // changes, and uploaded whole. Without a file the buffer holds an empty scene's header
+    std::string scene_path;
+    SceneGraph scene;
+    ConfigWatcher scene_watcher;
+    SceneGraph pending_scene;
+    bool scene_pending = false;   // Guarded by config_mutex
+    bool scene_dirty = true;
+    SDL_GPUBuffer* scene_buffer = nullptr;
+    Uint32 scene_buffer_size = 0;
+
+    // Small buffer updates, staged on the CPU and flushed into one copy pass
+    // through a single persistent transfer buffer
+    struct BufferUpload {
+        SDL_GPUBuffer* buffer;
+        Uint32 offset;
+        Uint32 size;
+        Uint32 staging_offset;
+    };
+    std::vector<Uint8> upload_staging;
+    std::vector<BufferUpload> buffer_uploads;
+    SDL_GPUTransferBuffer* frame_transfer = nullptr;
+    Uint32 frame_transfer_size = 0;
+
+    static const char* getQualityTierName(int tier) {
+        switch (tier) {
+            case QUALITY_LOW: return "low";
+            case QUALITY_MEDIUM: return "medium";
+            case QUALITY_HIGH: return "high";
+            case QUALITY_ULTRA: return "ultra";
+            default: return "unknown";
         }
+    }
 
-        size_t size = file.tellg();
-        std::vector<uint8_t> buffer(size);
-        file.seekg(0);
-        file.read(reinterpret_cast<char*>(buffer.data()), size);
-        file.close();
+    static bool parseQualityTier(const std::string& name, int& tier) {
+        for (int i = 0; i < QUALITY_TIER_COUNT; i++) {
+            if (name == getQualityTierName(i)) {
+                tier = i;
+                return true;
+            }
+        }
+        return false;
+    }
 
-        return buffer;
+    // March settings for a tier; explicit keys in the config override them
+    static void applyQualityTier(ColorParams& params, int tier) {
+        //                                   low    medium  high    ultra
+        static const float steps[] =       {96.0f, 150.0f, 200.0f, 320.0f};
+        static const float distance[] =    {60.0f, 80.0f,  100.0f, 100.0f};
+        static const float hit_pixels[] =  {6.0f,  5.0f,   4.0f,   2.0f};
+        static const float lod_pixels[] =  {2.0f,  1.5f,   1.0f,   0.5f};
+
+        params.quality_tier = (float)tier;
+        params.max_steps = steps[tier];
+        params.march_distance = distance[tier];
+        params.hit_pixels = hit_pixels[tier];
+        params.lod_pixels = lod_pixels[tier];
     }
 
-    SDL_GPUShaderFormat getShaderFormat() {
-#ifdef __APPLE__
-        return SDL_GPU_SHADERFORMAT_MSL;
-#else
-        return SDL_GPU_SHADERFORMAT_SPIRV;
-#endif
+    static ColorParams defaultColorParams() {
+        ColorParams params = {};
+        params.max_color_distance = 15.0f;
+        params.fog = 0.5f;
+        applyQualityTier(params, QUALITY_HIGH);
+        return params;
     }
 
-    const char* getShaderExtension() {
-#ifdef __APPLE__
-        return ".metal";
-#else
-        return ".spv";
-#endif
+    static Gradient::Settings defaultGradient() {
+        // Red -> green -> blue
+        const Gradient::Stop stops[] = {{0.0f, 0.0f}, {0.5f, 0.333f}, {1.0f, 0.667f}};
+
+        Gradient::Settings settings;
+        settings.stops.assign(stops, stops + 3);
+        settings.saturation = 1.0f;
+        settings.brightness = 0.95f;
+        settings.space = Gradient::SPACE_HSV;
+        return settings;
     }
 
-    const char* getShaderEntrypoint() {
-#ifdef __APPLE__
-        return "main0";
-#else
-        return "main";
-#endif
+    // Reads `key` into value if present, clamping it to [min_value, max_value] with a warning
+    static void readClamped(const YAML::Node& node, const char* key, float& value, float min_value, float max_value) {
+        if (node[key]) {
+            value = node[key].as<float>();
+        }
+        if (!(value >= min_value && value <= max_value)) {
+            float clamped = std::isnan(value) ? min_value : std::min(std::max(value, min_value), max_value);
+            std::cerr << "Warning: " << key << " " << value << " outside [" << min_value << ", "
+                      << max_value << "], using " << clamped << "\n";
+            value = clamped;
+        }
     }
 
-    ColorParams loadColorConfig(const char* filename) {
-        ColorParams params = {};
-        params.max_color_distance = 15.0f;
-        params.saturation = 1.0f;
-        params.brightness = 0.95f;
-        params.num_stops = 3.0f;
-        // Default gradient: red -> green -> blue
-        params.stops[0] = 0.0f; params.stops[1] = 0.0f;
-        params.stops[2] = 0.5f; params.stops[3] = 0.333f;
-        params.stops[4] = 1.0f; params.stops[5] = 0.667f;
+    // Parses the color config over the values already in `config`. Returns false, leaving `config` untouched,
+    // if the file can't be read or parsed
+    static bool loadRenderConfig(const std::string& filename, RenderConfig& config) {
+        RenderConfig loaded = config;
+        ColorParams& params = loaded.color;
+        Gradient::Settings& gradient = loaded.gradient;
+        AudioAnalyzer::AutoGainSettings& settings = loaded.gain;
 
         try {
-            YAML::Node config = YAML::LoadFile(filename);
+            YAML::Node root = YAML::LoadFile(filename);
 
-            if (config["max_color_distance"]) {
-                params.max_color_distance = config["max_color_distance"].as<float>();
-            }
-            if (config["saturation"]) {
-                params.saturation = config["saturation"].as<float>();
-            }
-            if (config["brightness"]) {
-                params.brightness = config["brightness"].as<float>();
+            readClamped(root, "max_color_distance", params.max_color_distance, 0.01f, 1000.0f);
+            readClamped(root, "saturation", gradient.saturation, 0.0f, 1.0f);
+            readClamped(root, "brightness", gradient.brightness, 0.0f, 2.0f);
+
+            if (root["gradient_space"]) {
+                std::string name = root["gradient_space"].as<std::string>();
+                if (!Gradient::parseSpace(name.c_str(), gradient.space)) {
+                    std::cerr << "Warning: Unknown gradient_space '" << name << "', expected hsv or oklab\n";
+                }
             }
 
-            if (config["gradient_stops"]) {
-                auto stops = config["gradient_stops"];
-                params.num_stops = std::min((int)stops.size(), 8);
+            if (root["gradient_stops"] && root["gradient_stops"].size() > 0) {
+                YAML::Node stops = root["gradient_stops"];
+                gradient.stops.clear();
+                for (size_t i = 0; i < stops.size(); i++) {
+                    Gradient::Stop stop;
+                    stop.position = std::min(std::max(stops[i]["position"].as<float>(), 0.0f), 1.0f);
+                    stop.hue = stops[i]["hue"].as<float>();
+                    stop.hue -= std::floor(stop.hue);
+                    gradient.stops.push_back(stop);
+                }
+                // The bake walks the stops in order
+                std::stable_sort(gradient.stops.begin(), gradient.stops.end(),
+                    [](const Gradient::Stop& a, const Gradient::Stop& b) { return a.position < b.position; });
+            }
 
-                for (size_t i = 0; i < params.num_stops && i < 8; i++) {
-                    params.stops[i * 2] = stops[i]["position"].as<float>();
-                    params.stops[i * 2 + 1] = stops[i]["hue"].as<float>();
+            // The tier sets every march setting; individual keys then override it
+            if (root["quality"]) {
+                int tier;
+                std::string name = root["quality"].as<std::string>();
+                if (parseQualityTier(name, tier)) {
+                    applyQualityTier(params, tier);
+                } else {
+                    std::cerr << "Warning: Unknown quality tier '" << name << "', expected low, medium, high or ultra\n";
                 }
             }
+            readClamped(root, "max_steps", params.max_steps, 16.0f, 512.0f);
+            params.max_steps = std::floor(params.max_steps);
+            readClamped(root, "march_distance", params.march_distance, 10.0f, 100.0f);
+            readClamped(root, "fog", params.fog, 0.0f, 1.0f);
+            readClamped(root, "hit_pixels", params.hit_pixels, 0.5f, 16.0f);
+            readClamped(root, "lod_pixels", params.lod_pixels, 0.25f, 8.0f);
+
+            // Optional `post` section: tonemapping and bloom
+            YAML::Node post = root["post"];
+            if (post) {
+                readClamped(post, "exposure", loaded.post.exposure, 0.01f, 16.0f);
+                readClamped(post, "bloom_strength", loaded.post.bloom_strength, 0.0f, 4.0f);
+                readClamped(post, "bloom_threshold", loaded.post.bloom_threshold, 0.0f, 16.0f);
+                readClamped(post, "bloom_knee", loaded.post.bloom_knee, 0.0f, 4.0f);
+            }
 
-            std::cout << "Loaded color config: " << params.num_stops << " gradient stops\n";
+            // Optional `audio_gain` section; anything missing keeps its current value
+            YAML::Node gain = root["audio_gain"];
+            if (gain) {
+                readClamped(gain, "attack", settings.attack_time, 0.0f, 60.0f);
+                readClamped(gain, "release", settings.release_time, 0.0f, 600.0f);
+                readClamped(gain, "floor", settings.floor, 1e-6f, 1e6f);
+                readClamped(gain, "bass", settings.bass_target, 0.0f, 100.0f);
+                readClamped(gain, "mid", settings.mid_target, 0.0f, 100.0f);
+                readClamped(gain, "high", settings.high_target, 0.0f, 100.0f);
+            }
         } catch (const YAML::Exception& e) {
             std::cerr << "Warning: Could not load " << filename << ": " << e.what() << "\n";
+            return false;
+        }
+
+        config = loaded;
+        std::cout << "Loaded " << filename << ": " << gradient.stops.size() << " gradient stops ("
+                  << Gradient::getSpaceName(gradient.space) << "), quality "
+                  << getQualityTierName((int)params.quality_tier) << " (" << params.max_steps << " steps, "
+                  << params.march_distance << " distance)\n";
+        return true;
+    }
+
+    // The config lives next to the sources; look where it usually is relative to the working
+    // directory, then relative to the executable
+    std::string findConfigFile() {
+        std::vector<std::string> candidates;
+        candidates.push_back("color_config.yaml");
+        candidates.push_back("../color_config.yaml");
+        const char* base = SDL_GetBasePath();
+        if (base) {
+            candidates.push_back(std::string(base) + "color_config.yaml");
+            candidates.push_back(std::string(base) + "../color_config.yaml");
+        }
+        return ConfigWatcher::findFile(candidates);
+    }
+
+    void loadConfig() {
+        default_config.color = defaultColorParams();
+        default_config.gradient = defaultGradient();
+        default_config.post = views[0].post_process.getSettings();
+        default_config.gain = audio_analyzer.getAutoGain();
+        RenderConfig config = default_config;
+
+        if (config_path.empty()) {
+            config_path = findConfigFile();
+        }
+        if (config_path.empty()) {
+            std::cerr << "Warning: color_config.yaml not found, using default color configuration\n";
+        } else if (!loadRenderConfig(config_path, config)) {
             std::cerr << "Using default color configuration\n";
         }
 
-        return params;
+        color_params = config.color;
+        gradient = config.gradient;
+        gradient_dirty = true;
+        setPostSettings(config.post);
+        audio_analyzer.setAutoGain(config.gain);
+
+        if (!config_path.empty()) {
+            config_watcher.start(config_path, [this](const std::string& path) { reloadConfig(path); });
+        }
+    }
+
+    void setPostSettings(const PostProcess::Settings& settings) {
+        for (size_t i = 0; i < views.size(); i++) {
+            views[i].post_process.setSettings(settings);
+        }
+    }
+
+    // Watcher thread: parse the whole file again and hand the result to the render thread
+    void reloadConfig(const std::string& path) {
+        RenderConfig config = default_config;
+        if (!loadRenderConfig(path, config)) {
+            std::cerr << "Keeping the previous color configuration\n";
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(config_mutex);
+        pending_config = config;
+        config_pending = true;
+    }
+
+    void loadScene() {
+        if (scene_path.empty()) return;
+        if (!scene.load(scene_path)) {
+            std::cerr << "Rendering without scene objects\n";
+        }
+        scene_watcher.start(scene_path, [this](const std::string& path) { reloadScene(path); });
+    }
+
+    // Watcher thread, like reloadConfig
+    void reloadScene(const std::string& path) {
+        SceneGraph loaded;
+        if (!loaded.load(path)) {
+            std::cerr << "Keeping the previous scene\n";
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(config_mutex);
+        pending_scene = loaded;
+        scene_pending = true;
+    }
+
+    // Render thread: takes a reloaded config or scene if there is one. Never waits on the
+    // watchers; if one is mid-handoff the change lands next frame
+    void applyConfigUpdate() {
+        std::unique_lock<std::mutex> lock(config_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) return;
+
+        if (scene_pending) {
+            scene = pending_scene;
+            scene_dirty = true;
+            scene_pending = false;
+            // New objects can be nearer than last frame's depth says
+            for (size_t i = 0; i < views.size(); i++) {
+                views[i].depth_history_valid = false;
+            }
+        }
+        if (!config_pending) return;
+
+        color_params = pending_config.color;
+        setPostSettings(pending_config.post);
+        if (pending_config.gradient != gradient) {
+            gradient = pending_config.gradient;
+            gradient_dirty = true;
+        }
+        audio_analyzer.setAutoGain(pending_config.gain);
+        config_pending = false;
     }
 
 public:
+    void setPresentMode(FrameScheduler::PresentMode mode) { requested_present_mode = mode; }
+    void addAudioDevice(int device_index) { audio_devices.push_back(device_index); }
+    void setHeadless(Uint32 width, Uint32 height) {
+        headless = true;
+        render_width = width;
+        render_height = height;
+    }
+    void setViews(int count, float spacing_degrees) {
+        view_count = std::max(count, 1);
+        view_spacing = spacing_degrees < 0.0f ? -1.0f : spacing_degrees * SDL_PI_F / 180.0f;
+    }
+    void setLatencyReport(bool enabled) { latency_report = enabled; }
+    void setLatencyTest(int clicks) { latency_test_clicks = clicks; }
+    void setConfigPath(const char* path) { config_path = path; }
+    void setScenePath(const char* path) { scene_path = path; }
+    void setPreferSRGB(bool enabled) { prefer_srgb = enabled; }
+    void setPostProcessing(bool enabled) { post_enabled = enabled; }
+    void setProfilePasses(bool enabled) { pass_profiler.setEnabled(enabled); }
+    void setRecording(const std::string& spec) { record_spec = spec; }
+    void setBandFile(const char* path) { band_file_path = path; }
+    void setBandStart(float seconds) { band_offset = std::max(seconds, 0.0f); }
+    void setWorker(bool enabled) { worker = enabled; }
+    void setCameraSeed(Uint32 seed) { camera_seed = seed; }
+    void setCameraReplay(const char* path) { camera_replay_path = path; }
+    void setCameraRecord(const char* path) { camera_record_path = path; }
+    void setAudioCamera(bool enabled) { audio_camera = enabled; }
+    void setRecordFps(float fps) { record_fps = fps > 0.0f ? fps : 60.0f; }
+    void setRecordFrames(int frames) { record_frame_limit = frames; }
+    FrameScheduler& getFrameScheduler() { return frame_scheduler; }
+
     bool initialize() {
-        if (!SDL_Init(SDL_INIT_VIDEO)) {
+        if (!SDL_Init(headless ? 0 : SDL_INIT_VIDEO)) {
             std::cerr << "SDL initialization failed: " << SDL_GetError() << "\n";
             return false;
         }
 
-        window = SDL_CreateWindow(
-            "Huawei Ray Marcher with Audio",
-            1024, 1024,
-            SDL_WINDOW_RESIZABLE
-        );
+        // Sized once, before anything holds on to a view
+        views.resize(view_count);
 
-        if (!window) {
-            std::cerr << "Window creation failed: " << SDL_GetError() << "\n";
-            return false;
+        // Centred on the camera's yaw; by default neighbours just touch, forming a panorama
+        float spacing = view_spacing >= 0.0f ? view_spacing
+                      : 2.0f * std::atan((float)render_width / (float)render_height);
+        for (int i = 0; i < view_count; i++) {
+            views[i].yaw_offset = (i - (view_count - 1) * 0.5f) * spacing;
+        }
+
+        if (!headless) {
+            for (int i = 0; i < view_count; i++) {
+                std::string title = "Huawei Ray Marcher with Audio";
+                if (view_count > 1) {
+                    title += " (view " + std::to_string(i + 1) + "/" + std::to_string(view_count) + ")";
+                }
+                views[i].window = SDL_CreateWindow(
+                    title.c_str(),
+                    (int)render_width, (int)render_height,
+                    SDL_WINDOW_RESIZABLE
+                );
+
+                if (!views[i].window) {
+                    std::cerr << "Window creation failed: " << SDL_GetError() << "\n";
+                    return false;
+                }
+            }
         }
 
         gpu_device = SDL_CreateGPUDevice(
-            getShaderFormat(),
+            Shader::getFormat(),
             true,
             nullptr
         );
@@ -196,72 +711,218 @@ public:
             return false;
         }
 
-        if (!SDL_ClaimWindowForGPUDevice(gpu_device, window)) {
-            std::cerr << "Failed to claim window for GPU: " << SDL_GetError() << "\n";
+        if (headless) {
+            if (!createOffscreenTargets()) {
+                return false;
+            }
+            std::cout << "Rendering headless at " << render_width << "x" << render_height;
+            if (view_count > 1) {
+                std::cout << ", " << view_count << " views";
+            }
+            std::cout << "\n";
+        } else if (!setupSwapchains()) {
             return false;
         }
+        std::cout << "Output encoding: " << (srgb_target ? "sRGB target" : "shader (UNORM target)") << "\n";
+
+        if (post_enabled && !PostProcess::isSupported(gpu_device)) {
+            std::cerr << "Warning: float render targets not supported, post-processing disabled\n";
+            post_enabled = false;
+        }
+        for (int i = 0; post_enabled && i < view_count; i++) {
+            if (!views[i].post_process.initialize(gpu_device, color_format, srgb_target)) {
+                std::cerr << "Warning: post-processing unavailable, rendering directly\n";
+                for (int j = 0; j <= i; j++) {
+                    views[j].post_process.cleanup();
+                }
+                post_enabled = false;
+            }
+        }
 
         // Initialize audio analyzer
         std::cout << "Initializing audio analyzer...\n";
-        if (!audio_analyzer.initialize(0)) {
+        bool audio_ok;
+        if (!band_file_path.empty()) {
+            if (!band_file.open(band_file_path)) {
+                return false;
+            }
+            std::cout << "Audio from " << band_file_path << ": " << band_file.getRecordCount() << " hops, "
+                      << band_file.getDurationNS() / (double)SDL_NS_PER_SECOND << " s, starting at " << band_offset << " s\n";
+            max_column_uploads = SPECTRUM_COLUMNS;
+            audio_ok = true;
+        } else if (headless && audio_devices.empty()) {
+            // Headless runs don't assume a microphone
+            audio_ok = audio_analyzer.initializeSynthetic();
+        } else {
+            if (audio_devices.empty()) {
+                audio_devices.push_back(0);
+            }
+            audio_ok = audio_analyzer.initialize(audio_devices);
+        }
+        if (!audio_ok) {
             std::cerr << "Warning: Failed to initialize audio analyzer\n";
             // Continue anyway - demo will work without audio
         }
+        loadConfig();
+        loadScene();
 
         if (!createPipeline()) {
             return false;
         }
 
         createVertexBuffer();
-        createCameraBuffer();
-        createAudioBuffer();
         createColorBuffer();
+        createDepthSampler();
+        createSpectrumTexture();
+        createGradientTexture();
+
+        if (latency_test_clicks > 0 && !createReadbackBuffer()) {
+            return false;
+        }
+        if (!setupCameraPath()) {
+            return false;
+        }
+        if ((!record_spec.empty() || worker) && !startRecording()) {
+            return false;
+        }
         return true;
     }
 
-    bool createPipeline() {
-        std::string vert_path = std::string("src/shaders/huawei_audio/huawei_audio.vert") + getShaderExtension();
-        std::string frag_path = std::string("src/shaders/huawei_audio/huawei_audio.frag") + getShaderExtension();
+    // Every window shares the pipelines, so their swapchains have to agree on a format;
+    // if only some can be sRGB, all of them fall back to UNORM
+    bool setupSwapchains() {
+        bool use_srgb = prefer_srgb;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            bool matching = true;
+            for (int i = 0; i < view_count; i++) {
+                if (attempt == 0 && !SDL_ClaimWindowForGPUDevice(gpu_device, views[i].window)) {
+                    std::cerr << "Failed to claim window for GPU: " << SDL_GetError() << "\n";
+                    return false;
+                }
 
-        auto vert_code = loadShader(vert_path.c_str());
-        auto frag_code = loadShader(frag_path.c_str());
+                frame_scheduler.applyPresentMode(gpu_device, views[i].window, requested_present_mode, use_srgb);
+                SDL_GPUTextureFormat format = SDL_GetGPUSwapchainTextureFormat(gpu_device, views[i].window);
+                if (i == 0) {
+                    color_format = format;
+                    srgb_target = frame_scheduler.isSRGBSwapchain();
+                } else if (format != color_format) {
+                    matching = false;
+                }
+            }
+            if (matching) {
+                std::cout << "Present mode: " << FrameScheduler::getPresentModeName(frame_scheduler.getPresentMode()) << "\n";
+                return true;
+            }
+            use_srgb = false;
+        }
 
-        if (vert_code.empty() || frag_code.empty()) {
-            std::cerr << "Failed to load shader files\n";
+        std::cerr << "Windows have different swapchain formats\n";
+        return false;
+    }
+
+    bool createOffscreenTargets() {
+        srgb_target = prefer_srgb &&
+                      SDL_GPUTextureSupportsFormat(gpu_device, SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM_SRGB,
+                                                   SDL_GPU_TEXTURETYPE_2D, SDL_GPU_TEXTUREUSAGE_COLOR_TARGET);
+        color_format = srgb_target ? SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM_SRGB : SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+
+        SDL_GPUTextureCreateInfo texture_info = {};
+        texture_info.type = SDL_GPU_TEXTURETYPE_2D;
+        texture_info.format = color_format;
+        texture_info.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+        texture_info.width = render_width;
+        texture_info.height = render_height;
+        texture_info.layer_count_or_depth = 1;
+        texture_info.num_levels = 1;
+
+        for (int i = 0; i < view_count; i++) {
+            views[i].offscreen_target = SDL_CreateGPUTexture(gpu_device, &texture_info);
+            if (!views[i].offscreen_target) {
+                std::cerr << "Failed to create offscreen target: " << SDL_GetError() << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool createReadbackBuffer() {
+        if (!headless) {
+            std::cerr << "The latency test needs --headless\n";
             return false;
         }
 
-        SDL_GPUShaderCreateInfo vert_info = {};
-        vert_info.code = vert_code.data();
-        vert_info.code_size = vert_code.size();
-        vert_info.entrypoint = getShaderEntrypoint();
-        vert_info.format = getShaderFormat();
-        vert_info.stage = SDL_GPU_SHADERSTAGE_VERTEX;
-        vert_info.num_samplers = 0;
-        vert_info.num_storage_textures = 0;
-        vert_info.num_storage_buffers = 0;
-        vert_info.num_uniform_buffers = 0;
+        SDL_GPUTransferBufferCreateInfo transfer_info = {};
+        transfer_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD;
+        transfer_info.size = render_width * (render_height / 2) * 4;
 
-        SDL_GPUShader* vert_shader = SDL_CreateGPUShader(gpu_device, &vert_info);
-        if (!vert_shader) {
-            std::cerr << "Failed to create vertex shader: " << SDL_GetError() << "\n";
+        readback_buffer = SDL_CreateGPUTransferBuffer(gpu_device, &transfer_info);
+        if (!readback_buffer) {
+            std::cerr << "Failed to create readback buffer: " << SDL_GetError() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool setupCameraPath() {
+        if (!camera_replay_path.empty()) {
+            if (!camera_path.load(camera_replay_path)) {
+                return false;
+            }
+            std::cout << "Camera: replaying " << camera_replay_path << " (" << camera_path.getDuration() << " s)\n";
+        } else {
+            CameraPath::Pose start = {cam_x, cam_y, cam_z, cam_yaw, cam_pitch};
+            camera_path.generate(camera_seed, start, camera_altitude_min, camera_altitude_max);
+            std::cout << "Camera: seed " << camera_seed << (audio_camera ? ", audio-driven" : "") << "\n";
+
+            director_pose = camera_path.sample(0.0f);
+            if (audio_camera && !camera_director.start(camera_path, band_file.isOpen() ? &band_file : nullptr, band_offset)) {
+                return false;
+            }
+        }
+        return camera_record_path.empty() || camera_recorder.open(camera_record_path, camera_seed);
+    }
+
+    bool startRecording() {
+        if (!headless) {
+            std::cerr << "Recording needs --headless\n";
+            return false;
+        }
+        if (worker && !band_file.isOpen()) {
+            std::cerr << "A worker needs --band-file\n";
             return false;
         }
+        // Frames are produced as fast as possible; idling on quiet audio would only slow them down
+        frame_scheduler.setIdleFps(0.0f);
 
-        SDL_GPUShaderCreateInfo frag_info = {};
-        frag_info.code = frag_code.data();
-        frag_info.code_size = frag_code.size();
-        frag_info.entrypoint = getShaderEntrypoint();
-        frag_info.format = getShaderFormat();
-        frag_info.stage = SDL_GPU_SHADERSTAGE_FRAGMENT;
-        frag_info.num_samplers = 0;
-        frag_info.num_storage_textures = 0;
-        frag_info.num_storage_buffers = 3;  // camera + audio + color
-        frag_info.num_uniform_buffers = 0;
+        SDL_GPUTransferBufferCreateInfo transfer_info = {};
+        transfer_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD;
+        transfer_info.size = render_width * render_height * 4;
 
-        SDL_GPUShader* frag_shader = SDL_CreateGPUShader(gpu_device, &frag_info);
+        record_buffer = SDL_CreateGPUTransferBuffer(gpu_device, &transfer_info);
+        if (!record_buffer) {
+            std::cerr << "Failed to create record buffer: " << SDL_GetError() << "\n";
+            return false;
+        }
+
+        // A worker starts a sink per job instead
+        if (worker) {
+            return true;
+        }
+        // The offscreen target is RGBA8 either way; an sRGB format just means the bytes were encoded on store
+        return frame_encoder.start(EncoderSink::create(record_spec), render_width, render_height, record_fps);
+    }
+
+    bool createPipeline() {
+        SDL_GPUShader* vert_shader = Shader::create(gpu_device, "src/shaders/huawei_audio/huawei_audio.vert",
+                                                    SDL_GPU_SHADERSTAGE_VERTEX, 0, 0, 0);
+        if (!vert_shader) {
+            return false;
+        }
+
+        // Samplers: depth history, spectrum history, gradient. Storage: color, scene. Uniforms: camera, audio
+        SDL_GPUShader* frag_shader = Shader::create(gpu_device, "src/shaders/huawei_audio/huawei_audio.frag",
+                                                    SDL_GPU_SHADERSTAGE_FRAGMENT, 3, 2, 2);
         if (!frag_shader) {
-            std::cerr << "Failed to create fragment shader: " << SDL_GetError() << "\n";
             SDL_ReleaseGPUShader(gpu_device, vert_shader);
             return false;
         }
@@ -298,12 +959,14 @@ public:
         pipeline_info.rasterizer_state.cull_mode = SDL_GPU_CULLMODE_NONE;
         pipeline_info.rasterizer_state.front_face = SDL_GPU_FRONTFACE_COUNTER_CLOCKWISE;
 
-        SDL_GPUColorTargetDescription color_target = {};
-        color_target.format = SDL_GPU_TEXTUREFORMAT_B8G8R8A8_UNORM;
-        color_target.blend_state.enable_blend = false;
+        SDL_GPUColorTargetDescription color_targets[2] = {};
+        color_targets[0].format = post_enabled ? PostProcess::SCENE_FORMAT : color_format;
+        color_targets[0].blend_state.enable_blend = false;
+        color_targets[1].format = SDL_GPU_TEXTUREFORMAT_R32_FLOAT;  // hit distance
+        color_targets[1].blend_state.enable_blend = false;
 
-        pipeline_info.target_info.num_color_targets = 1;
-        pipeline_info.target_info.color_target_descriptions = &color_target;
+        pipeline_info.target_info.num_color_targets = 2;
+        pipeline_info.target_info.color_target_descriptions = color_targets;
         pipeline_info.target_info.has_depth_stencil_target = false;
 
         pipeline = SDL_CreateGPUGraphicsPipeline(gpu_device, &pipeline_info);
@@ -362,262 +1025,990 @@ public:
         }
     }
 
-    void createCameraBuffer() {
+    // Filled by the first frame's uploads
+    void createColorBuffer() {
         SDL_GPUBufferCreateInfo buffer_info = {};
         buffer_info.usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ;
-        buffer_info.size = sizeof(CameraParams);
+        buffer_info.size = sizeof(ColorParams);
 
-        camera_buffer = SDL_CreateGPUBuffer(gpu_device, &buffer_info);
+        color_buffer = SDL_CreateGPUBuffer(gpu_device, &buffer_info);
+        if (!color_buffer) {
+            std::cerr << "Failed to create color buffer: " << SDL_GetError() << "\n";
+        }
     }
 
-    void createAudioBuffer() {
-        SDL_GPUBufferCreateInfo buffer_info = {};
-        buffer_info.usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ;
-        buffer_info.size = sizeof(AudioParams);
-
-        audio_buffer = SDL_CreateGPUBuffer(gpu_device, &buffer_info);
+    bool hasPendingUploads() {
+        return !buffer_uploads.empty() || gradient_dirty || spectrumColumnCount() > uploaded_columns;
     }
 
-    void createColorBuffer() {
-        ColorParams params = loadColorConfig("../color_config.yaml");
-
-        SDL_GPUBufferCreateInfo buffer_info = {};
-        buffer_info.usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ;
-        buffer_info.size = sizeof(ColorParams);
+    // Stages bytes for `buffer` to be written by this frame's copy pass
+    void queueUpload(SDL_GPUBuffer* buffer, Uint32 offset, const void* data, Uint32 size) {
+        BufferUpload upload = {buffer, offset, size, (Uint32)upload_staging.size()};
+        const Uint8* bytes = (const Uint8*)data;
+        upload_staging.insert(upload_staging.end(), bytes, bytes + size);
+        buffer_uploads.push_back(upload);
+    }
 
-        color_buffer = SDL_CreateGPUBuffer(gpu_device, &buffer_info);
+    // Records everything queued this frame into copy_pass through one cycled transfer buffer
+    void flushUploads(SDL_GPUCopyPass* copy_pass) {
+        if (buffer_uploads.empty()) return;
 
-        // Upload initial color config
-        if (color_buffer) {
+        Uint32 size = (Uint32)upload_staging.size();
+        if (!frame_transfer || frame_transfer_size < size) {
+            if (frame_transfer) {
+                SDL_ReleaseGPUTransferBuffer(gpu_device, frame_transfer);
+            }
             SDL_GPUTransferBufferCreateInfo transfer_info = {};
             transfer_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
-            transfer_info.size = sizeof(ColorParams);
+            transfer_info.size = std::max(size, (Uint32)1024);
 
-            SDL_GPUTransferBuffer* transfer = SDL_CreateGPUTransferBuffer(gpu_device, &transfer_info);
-            void* data = SDL_MapGPUTransferBuffer(gpu_device, transfer, false);
-            SDL_memcpy(data, &params, sizeof(ColorParams));
-            SDL_UnmapGPUTransferBuffer(gpu_device, transfer);
+            frame_transfer = SDL_CreateGPUTransferBuffer(gpu_device, &transfer_info);
+            frame_transfer_size = frame_transfer ? transfer_info.size : 0;
+        }
 
-            SDL_GPUCommandBuffer* cmd = SDL_AcquireGPUCommandBuffer(gpu_device);
-            SDL_GPUCopyPass* copy_pass = SDL_BeginGPUCopyPass(cmd);
+        void* data = frame_transfer ? SDL_MapGPUTransferBuffer(gpu_device, frame_transfer, true) : nullptr;
+        if (data) {
+            SDL_memcpy(data, upload_staging.data(), size);
+            SDL_UnmapGPUTransferBuffer(gpu_device, frame_transfer);
 
-            SDL_GPUTransferBufferLocation src = {};
-            src.transfer_buffer = transfer;
-            src.offset = 0;
+            for (size_t i = 0; i < buffer_uploads.size(); i++) {
+                SDL_GPUTransferBufferLocation src = {};
+                src.transfer_buffer = frame_transfer;
+                src.offset = buffer_uploads[i].staging_offset;
 
-            SDL_GPUBufferRegion dst = {};
-            dst.buffer = color_buffer;
-            dst.offset = 0;
-            dst.size = sizeof(ColorParams);
+                SDL_GPUBufferRegion dst = {};
+                dst.buffer = buffer_uploads[i].buffer;
+                dst.offset = buffer_uploads[i].offset;
+                dst.size = buffer_uploads[i].size;
 
-            SDL_UploadToGPUBuffer(copy_pass, &src, &dst, false);
-            SDL_EndGPUCopyPass(copy_pass);
-            SDL_SubmitGPUCommandBuffer(cmd);
-            SDL_ReleaseGPUTransferBuffer(gpu_device, transfer);
+                SDL_UploadToGPUBuffer(copy_pass, &src, &dst, false);
+            }
+        } else {
+            std::cerr << "Failed to stage frame uploads: " << SDL_GetError() << "\n";
         }
+
+        upload_staging.clear();
+        buffer_uploads.clear();
     }
 
-    void updateCameraBuffer() {
-        if (!camera_buffer) return;
+    // Queues the bytes of the color params that changed since the last upload: a reload
+    // that only touches fog sends 4 bytes, and an unchanged config sends nothing
+    void updateColorBuffer() {
+        if (!color_buffer) return;
+
+        const Uint8* current = (const Uint8*)&color_params;
+        const Uint8* uploaded = (const Uint8*)&uploaded_color;
+        Uint32 first = 0;
+        Uint32 last = sizeof(ColorParams);
+        if (color_uploaded) {
+            while (first < last && current[first] == uploaded[first]) first++;
+            while (last > first && current[last - 1] == uploaded[last - 1]) last--;
+            if (first == last) return;
+
+            // Storage buffer updates go in whole floats
+            first &= ~(Uint32)3;
+            last = (last + 3) & ~(Uint32)3;
+        }
+
+        queueUpload(color_buffer, first, current + first, last - first);
+        uploaded_color = color_params;
+        color_uploaded = true;
+    }
+
+    // Queues the whole compiled scene after a load, recreating the buffer if it has outgrown it.
+    // The header says how much is in use, so a smaller scene can reuse a bigger buffer
+    void updateSceneBuffer() {
+        if (!scene_dirty) return;
+
+        const std::vector<SceneGraph::Record>& records = scene.getRecords();
+        Uint32 size = (Uint32)(records.size() * sizeof(SceneGraph::Record));
+        if (!scene_buffer || scene_buffer_size < size) {
+            if (scene_buffer) {
+                SDL_ReleaseGPUBuffer(gpu_device, scene_buffer);
+            }
+            SDL_GPUBufferCreateInfo buffer_info = {};
+            buffer_info.usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ;
+            buffer_info.size = size;
+
+            scene_buffer = SDL_CreateGPUBuffer(gpu_device, &buffer_info);
+            scene_buffer_size = scene_buffer ? size : 0;
+            if (!scene_buffer) {
+                std::cerr << "Failed to create scene buffer: " << SDL_GetError() << "\n";
+                return;
+            }
+        }
 
-        CameraParams params = {cam_x, cam_y, cam_z, cam_yaw, cam_pitch, elapsed_time, {0, 0}};
+        queueUpload(scene_buffer, 0, records.data(), size);
+        scene_dirty = false;
+    }
+
+    void createDepthSampler() {
+        SDL_GPUSamplerCreateInfo sampler_info = {};
+        sampler_info.min_filter = SDL_GPU_FILTER_NEAREST;
+        sampler_info.mag_filter = SDL_GPU_FILTER_NEAREST;
+        sampler_info.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
+        sampler_info.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+        sampler_info.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+        sampler_info.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+
+        depth_sampler = SDL_CreateGPUSampler(gpu_device, &sampler_info);
+        if (!depth_sampler) {
+            std::cerr << "Failed to create depth sampler: " << SDL_GetError() << "\n";
+        }
+    }
 
+    void createSpectrumTexture() {
+        const Uint32 bins = AudioAnalyzer::SPECTRUM_BINS;
+        const Uint32 texel_size = 2 * sizeof(Uint16);
+
+        // Half floats, so the linear sampler below is supported everywhere
+        SDL_GPUTextureCreateInfo texture_info = {};
+        texture_info.type = SDL_GPU_TEXTURETYPE_2D;
+        texture_info.format = SDL_GPU_TEXTUREFORMAT_R16G16_FLOAT;
+        texture_info.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+        texture_info.width = SPECTRUM_COLUMNS;
+        texture_info.height = bins;
+        texture_info.layer_count_or_depth = 1;
+        texture_info.num_levels = 1;
+
+        spectrum_texture = SDL_CreateGPUTexture(gpu_device, &texture_info);
+        if (!spectrum_texture) {
+            std::cerr << "Failed to create spectrum texture: " << SDL_GetError() << "\n";
+            return;
+        }
+
+        SDL_GPUSamplerCreateInfo sampler_info = {};
+        sampler_info.min_filter = SDL_GPU_FILTER_LINEAR;
+        sampler_info.mag_filter = SDL_GPU_FILTER_LINEAR;
+        sampler_info.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
+        sampler_info.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_REPEAT;
+        sampler_info.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+        sampler_info.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+
+        spectrum_sampler = SDL_CreateGPUSampler(gpu_device, &sampler_info);
+        if (!spectrum_sampler) {
+            std::cerr << "Failed to create spectrum sampler: " << SDL_GetError() << "\n";
+        }
+
+        // Persistent staging for new columns, cycled each frame
         SDL_GPUTransferBufferCreateInfo transfer_info = {};
         transfer_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
-        transfer_info.size = sizeof(CameraParams);
+        transfer_info.size = max_column_uploads * bins * texel_size;
+        spectrum_transfer = SDL_CreateGPUTransferBuffer(gpu_device, &transfer_info);
+
+        // Start from silence so filtering at the edge of the written history reads zeros
+        SDL_GPUTransferBufferCreateInfo clear_info = {};
+        clear_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+        clear_info.size = SPECTRUM_COLUMNS * bins * texel_size;
 
-        SDL_GPUTransferBuffer* transfer = SDL_CreateGPUTransferBuffer(gpu_device, &transfer_info);
-        void* data = SDL_MapGPUTransferBuffer(gpu_device, transfer, false);
-        SDL_memcpy(data, &params, sizeof(CameraParams));
-        SDL_UnmapGPUTransferBuffer(gpu_device, transfer);
+        SDL_GPUTransferBuffer* clear = SDL_CreateGPUTransferBuffer(gpu_device, &clear_info);
+        void* data = SDL_MapGPUTransferBuffer(gpu_device, clear, false);
+        SDL_memset(data, 0, clear_info.size);
+        SDL_UnmapGPUTransferBuffer(gpu_device, clear);
 
         SDL_GPUCommandBuffer* cmd = SDL_AcquireGPUCommandBuffer(gpu_device);
         SDL_GPUCopyPass* copy_pass = SDL_BeginGPUCopyPass(cmd);
 
-        SDL_GPUTransferBufferLocation src = {};
-        src.transfer_buffer = transfer;
-        src.offset = 0;
+        SDL_GPUTextureTransferInfo src = {};
+        src.transfer_buffer = clear;
+        src.pixels_per_row = SPECTRUM_COLUMNS;
+        src.rows_per_layer = bins;
 
-        SDL_GPUBufferRegion dst = {};
-        dst.buffer = camera_buffer;
-        dst.offset = 0;
-        dst.size = sizeof(CameraParams);
+        SDL_GPUTextureRegion dst = {};
+        dst.texture = spectrum_texture;
+        dst.w = SPECTRUM_COLUMNS;
+        dst.h = bins;
+        dst.d = 1;
 
-        SDL_UploadToGPUBuffer(copy_pass, &src, &dst, false);
+        SDL_UploadToGPUTexture(copy_pass, &src, &dst, false);
         SDL_EndGPUCopyPass(copy_pass);
         SDL_SubmitGPUCommandBuffer(cmd);
-        SDL_ReleaseGPUTransferBuffer(gpu_device, transfer);
+        SDL_ReleaseGPUTransferBuffer(gpu_device, clear);
     }
 
-    void updateAudioBuffer() {
-        if (!audio_buffer) return;
+    // Columns come from the analyzer, or from the band file up to the frame's audio time
+    Uint64 spectrumColumnCount() {
+        return band_file.isOpen() ? band_file.countAt(bandFileTime()) : audio_analyzer.getColumnCount();
+    }
 
-        // Update audio analyzer and get coefficients
-        audio_analyzer.update();
-        auto coeffs = audio_analyzer.getCoefficients();
+    const AudioAnalyzer::SpectrumColumn* spectrumColumn(Uint64 index) {
+        if (band_file.isOpen()) {
+            return index < band_file.getRecordCount() ? &band_file.getRecord(index).column : nullptr;
+        }
+        return audio_analyzer.getColumn(index);
+    }
 
-        // Smooth the bass value
-        smoothed_bass = (1.0f - bass_smoothing_factor) * smoothed_bass + bass_smoothing_factor * coeffs[0];
+    // Records uploads of the analyzer's columns that the texture hasn't seen yet, one
+    // SPECTRUM_BINS-tall column each, into the frame's copy pass
+    void uploadSpectrumColumns(SDL_GPUCopyPass* copy_pass) {
+        if (!spectrum_texture || !spectrum_transfer) return;
 
-        AudioParams params = {coeffs[0], coeffs[1], coeffs[2], smoothed_bass};
+        Uint64 count = spectrumColumnCount();
+        Uint64 first = std::max(uploaded_columns, count > max_column_uploads ? count - max_column_uploads : (Uint64)0);
+        if (first >= count) return;
+
+        const Uint32 bins = AudioAnalyzer::SPECTRUM_BINS;
+        Uint16* staging = (Uint16*)SDL_MapGPUTransferBuffer(gpu_device, spectrum_transfer, true);
+        if (!staging) return;
+
+        Uint32 slot = 0;
+        for (Uint64 index = first; index < count; index++) {
+            const AudioAnalyzer::SpectrumColumn* column = spectrumColumn(index);
+            if (!column) continue;
+
+            Uint16* texels = staging + slot * bins * 2;
+            for (Uint32 y = 0; y < bins; y++) {
+                texels[y * 2] = floatToHalf(column->spectrum[y]);
+                texels[y * 2 + 1] = floatToHalf(column->waveform[y]);
+            }
+
+            SDL_GPUTextureTransferInfo src = {};
+            src.transfer_buffer = spectrum_transfer;
+            src.offset = slot * bins * 2 * sizeof(Uint16);
+            src.pixels_per_row = 1;
+            src.rows_per_layer = bins;
+
+            SDL_GPUTextureRegion dst = {};
+            dst.texture = spectrum_texture;
+            dst.x = (Uint32)(index % SPECTRUM_COLUMNS);
+            dst.w = 1;
+            dst.h = bins;
+            dst.d = 1;
+
+            SDL_UploadToGPUTexture(copy_pass, &src, &dst, false);
+            slot++;
+        }
+        SDL_UnmapGPUTransferBuffer(gpu_device, spectrum_transfer);
+
+        uploaded_columns = count;
+    }
+
+    // Where the frame's sampled capture time falls in the texture, in columns
+    float spectrumHead(Uint64 sample_ns) {
+        if (uploaded_columns == 0) return 0.0f;
+
+        Uint64 newest = uploaded_columns - 1;
+        const AudioAnalyzer::SpectrumColumn* column = spectrumColumn(newest);
+        Uint64 interval = band_file.isOpen() ? band_file.getHopNS() : audio_analyzer.getSnapshotIntervalNS();
+        double offset = 0.0;
+        if (column && interval > 0) {
+            offset = (double)(Sint64)(sample_ns - column->time_ns) / (double)interval;
+        }
+        double head = std::fmod((double)(newest % SPECTRUM_COLUMNS) + offset, (double)SPECTRUM_COLUMNS);
+        return (float)(head < 0.0 ? head + SPECTRUM_COLUMNS : head);
+    }
+
+    void createGradientTexture() {
+        SDL_GPUTextureCreateInfo texture_info = {};
+        texture_info.type = SDL_GPU_TEXTURETYPE_2D;
+        texture_info.format = SDL_GPU_TEXTUREFORMAT_R16G16B16A16_FLOAT;  // Filterable everywhere
+        texture_info.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+        texture_info.width = GRADIENT_TEXELS;
+        texture_info.height = 1;
+        texture_info.layer_count_or_depth = 1;
+        texture_info.num_levels = 1;
+
+        gradient_texture = SDL_CreateGPUTexture(gpu_device, &texture_info);
+        if (!gradient_texture) {
+            std::cerr << "Failed to create gradient texture: " << SDL_GetError() << "\n";
+            return;
+        }
+
+        SDL_GPUSamplerCreateInfo sampler_info = {};
+        sampler_info.min_filter = SDL_GPU_FILTER_LINEAR;
+        sampler_info.mag_filter = SDL_GPU_FILTER_LINEAR;
+        sampler_info.mipmap_mode = SDL_GPU_SAMPLERMIPMAPMODE_NEAREST;
+        sampler_info.address_mode_u = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+        sampler_info.address_mode_v = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+        sampler_info.address_mode_w = SDL_GPU_SAMPLERADDRESSMODE_CLAMP_TO_EDGE;
+
+        gradient_sampler = SDL_CreateGPUSampler(gpu_device, &sampler_info);
+        if (!gradient_sampler) {
+            std::cerr << "Failed to create gradient sampler: " << SDL_GetError() << "\n";
+        }
 
         SDL_GPUTransferBufferCreateInfo transfer_info = {};
         transfer_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
-        transfer_info.size = sizeof(AudioParams);
+        transfer_info.size = GRADIENT_TEXELS * 4 * sizeof(Uint16);
+        gradient_transfer = SDL_CreateGPUTransferBuffer(gpu_device, &transfer_info);
+    }
 
-        SDL_GPUTransferBuffer* transfer = SDL_CreateGPUTransferBuffer(gpu_device, &transfer_info);
-        void* data = SDL_MapGPUTransferBuffer(gpu_device, transfer, false);
-        SDL_memcpy(data, &params, sizeof(AudioParams));
-        SDL_UnmapGPUTransferBuffer(gpu_device, transfer);
+    // Re-bakes the gradient, as half floats, into the frame's copy pass when the config changed it
+    void uploadGradient(SDL_GPUCopyPass* copy_pass) {
+        if (!gradient_dirty || !gradient_texture || !gradient_transfer) return;
 
-        SDL_GPUCommandBuffer* cmd = SDL_AcquireGPUCommandBuffer(gpu_device);
-        SDL_GPUCopyPass* copy_pass = SDL_BeginGPUCopyPass(cmd);
+        std::vector<float> texels = Gradient::bake(gradient, GRADIENT_TEXELS);
+        Uint16* data = (Uint16*)SDL_MapGPUTransferBuffer(gpu_device, gradient_transfer, true);
+        if (!data) return;
+        for (size_t i = 0; i < texels.size(); i++) {
+            data[i] = floatToHalf(texels[i]);
+        }
+        SDL_UnmapGPUTransferBuffer(gpu_device, gradient_transfer);
 
-        SDL_GPUTransferBufferLocation src = {};
-        src.transfer_buffer = transfer;
-        src.offset = 0;
+        SDL_GPUTextureTransferInfo src = {};
+        src.transfer_buffer = gradient_transfer;
+        src.pixels_per_row = GRADIENT_TEXELS;
+        src.rows_per_layer = 1;
 
-        SDL_GPUBufferRegion dst = {};
-        dst.buffer = audio_buffer;
-        dst.offset = 0;
-        dst.size = sizeof(AudioParams);
+        SDL_GPUTextureRegion dst = {};
+        dst.texture = gradient_texture;
+        dst.w = GRADIENT_TEXELS;
+        dst.h = 1;
+        dst.d = 1;
 
-        SDL_UploadToGPUBuffer(copy_pass, &src, &dst, false);
-        SDL_EndGPUCopyPass(copy_pass);
-        SDL_SubmitGPUCommandBuffer(cmd);
-        SDL_ReleaseGPUTransferBuffer(gpu_device, transfer);
+        SDL_UploadToGPUTexture(copy_pass, &src, &dst, false);
+        gradient_dirty = false;
     }
 
-    void updateCamera(float delta_time) {
-        float move_speed = 0.5f * delta_time;
+    void releaseDepthHistory(View& view) {
+        for (int i = 0; i < 2; i++) {
+            if (view.depth_history[i]) {
+                SDL_ReleaseGPUTexture(gpu_device, view.depth_history[i]);
+                view.depth_history[i] = nullptr;
+            }
+        }
+        view.depth_width = 0;
+        view.depth_height = 0;
+        view.depth_history_valid = false;
+    }
+
+    // (Re)creates a view's depth history to match its target; a resize invalidates the history
+    bool ensureDepthHistory(View& view, Uint32 width, Uint32 height) {
+        if (view.depth_history[0] && view.depth_width == width && view.depth_height == height) {
+            return true;
+        }
+
+        releaseDepthHistory(view);
+
+        SDL_GPUTextureCreateInfo texture_info = {};
+        texture_info.type = SDL_GPU_TEXTURETYPE_2D;
+        texture_info.format = SDL_GPU_TEXTUREFORMAT_R32_FLOAT;
+        texture_info.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER;
+        texture_info.width = width;
+        texture_info.height = height;
+        texture_info.layer_count_or_depth = 1;
+        texture_info.num_levels = 1;
+
+        for (int i = 0; i < 2; i++) {
+            view.depth_history[i] = SDL_CreateGPUTexture(gpu_device, &texture_info);
+            if (!view.depth_history[i]) {
+                std::cerr << "Failed to create depth history texture: " << SDL_GetError() << "\n";
+                releaseDepthHistory(view);
+                return false;
+            }
+        }
+
+        view.depth_width = width;
+        view.depth_height = height;
+        return true;
+    }
+
+    // The shader maps the vertical extent to uv [-1, 1] at focal length 1,
+    // so one pixel spans 2 / height units on the image plane
+    static float pixelAngle(Uint32 height) {
+        return 2.0f / (float)height;
+    }
+
+    // Pushed as uniforms when the view's scene is drawn
+    void updateCameraParams(View& view) {
+        float dx = cam_x - view.prev_x;
+        float dy = cam_y - view.prev_y;
+        float dz = cam_z - view.prev_z;
+        float camera_move = std::sqrt(dx * dx + dy * dy + dz * dz);
+        float time_step = elapsed_time - view.prev_time;
+        float height_slack = std::max(Terrain::maxHeightChange(prev_left, current_left, camera_move, time_step),
+                                      Terrain::maxHeightChange(prev_right, current_right, camera_move, time_step));
+        float yaw = cam_yaw + view.yaw_offset;
+
+        view.camera_params = {
+            cam_x, cam_y, cam_z, yaw, cam_pitch, elapsed_time,
+            view.prev_x, view.prev_y, view.prev_z, view.prev_yaw,
+            view.depth_history_valid ? 1.0f : 0.0f,
+            height_slack,
+            (float)view.width, (float)view.height,
+            pixelAngle(view.height),
+            (post_enabled || srgb_target) ? 0.0f : 1.0f
+        };
+
+        view.prev_x = cam_x;
+        view.prev_y = cam_y;
+        view.prev_z = cam_z;
+        view.prev_yaw = yaw;
+        view.prev_time = elapsed_time;
+    }
+
+    // Fraction of the way a one-pole filter moves toward its input over dt
+    static float smoothingWeight(float dt, float time_constant) {
+        if (time_constant <= 0.0f) return 1.0f;
+        return 1.0f - std::exp(-dt / time_constant);
+    }
+
+    // Present is estimated from how long the GPU took last frame
+    Uint64 presentLatencyNS() const {
+        return frame_timestamps.presented_ns > frame_timestamps.submitted_ns
+             ? frame_timestamps.presented_ns - frame_timestamps.submitted_ns : 0;
+    }
+
+    // Picks the capture time this frame shows and interpolates the analyzer's snapshots there.
+    // Frames run a steady delay behind the newest snapshot (about one hop more than its usual
+    // age at present), so they normally interpolate and only extrapolate through hiccups
+    AudioAnalyzer::BandSnapshot sampleAudio() {
+        Uint64 now = SDL_GetTicksNS();
+        audio_frame_time = last_audio_sample_ns ? (float)(now - last_audio_sample_ns) / SDL_NS_PER_SECOND : 0.0f;
+        last_audio_sample_ns = now;
+
+        Uint64 newest = audio_analyzer.getLatestSnapshotTime();
+        if (newest == 0) {
+            return audio_analyzer.getBandsAt(0);
+        }
+
+        Uint64 present_ns = now + presentLatencyNS();
+
+        double target_delay = (double)(Sint64)(present_ns - newest) + (double)audio_analyzer.getSnapshotIntervalNS();
+        if (audio_delay_ns <= 0.0) {
+            audio_delay_ns = target_delay;
+        } else {
+            audio_delay_ns += (target_delay - audio_delay_ns) * smoothingWeight(audio_frame_time, audio_delay_smoothing_time);
+        }
+
+        Uint64 delay = (Uint64)std::max(audio_delay_ns, 0.0);
+        return audio_analyzer.getBandsAt(present_ns > delay ? present_ns - delay : 0);
+    }
+
+    Uint64 bandFileTime() const {
+        return (Uint64)(std::max((double)elapsed_time + band_offset, 0.0) * SDL_NS_PER_SECOND);
+    }
+
+    // Jumps the band file's track; the lookup is a direct index, so any distance is free
+    void seekBandFile(double seconds) {
+        double duration = band_file.getDurationNS() / (double)SDL_NS_PER_SECOND;
+        double target = std::min(std::max(elapsed_time + band_offset + seconds, 0.0), duration);
+        band_offset = target - elapsed_time;
+        camera_director.setBandOffset(band_offset);
+
+        // Refill the spectrum history from the new position
+        uploaded_columns = 0;
+        std::cout << "Audio at " << target << " / " << duration << " s\n";
+    }
 
-        float Y_MIN = 3.5;
-        float Y_MAX = 10.0;
+    float audioLevel() const {
+        return band_file.isOpen() ? band_file.getLevelAt(bandFileTime()) : audio_analyzer.getLevel();
+    }
+
+    void updateAudioParams() {
+        audio_params = advanceAudio();
+    }
+
+    // This frame's audio: updates the smoothing and stereo history, which a band file
+    // worker also replays for the frames it skips
+    AudioParams advanceAudio() {
+        AudioAnalyzer::BandSnapshot snapshot;
+        AudioAnalyzer::BeatInfo beat;
+        if (band_file.isOpen()) {
+            Uint64 time_ns = bandFileTime();
+            snapshot = band_file.getBandsAt(time_ns);
+            beat = band_file.getBeatAt(time_ns);
+            audio_frame_time = elapsed_time - last_band_time;
+            last_band_time = elapsed_time;
+        } else {
+            // Update audio analyzer, then sample its snapshots at this frame's present time
+            audio_analyzer.update();
+            snapshot = sampleAudio();
+            beat = audio_analyzer.getBeatInfo();
+
+            frame_timestamps.capture_ns = snapshot.time_ns;
+            frame_timestamps.window_start_ns = snapshot.time_ns - std::min(snapshot.time_ns, audio_analyzer.getAnalysisWindowNS());
+            frame_timestamps.analyzed_ns = SDL_GetTicksNS();
+
+            if (camera_director.isRunning()) {
+                CameraDirector::Features features = {
+                    elapsed_time, (snapshot.bands.bass + snapshot.bands.mid + snapshot.bands.high) / 3.0f, beat.onset
+                };
+                camera_director.pushFeatures(features);
+            }
+        }
+        std::array<float, 3> coeffs = {snapshot.bands.bass, snapshot.bands.mid, snapshot.bands.high};
+
+        // Stereo sides for panning; mono input drives both sides equally
+        AudioAnalyzer::FrequencyBands left = snapshot.left;
+        AudioAnalyzer::FrequencyBands right = snapshot.right;
+        prev_left = current_left;
+        prev_right = current_right;
+        current_left = {left.bass, left.mid, left.high};
+        current_right = {right.bass, right.mid, right.high};
 
-        // Calculate forward and right vectors from yaw
-        float forward_x = sin(cam_yaw);
-        float forward_z = cos(cam_yaw);
-        float right_x = cos(cam_yaw);
-        float right_z = -sin(cam_yaw);
+        // Smooth the bass value
+        smoothed_bass += (coeffs[0] - smoothed_bass) * smoothingWeight(audio_frame_time, bass_smoothing_time);
+
+        float max_height = std::max(Terrain::maxHeight(current_left), Terrain::maxHeight(current_right));
+        float max_slope = std::max(Terrain::maxSlope(prev_left, prev_right), Terrain::maxSlope(current_left, current_right));
+
+        AudioParams params = {
+            coeffs[0], coeffs[1], coeffs[2], smoothed_bass, max_height, beat.onset_strength, beat.beat_phase,
+            spectrumHead(snapshot.time_ns),
+            left.bass, left.mid, left.high,
+            right.bass, right.mid, right.high,
+            (float)std::min(uploaded_columns, (Uint64)SPECTRUM_COLUMNS),
+            max_slope
+        };
+        return params;
+    }
 
-        // AUTO MOVEMENT
-        cam_x += forward_x * auto_direction_x * move_speed * 0.5f;
-        cam_y += auto_direction_y * move_speed * 0.5f;
-        cam_z += forward_z * auto_direction_z * move_speed * 0.5f;
-        cam_yaw += 0.2f * auto_yaw_direction * delta_time;  // Slowly spin yaw
+    void updateCamera(float delta_time) {
+        // stepCamera() advances elapsed_time after this, so the pose is for the new time
+        float time = elapsed_time + delta_time;
+        CameraPath::Pose pose;
+        if (camera_director.isRunning()) {
+            pose = directedPose(time);
+        } else {
+            pose = camera_path.sample(time);
+        }
 
-        // Update auto movement timer and randomly change direction
-        auto_movement_timer += delta_time;
-        if (auto_movement_timer >= auto_direction_change_interval) {
-            auto_movement_timer = 0.0f;
+        if (!camera_path.isReplay()) {
+            float move_speed = 0.5f * delta_time;
 
-            // Set next random interval (0.5 - 4 seconds)
-            auto_direction_change_interval = 0.5f + static_cast<float>(rand()) / RAND_MAX * 3.5f;
+            // Calculate forward and right vectors from yaw
+            float yaw = pose.yaw + manual_yaw;
+            float forward_x = sin(yaw);
+            float forward_z = cos(yaw);
+            float right_x = cos(yaw);
+            float right_z = -sin(yaw);
 
-            // Randomly flip any subset of directions (or set to random if 0)
-            if (rand() % 2) {
-                auto_direction_x = (auto_direction_x == 0.0f) ? ((rand() % 2) ? 1.0f : -1.0f) : auto_direction_x * -1.0f;
+            // WASD movement
+            if (key_w) {
+                manual_x += forward_x * move_speed;
+                manual_z += forward_z * move_speed;
             }
-            if (rand() % 2) {
-                auto_direction_y = (auto_direction_y == 0.0f) ? ((rand() % 2) ? 1.0f : -1.0f) : auto_direction_y * -1.0f;
+            if (key_s) {
+                manual_x -= forward_x * move_speed;
+                manual_z -= forward_z * move_speed;
             }
-            if (rand() % 2) {
-                auto_direction_z = (auto_direction_z == 0.0f) ? ((rand() % 2) ? 1.0f : -1.0f) : auto_direction_z * -1.0f;
+            if (key_a) {
+                manual_x -= right_x * move_speed;
+                manual_z -= right_z * move_speed;
             }
-            if (rand() % 2) {
-                auto_yaw_direction = (auto_yaw_direction == 0.0f) ? ((rand() % 2) ? 1.0f : -1.0f) : auto_yaw_direction * -1.0f;
+            if (key_d) {
+                manual_x += right_x * move_speed;
+                manual_z += right_z * move_speed;
             }
+
+            // Vertical movement
+            if (key_space) {
+                manual_y += move_speed;
+            }
+            if (key_shift) {
+                manual_y -= move_speed;
+            }
+
+            // Clamp altitude and pitch, keeping the offsets inside the limits too
+            manual_y = std::min(std::max(pose.y + manual_y, camera_altitude_min), camera_altitude_max) - pose.y;
+            manual_pitch = std::min(std::max(pose.pitch + manual_pitch, -1.5f), 1.5f) - pose.pitch;
+
+            pose.x += manual_x;
+            pose.y += manual_y;
+            pose.z += manual_z;
+            pose.yaw += manual_yaw;
+            pose.pitch += manual_pitch;
+
+            updateGroundLevel(pose, time, delta_time);
+            pose.y += ground_level;
+        }
+
+        cam_x = pose.x;
+        cam_y = pose.y;
+        cam_z = pose.z;
+        cam_yaw = pose.yaw;
+        cam_pitch = pose.pitch;
+        camera_recorder.write(time, pose);
+    }
+
+    // Raises ground_level to the terrain's upper bound at the camera, a ring around it and the
+    // path ahead (when the path is known). Only the centre sample is a guarantee, keeping the
+    // camera itself at least camera_altitude_min above the surface; the others let it climb
+    // early, but a ridge between them is only met once the camera is over it
+    void updateGroundLevel(const CameraPath::Pose& pose, float time, float delta_time) {
+        const int RING = 8;
+        const int AHEAD = 4;
+        float xs[1 + RING + AHEAD];
+        float zs[1 + RING + AHEAD];
+        int count = 0;
+        xs[count] = pose.x;
+        zs[count] = pose.z;
+        count++;
+        for (int i = 0; i < RING; i++) {
+            float angle = 2.0f * SDL_PI_F * i / RING;
+            xs[count] = pose.x + ground_radius * std::cos(angle);
+            zs[count] = pose.z + ground_radius * std::sin(angle);
+            count++;
+        }
+        if (!camera_director.isRunning()) {
+            std::vector<CameraPath::Pose> ahead;
+            camera_path.prefetch(time + ground_lookahead / AHEAD, ground_lookahead / AHEAD, AHEAD, ahead);
+            for (int i = 0; i < AHEAD; i++) {
+                xs[count] = ahead[i].x + manual_x;
+                zs[count] = ahead[i].z + manual_z;
+                count++;
+            }
+        }
+
+        Terrain::Frame frame = {pose.x, pose.z, pose.yaw, current_left, current_right, time, 0.0f};
+        float bounds[1 + RING + AHEAD];
+        Terrain::heightBoundBatch(frame, xs, zs, count, bounds);
+        float ground = *std::max_element(bounds, bounds + count);
+
+        if (!ground_valid || ground > ground_level) {
+            ground_level = ground;
+            ground_valid = true;
+        } else {
+            ground_level += (ground - ground_level) * smoothingWeight(delta_time, ground_fall_time);
         }
+    }
 
-        // WASD movement
-        if (key_w) {
-            cam_x += forward_x * move_speed;
-            cam_z += forward_z * move_speed;
+    // The director's pose for the frame. Live frames take it at their estimated present time
+    // and hold the last pose if the director is behind; recorded frames wait for theirs so
+    // every render of a band file flies the same way
+    CameraPath::Pose directedPose(float time) {
+        bool cut = false;
+        if (record_buffer) {
+            camera_director.waitFor(time);
+        } else {
+            time += presentLatencyNS() / (float)SDL_NS_PER_SECOND;
         }
-        if (key_s) {
-            cam_x -= forward_x * move_speed;
-            cam_z -= forward_z * move_speed;
+        if (camera_director.poseAt(time, director_pose, cut) && cut) {
+            // Reprojecting last frame's depth across a cut only finds the wrong surfaces
+            for (int i = 0; i < view_count; i++) {
+                views[i].depth_history_valid = false;
+            }
         }
-        if (key_a) {
-            cam_x -= right_x * move_speed;
-            cam_z -= right_z * move_speed;
+        return director_pose;
+    }
+
+    // Scene pass for one view: ray march into target (its HDR scene target, or the output
+    // directly) and write this frame's hit distances. False when the draw had to be skipped
+    bool renderScene(SDL_GPUCommandBuffer* cmd, View& view, SDL_GPUTexture* target) {
+        SDL_GPUColorTargetInfo color_targets[2] = {};
+        color_targets[0].texture = target;
+        color_targets[0].clear_color = {0.1f, 0.1f, 0.15f, 1.0f};
+        color_targets[0].load_op = SDL_GPU_LOADOP_CLEAR;
+        color_targets[0].store_op = SDL_GPU_STOREOP_STORE;
+
+        // Every pixel writes its distance, so nothing needs loading
+        color_targets[1].texture = view.depth_history[view.depth_write_index];
+        color_targets[1].load_op = SDL_GPU_LOADOP_DONT_CARE;
+        color_targets[1].store_op = SDL_GPU_STOREOP_STORE;
+
+        SDL_GPURenderPass* pass = SDL_BeginGPURenderPass(cmd, color_targets, 2, nullptr);
+
+        bool drawn = pipeline && vertex_buffer && color_buffer && scene_buffer && depth_sampler &&
+                     spectrum_texture && spectrum_sampler && gradient_texture && gradient_sampler;
+        if (drawn) {
+            SDL_BindGPUGraphicsPipeline(pass, pipeline);
+
+            SDL_GPUBufferBinding vbinding = {};
+            vbinding.buffer = vertex_buffer;
+            vbinding.offset = 0;
+
+            SDL_BindGPUVertexBuffers(pass, 0, &vbinding, 1);
+
+            SDL_GPUTextureSamplerBinding sampler_bindings[3] = {};
+            sampler_bindings[0].texture = view.depth_history[1 - view.depth_write_index];
+            sampler_bindings[0].sampler = depth_sampler;
+            sampler_bindings[1].texture = spectrum_texture;
+            sampler_bindings[1].sampler = spectrum_sampler;
+            sampler_bindings[2].texture = gradient_texture;
+            sampler_bindings[2].sampler = gradient_sampler;
+            SDL_BindGPUFragmentSamplers(pass, 0, sampler_bindings, 3);
+
+            SDL_GPUBuffer* storage_buffers[] = {color_buffer, scene_buffer};
+            SDL_BindGPUFragmentStorageBuffers(pass, 0, storage_buffers, 2);
+
+            // Copied into the command buffer at the draw, so views can push in turn
+            SDL_PushGPUFragmentUniformData(cmd, 0, &view.camera_params, sizeof(CameraParams));
+            SDL_PushGPUFragmentUniformData(cmd, 1, &audio_params, sizeof(AudioParams));
+
+            SDL_DrawGPUPrimitives(pass, 4, 1, 0, 0);
         }
-        if (key_d) {
-            cam_x += right_x * move_speed;
-            cam_z += right_z * move_speed;
+
+        SDL_EndGPURenderPass(pass);
+
+        // A skipped draw leaves the history target undefined (DONT_CARE), so it must not be read
+        if (drawn) {
+            view.depth_write_index = 1 - view.depth_write_index;
+            view.depth_history_valid = true;
+        } else {
+            view.depth_history_valid = false;
         }
+        return drawn;
+    }
+
+    // Loopback test (top half) and recorder (whole frame) downloads share one copy pass
+    void recordReadback(SDL_GPUCommandBuffer* cmd, SDL_GPUTexture* target) {
+        SDL_GPUCopyPass* copy_pass = SDL_BeginGPUCopyPass(cmd);
+
+        SDL_GPUTextureRegion region = {};
+        region.texture = target;
+        region.w = render_width;
+        region.d = 1;
 
-        // Vertical movement
-        if (key_space) {
-            cam_y += move_speed;
+        SDL_GPUTextureTransferInfo dst = {};
+        if (readback_buffer) {
+            region.h = render_height / 2;
+            dst.transfer_buffer = readback_buffer;
+            SDL_DownloadFromGPUTexture(copy_pass, &region, &dst);
         }
-        if (key_shift) {
-            cam_y -= move_speed;
+        if (record_buffer) {
+            region.h = render_height;
+            dst.transfer_buffer = record_buffer;
+            SDL_DownloadFromGPUTexture(copy_pass, &region, &dst);
         }
+        SDL_EndGPUCopyPass(copy_pass);
+    }
 
-        // Clamp Y to min and max
-        if (cam_y < Y_MIN) {
-            cam_y = Y_MIN;
+    // Copies the downloaded frame into a free encoder slot; blocks only when the encoder
+    // has fallen a full ring behind
+    void encodeFrame() {
+        const Uint8* pixels = (const Uint8*)SDL_MapGPUTransferBuffer(gpu_device, record_buffer, false);
+        if (!pixels) {
+            std::cerr << "Failed to map record buffer: " << SDL_GetError() << "\n";
+            running = false;
+            return;
         }
-        if (cam_y > Y_MAX) {
-            cam_y = Y_MAX;
+        Uint8* slot = frame_encoder.acquireSlot();
+        SDL_memcpy(slot, pixels, (size_t)render_width * render_height * 4);
+        SDL_UnmapGPUTransferBuffer(gpu_device, record_buffer);
+        frame_encoder.submitSlot();
+
+        recorded_frames++;
+        if (frame_encoder.hasFailed()) {
+            std::cerr << "Encoder failed, stopping\n";
+            running = false;
+        } else if (record_frame_limit > 0 && recorded_frames >= record_frame_limit) {
+            running = false;
+        }
+    }
+
+    // Sizes a view for this frame. Post-processing acquires a window's swapchain as late as
+    // possible, just before the tonemap writes it, and sizes the scene from the window;
+    // otherwise the scene needs the swapchain up front
+    bool prepareView(SDL_GPUCommandBuffer* cmd, View& view) {
+        view.target = view.offscreen_target;
+        Uint32 target_width = render_width;
+        Uint32 target_height = render_height;
+        if (!headless) {
+            if (post_enabled) {
+                int window_width = 0, window_height = 0;
+                SDL_GetWindowSizeInPixels(view.window, &window_width, &window_height);
+                target_width = (Uint32)std::max(window_width, 0);
+                target_height = (Uint32)std::max(window_height, 0);
+            } else if (!SDL_AcquireGPUSwapchainTexture(cmd, view.window, &view.target, &target_width, &target_height)) {
+                std::cerr << "Failed to acquire swapchain texture: " << SDL_GetError() << "\n";
+                return false;
+            } else if (!view.target) {
+                return false;
+            }
         }
 
-        // Clamp pitch
-        if (cam_pitch > 1.5f) cam_pitch = 1.5f;
-        if (cam_pitch < -1.5f) cam_pitch = -1.5f;
+        if (target_width == 0 || target_height == 0 || !ensureDepthHistory(view, target_width, target_height) ||
+            (post_enabled && !view.post_process.resize(target_width, target_height))) {
+            return false;
+        }
+        view.width = target_width;
+        view.height = target_height;
+        return true;
     }
 
+    // Every view goes into one command buffer behind a single upload pass
     void render() {
-        updateCameraBuffer();
-        updateAudioBuffer();
-
         SDL_GPUCommandBuffer* cmd = SDL_AcquireGPUCommandBuffer(gpu_device);
         if (!cmd) return;
 
-        SDL_GPUTexture* swapchain;
-        if (!SDL_AcquireGPUSwapchainTexture(cmd, window, &swapchain, nullptr, nullptr)) {
-            SDL_CancelGPUCommandBuffer(cmd);
-            return;
+        bool any_active = false;
+        for (size_t i = 0; i < views.size(); i++) {
+            views[i].active = prepareView(cmd, views[i]);
+            views[i].rendered = false;
+            any_active = any_active || views[i].active;
         }
 
-        if (swapchain) {
-            SDL_GPUColorTargetInfo color_target = {};
-            color_target.texture = swapchain;
-            color_target.clear_color = {0.1f, 0.1f, 0.15f, 1.0f};
-            color_target.load_op = SDL_GPU_LOADOP_CLEAR;
-            color_target.store_op = SDL_GPU_STOREOP_STORE;
-
-            SDL_GPURenderPass* pass = SDL_BeginGPURenderPass(cmd, &color_target, 1, nullptr);
-
-            if (pipeline && vertex_buffer && camera_buffer && audio_buffer && color_buffer) {
-                SDL_BindGPUGraphicsPipeline(pass, pipeline);
+        if (any_active) {
+            // Audio first: the camera's height slack depends on this frame's bands
+            applyConfigUpdate();
+            updateAudioParams();
+            for (size_t i = 0; i < views.size(); i++) {
+                if (views[i].active) {
+                    updateCameraParams(views[i]);
+                }
+            }
+            updateColorBuffer();
+            updateSceneBuffer();
+
+            // Camera and audio go in as uniforms; a copy pass is only needed for new spectrum
+            // columns or a changed config
+            if (hasPendingUploads()) {
+                SDL_GPUCopyPass* upload_pass = SDL_BeginGPUCopyPass(cmd);
+                uploadSpectrumColumns(upload_pass);
+                uploadGradient(upload_pass);
+                flushUploads(upload_pass);
+                SDL_EndGPUCopyPass(upload_pass);
+            }
+            frame_timestamps.uploaded_ns = SDL_GetTicksNS();
 
-                SDL_GPUBufferBinding vbinding = {};
-                vbinding.buffer = vertex_buffer;
-                vbinding.offset = 0;
+            for (size_t i = 0; i < views.size(); i++) {
+                View& view = views[i];
+                if (!view.active) continue;
 
-                SDL_BindGPUVertexBuffers(pass, 0, &vbinding, 1);
+                if (!post_enabled) {
+                    view.rendered = renderScene(cmd, view, view.target);
+                    continue;
+                }
 
-                // Metal and SPIR-V now match: camera (0), audio (1), color (2)
-                SDL_GPUBuffer* storage_buffers[] = {camera_buffer, audio_buffer, color_buffer};
-                SDL_BindGPUFragmentStorageBuffers(pass, 0, storage_buffers, 3);
+                bool drawn = renderScene(cmd, view, view.post_process.getSceneTarget());
+                cmd = pass_profiler.endPass(gpu_device, cmd, "scene");
+                view.post_process.renderBloom(cmd, pass_profiler);
 
-                SDL_DrawGPUPrimitives(pass, 4, 1, 0, 0);
+                if (!headless && !SDL_AcquireGPUSwapchainTexture(cmd, view.window, &view.target, nullptr, nullptr)) {
+                    std::cerr << "Failed to acquire swapchain texture: " << SDL_GetError() << "\n";
+                    view.target = nullptr;
+                }
+                if (view.target) {
+                    view.post_process.renderTonemap(cmd, view.target);
+                    cmd = pass_profiler.endPass(gpu_device, cmd, "tonemap");
+                }
+                view.rendered = drawn && view.target != nullptr;
             }
+            // Without post-processing the swapchains were acquired with this command buffer,
+            // so the scenes can't be split across submissions
+            if (!post_enabled) {
+                cmd = pass_profiler.endPass(gpu_device, cmd, "scene");
+            }
+        }
 
-            SDL_EndGPURenderPass(pass);
+        // The first view that reached its target stands for the frame in recordings, the
+        // loopback test and latency stats
+        View* output = nullptr;
+        for (size_t i = 0; i < views.size() && !output; i++) {
+            if (views[i].active && views[i].rendered) {
+                output = &views[i];
+            }
         }
+        if (output && (readback_buffer || record_buffer)) {
+            recordReadback(cmd, output->target);
+        }
+        bool rendered = output != nullptr;
 
         SDL_SubmitGPUCommandBuffer(cmd);
+        frame_timestamps.submitted_ns = SDL_GetTicksNS();
 
         // Wait for GPU to finish rendering
         SDL_WaitForGPUIdle(gpu_device);
+        frame_timestamps.presented_ns = SDL_GetTicksNS();
+
+        if (rendered && frame_timestamps.capture_ns != 0) {
+            latency_tracker.recordFrame(frame_timestamps);
+        }
+        if (rendered && latency_test_clicks > 0) {
+            updateLatencyTest();
+        }
+        if (rendered && record_buffer) {
+            encodeFrame();
+        }
+    }
+
+    // Mean Rec. 709 relative luminance (linear light) of the top half of the last frame, in [0, 1].
+    // Either target format reads back sRGB-encoded bytes
+    float readbackLuminance() {
+        const Uint8* pixels = (const Uint8*)SDL_MapGPUTransferBuffer(gpu_device, readback_buffer, false);
+        if (!pixels) return 0.0f;
+
+        // Every 4th pixel in each direction is plenty for a mean
+        double sum = 0.0;
+        int count = 0;
+        Uint32 rows = render_height / 2;
+        for (Uint32 y = 0; y < rows; y += 4) {
+            const Uint8* row = pixels + (size_t)y * render_width * 4;
+            for (Uint32 x = 0; x < render_width; x += 4) {
+                const Uint8* p = row + x * 4;
+                sum += 0.2126 * SRGB::byteToLinear(p[0]) + 0.7152 * SRGB::byteToLinear(p[1]) +
+                       0.0722 * SRGB::byteToLinear(p[2]);
+                count++;
+            }
+        }
+        SDL_UnmapGPUTransferBuffer(gpu_device, readback_buffer);
+
+        return count > 0 ? (float)(sum / count) : 0.0f;
+    }
+
+    // Injects a click every click_interval and watches for the onset flash in the sky
+    void updateLatencyTest() {
+        float luminance = readbackLuminance();
+        Uint64 now = frame_timestamps.presented_ns;
+
+        if (click_in_flight) {
+            Uint64 click_time = audio_analyzer.getClickTime();
+            float threshold = std::max(0.01f, 4.0f * luminance_deviation);
+
+            // The click only counts once update() has actually mixed it in
+            if (click_time != last_click_time && luminance > luminance_mean + threshold) {
+                double latency_ms = (double)(now - click_time) / SDL_NS_PER_MS;
+                click_latencies.push_back(latency_ms);
+                std::cout << "Click " << clicks_sent << ": " << latency_ms << " ms\n";
+                last_click_time = click_time;
+                click_in_flight = false;
+            } else if (now - click_sent_ns > (Uint64)(click_timeout * SDL_NS_PER_SECOND)) {
+                std::cout << "Click " << clicks_sent << ": not detected\n";
+                last_click_time = click_time;
+                clicks_missed++;
+                click_in_flight = false;
+            }
+            return;
+        }
+
+        // Baseline brightness between clicks
+        if (luminance_mean < 0.0f) {
+            luminance_mean = luminance;
+        }
+        float difference = luminance - luminance_mean;
+        luminance_mean += 0.05f * difference;
+        luminance_deviation += 0.05f * (std::fabs(difference) - luminance_deviation);
+
+        if (clicks_sent >= latency_test_clicks) {
+            printLatencyTestReport();
+            running = false;
+            return;
+        }
+
+        bool warmed_up = elapsed_time > click_warmup;
+        if (warmed_up && now - click_sent_ns > (Uint64)(click_interval * SDL_NS_PER_SECOND)) {
+            audio_analyzer.injectClick();
+            click_sent_ns = now;
+            click_in_flight = true;
+            clicks_sent++;
+        }
+    }
+
+    void printLatencyTestReport() {
+        std::cout << "Loopback latency: " << click_latencies.size() << " of " << clicks_sent << " clicks detected";
+        if (!click_latencies.empty()) {
+            std::cout << ", click->frame p50/p95/p99 "
+                      << LatencyTracker::percentile(click_latencies, 0.5) << " / "
+                      << LatencyTracker::percentile(click_latencies, 0.95) << " / "
+                      << LatencyTracker::percentile(click_latencies, 0.99) << " ms";
+        }
+        std::cout << "\n";
+        latency_tracker.printReport(std::cout);
     }
 
     void handleEvent(const SDL_Event& event) {
+        switch (event.type) {
+            case SDL_EVENT_KEY_DOWN:
+            case SDL_EVENT_MOUSE_BUTTON_DOWN:
+            case SDL_EVENT_MOUSE_MOTION:
+                user_input = true;
+                break;
+        }
+
         switch (event.type) {
             case SDL_EVENT_QUIT:
+            case SDL_EVENT_WINDOW_CLOSE_REQUESTED:  // Closing any view ends the demo
                 running = false;
                 break;
             case SDL_EVENT_KEY_DOWN:
@@ -635,6 +2026,12 @@ public:
                     case SDLK_RSHIFT:
                         key_shift = true;
                         break;
+                    case SDLK_LEFT:
+                    case SDLK_RIGHT:
+                        if (band_file.isOpen()) {
+                            seekBandFile(event.key.key == SDLK_LEFT ? -seek_step : seek_step);
+                        }
+                        break;
                 }
                 break;
             case SDL_EVENT_KEY_UP:
@@ -652,20 +2049,89 @@ public:
                 break;
             case SDL_EVENT_MOUSE_BUTTON_DOWN:
                 if (!mouse_captured) {
-                    SDL_SetWindowRelativeMouseMode(window, true);
+                    SDL_SetWindowRelativeMouseMode(SDL_GetWindowFromID(event.button.windowID), true);
                     mouse_captured = true;
                 }
                 break;
             case SDL_EVENT_MOUSE_MOTION:
                 if (mouse_captured) {
-                    cam_yaw += event.motion.xrel * mouse_sensitivity;
-                    cam_pitch -= event.motion.yrel * mouse_sensitivity;
+                    manual_yaw += event.motion.xrel * mouse_sensitivity;
+                    manual_pitch -= event.motion.yrel * mouse_sensitivity;
                 }
                 break;
         }
     }
 
+    void stepCamera(float delta_time) {
+        updateCamera(delta_time);
+        elapsed_time += delta_time;
+        camera_steps++;
+    }
+
+    // Render farm worker: reads "<first frame> <count> <sink spec>" jobs from stdin, renders
+    // those frames of the band file's track into the sink, and answers "done <first>" (or
+    // "failed <first>") on stdout. The coordinator hands out jobs in increasing order, so the
+    // camera only ever steps forward; skipped frames replay the camera and audio smoothing
+    // without rendering
+    void runWorker() {
+        char line[4096];
+        char spec[4096];
+        while (!stop_requested && std::fgets(line, sizeof(line), stdin)) {
+            unsigned long long first = 0;
+            int count = 0;
+            bool ok = std::sscanf(line, "%llu %d %4095s", &first, &count, spec) == 3 && count > 0 &&
+                      renderJob(first, count, spec);
+            std::printf("%s %llu\n", ok ? "done" : "failed", first);
+            std::fflush(stdout);
+        }
+    }
+
+    bool renderJob(Uint64 first, int count, const std::string& spec) {
+        if (first < camera_steps) {
+            std::cerr << "Worker is past frame " << first << ", it can't step back\n";
+            return false;
+        }
+
+        // Frame n is rendered after n + 1 camera steps, as in run()
+        float delta_time = 1.0f / record_fps;
+        while (camera_steps < first) {
+            stepCamera(delta_time);
+            advanceAudio();
+        }
+
+        // Every chunk starts without depth history: the skipped steps moved the bands further
+        // than the height slack covers, and a chunk must come out the same on any worker
+        for (size_t i = 0; i < views.size(); i++) {
+            views[i].depth_history_valid = false;
+        }
+
+        frame_encoder.setFirstFrameIndex(first);
+        if (!frame_encoder.start(EncoderSink::create(spec), render_width, render_height, record_fps)) {
+            return false;
+        }
+        recorded_frames = 0;
+        record_frame_limit = count;
+        running = true;
+        while (running && !stop_requested) {
+            stepCamera(delta_time);
+            render();
+        }
+
+        bool ok = recorded_frames == count && !frame_encoder.hasFailed();
+        frame_encoder.stop();
+        return ok;
+    }
+
     void run() {
+        if (headless) {
+            std::signal(SIGINT, requestStop);
+            std::signal(SIGTERM, requestStop);
+        }
+        if (worker) {
+            runWorker();
+            return;
+        }
+
         std::cout << "Huawei Ray Marcher with Audio Reactivity\n";
         std::cout << "Controls:\n";
         std::cout << "  Click to capture mouse\n";
@@ -673,6 +2139,9 @@ public:
         std::cout << "  Space/Shift: Move up/down\n";
         std::cout << "  Mouse: Look around\n";
         std::cout << "  ESC or Q: Quit\n";
+        if (band_file.isOpen()) {
+            std::cout << "  Left/Right: Seek " << seek_step << " s\n";
+        }
         std::cout << "\nAudio bands are being analyzed:\n";
         std::cout << "  Bass: 20-250 Hz\n";
         std::cout << "  Mid: 250-4000 Hz\n";
@@ -683,22 +2152,42 @@ public:
 
         while (running) {
             SDL_Event event;
-            while (SDL_PollEvent(&event)) {
+            while (!headless && SDL_PollEvent(&event)) {
                 handleEvent(event);
             }
+            if (stop_requested) {
+                std::cerr << "Interrupted, finishing up\n";
+                break;
+            }
 
             // Calculate delta time
             Uint64 current_frame_time = SDL_GetPerformanceCounter();
             float delta_time = (current_frame_time - last_frame_time) / (float)SDL_GetPerformanceFrequency();
             last_frame_time = current_frame_time;
+            if (record_buffer) {
+                delta_time = 1.0f / record_fps;
+            }
+
+            float prev_x = cam_x, prev_y = cam_y, prev_z = cam_z, prev_yaw = cam_yaw, prev_pitch = cam_pitch;
+            stepCamera(delta_time);
 
-            updateCamera(delta_time);
-            elapsed_time += delta_time;
+            // The path and the director keep flying through silence, and a moving shot
+            // dropped to the idle rate would stutter
+            bool camera_moving = cam_x != prev_x || cam_y != prev_y || cam_z != prev_z ||
+                                 cam_yaw != prev_yaw || cam_pitch != prev_pitch;
+            bool keys_held = key_w || key_s || key_a || key_d || key_space || key_shift;
+            frame_scheduler.reportActivity(audioLevel() > silence_level, user_input || keys_held || camera_moving);
+            user_input = false;
 
             Uint64 frame_start = SDL_GetPerformanceCounter();
             render();
             Uint64 frame_end = SDL_GetPerformanceCounter();
 
+            // A replayed track is a repeatable benchmark run; headless, it ends with the track
+            if (headless && camera_path.isReplay() && elapsed_time >= camera_path.getDuration()) {
+                running = false;
+            }
+
             float frame_time_ms = (frame_end - frame_start) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
 
             frame_count++;
@@ -710,45 +2199,255 @@ public:
                 float fps = frame_count / (elapsed / 1000.0f);
                 auto coeffs = audio_analyzer.getCoefficients();
                 std::cout << "FPS: " << fps << " | Frame time: " << frame_time_ms << " ms";
-                std::cout << " | Audio [Bass: " << coeffs[0] << ", Mid: " << coeffs[1] << ", High: " << coeffs[2] << "]\n";
+                std::cout << " | Audio [Bass: " << coeffs[0] << ", Mid: " << coeffs[1] << ", High: " << coeffs[2] << "]";
+                std::cout << " | " << audio_analyzer.getBpm() << " BPM";
+                if (frame_scheduler.isIdle()) {
+                    std::cout << " | Idle (" << frame_scheduler.getCurrentTargetFps() << " fps cap)";
+                }
+                std::cout << "\n";
+                if (latency_report) {
+                    latency_tracker.printReport(std::cout);
+                }
+                pass_profiler.printReport(std::cout);
+                frame_encoder.printReport(std::cout);
                 frame_count = 0;
                 last_time = current_time;
             }
 
+            frame_scheduler.waitForNextFrame();
         }
     }
 
     ~HuaweiAudioDemo() {
+        config_watcher.stop();
+        scene_watcher.stop();
+        frame_encoder.stop();
+        camera_director.stop();  // Reads band_file
         audio_analyzer.cleanup();
 
         if (vertex_buffer) {
             SDL_ReleaseGPUBuffer(gpu_device, vertex_buffer);
         }
-        if (camera_buffer) {
-            SDL_ReleaseGPUBuffer(gpu_device, camera_buffer);
-        }
-        if (audio_buffer) {
-            SDL_ReleaseGPUBuffer(gpu_device, audio_buffer);
-        }
         if (color_buffer) {
             SDL_ReleaseGPUBuffer(gpu_device, color_buffer);
         }
+        if (scene_buffer) {
+            SDL_ReleaseGPUBuffer(gpu_device, scene_buffer);
+        }
+        for (size_t i = 0; i < views.size(); i++) {
+            views[i].post_process.cleanup();
+            releaseDepthHistory(views[i]);
+            if (views[i].offscreen_target) {
+                SDL_ReleaseGPUTexture(gpu_device, views[i].offscreen_target);
+            }
+        }
+        if (readback_buffer) {
+            SDL_ReleaseGPUTransferBuffer(gpu_device, readback_buffer);
+        }
+        if (record_buffer) {
+            SDL_ReleaseGPUTransferBuffer(gpu_device, record_buffer);
+        }
+        if (depth_sampler) {
+            SDL_ReleaseGPUSampler(gpu_device, depth_sampler);
+        }
+        if (spectrum_texture) {
+            SDL_ReleaseGPUTexture(gpu_device, spectrum_texture);
+        }
+        if (spectrum_sampler) {
+            SDL_ReleaseGPUSampler(gpu_device, spectrum_sampler);
+        }
+        if (spectrum_transfer) {
+            SDL_ReleaseGPUTransferBuffer(gpu_device, spectrum_transfer);
+        }
+        if (gradient_texture) {
+            SDL_ReleaseGPUTexture(gpu_device, gradient_texture);
+        }
+        if (gradient_sampler) {
+            SDL_ReleaseGPUSampler(gpu_device, gradient_sampler);
+        }
+        if (gradient_transfer) {
+            SDL_ReleaseGPUTransferBuffer(gpu_device, gradient_transfer);
+        }
+        if (frame_transfer) {
+            SDL_ReleaseGPUTransferBuffer(gpu_device, frame_transfer);
+        }
         if (pipeline) {
             SDL_ReleaseGPUGraphicsPipeline(gpu_device, pipeline);
         }
         if (gpu_device) {
             SDL_DestroyGPUDevice(gpu_device);
         }
-        if (window) {
-            SDL_DestroyWindow(window);
+        for (size_t i = 0; i < views.size(); i++) {
+            if (views[i].window) {
+                SDL_DestroyWindow(views[i].window);
+            }
         }
         SDL_Quit();
     }
 };
 
+// Height queries per second through height() and heightBatch() over the visible range, and
+// how far the two disagree
+static void benchTerrain() {
+    const int COUNT = 1 << 16;
+    const int BATCH = 256;
+    std::vector<float> xs(COUNT), zs(COUNT), reference(COUNT), batched(COUNT);
+    Uint32 state = 12345;
+    for (int i = 0; i < COUNT; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        float angle = (float)(state & 0xFFFF) / 65536.0f * 2.0f * SDL_PI_F;
+        float distance = (float)(state >> 16) / 65536.0f * Terrain::MAX_DISTANCE;
+        xs[i] = distance * std::cos(angle);
+        zs[i] = distance * std::sin(angle);
+    }
+
+    std::array<float, 3> left = {0.6f, 0.3f, 0.2f};
+    std::array<float, 3> right = {0.5f, 0.4f, 0.1f};
+    Terrain::Frame frame = {0.0f, 0.0f, 0.3f, left, right, 10.0f, 0.0f};
+
+    Uint64 start = SDL_GetTicksNS();
+    for (int i = 0; i < COUNT; i++) {
+        reference[i] = Terrain::height(xs[i], zs[i], frame.cam_x, frame.cam_z, frame.cam_yaw, left, right, frame.time);
+    }
+    Uint64 scalar_ns = SDL_GetTicksNS() - start;
+
+    start = SDL_GetTicksNS();
+    for (int i = 0; i < COUNT; i += BATCH) {
+        Terrain::heightBatch(frame, &xs[i], &zs[i], BATCH, &batched[i]);
+    }
+    Uint64 batch_ns = SDL_GetTicksNS() - start;
+
+    float max_error = 0.0f;
+    for (int i = 0; i < COUNT; i++) {
+        max_error = std::max(max_error, std::fabs(batched[i] - reference[i]));
+    }
+
+    std::cout << "Terrain height, " << COUNT << " points, all octaves:\n";
+    std::cout << "  scalar:  " << COUNT / (scalar_ns / 1e9) / 1e6 << " M/s\n";
+    std::cout << "  " << Terrain::getBatchImplementationName() << " batch of " << BATCH << ": "
+              << COUNT / (batch_ns / 1e9) / 1e6 << " M/s (" << (double)scalar_ns / batch_ns << "x)\n";
+    std::cout << "  max difference " << max_error << "\n";
+}
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n";
+    std::cout << "  --present-mode <vsync|mailbox|immediate>  Swapchain present mode (default vsync)\n";
+    std::cout << "  --fps <n>                                 Frame rate cap, 0 = uncapped (default 0)\n";
+    std::cout << "  --idle-fps <n>                            Frame rate when silent and idle, 0 = off (default 15)\n";
+    std::cout << "  --idle-timeout <seconds>                  Inactivity before idling (default 5)\n";
+    std::cout << "  --audio-device <index>                    Recording device to capture; repeat for several (default 0)\n";
+    std::cout << "  --list-audio-devices                      Print recording devices and exit\n";
+    std::cout << "  --bench-terrain                           Time CPU terrain height queries, scalar against batched, and exit\n";
+    std::cout << "  --headless [WxH]                          Render offscreen, synthetic audio unless a device is given (default 1024x1024)\n";
+    std::cout << "  --views <n>                               Render n views side by side, one window (or offscreen target) each\n";
+    std::cout << "  --view-spacing <degrees>                  Yaw between neighbouring views (default: one view's horizontal FOV)\n";
+    std::cout << "  --latency-report                          Print audio-to-photon latency percentiles every second\n";
+    std::cout << "  --latency-test <clicks>                   Headless loopback test: inject clicks, time their visual response\n";
+    std::cout << "  --no-post                                 Skip HDR bloom/tonemapping, render straight to the output\n";
+    std::cout << "  --profile-passes                          Time each GPU pass (serialises the frame) and print every second\n";
+    std::cout << "  --record <sink>                           Headless: encode every frame; y4m:<file|->, png:<pattern>, libav:<file>\n";
+    std::cout << "  --record-fps <n>                          Recorded frame rate, also the camera's fixed timestep (default 60)\n";
+    std::cout << "  --record-frames <n>                       Stop after n recorded frames, 0 = until killed (default 0)\n";
+    std::cout << "  --band-file <path>                        Audio from a feature track written by analyze, instead of capture\n";
+    std::cout << "  --start <seconds>                         With --band-file: start this far into the track\n";
+    std::cout << "  --worker                                  Render farm worker: take frame ranges on stdin (needs --headless, --band-file)\n";
+    std::cout << "  --camera-seed <n>                         Seed for the automatic camera's path (default 1)\n";
+    std::cout << "  --audio-camera                            Automatic camera speeds up with the music and cuts on strong onsets\n";
+    std::cout << "  --camera-record <file>                    Write the camera's pose every frame, for --camera-replay\n";
+    std::cout << "  --camera-replay <file>                    Fly a recorded camera track instead of the automatic path\n";
+    std::cout << "  --no-srgb                                 Encode sRGB in the shader instead of using an sRGB target\n";
+    std::cout << "  --config <path>                           Color config, reloaded when it changes (default: color_config.yaml\n";
+    std::cout << "                                            in or above the working directory, then next to the executable)\n";
+    std::cout << "  --scene <path>                            SDF objects to add to the terrain, from YAML; reloaded when it changes\n";
+}
+
 int main(int argc, char* argv[]) {
     HuaweiAudioDemo demo;
+    int view_count = 1;
+    float view_spacing = -1.0f;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--present-mode") == 0 && has_value) {
+            FrameScheduler::PresentMode mode;
+            if (!FrameScheduler::parsePresentMode(argv[++i], mode)) {
+                std::cerr << "Unknown present mode: " << argv[i] << "\n";
+                return 1;
+            }
+            demo.setPresentMode(mode);
+        } else if (std::strcmp(argv[i], "--fps") == 0 && has_value) {
+            demo.getFrameScheduler().setTargetFps(std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--idle-fps") == 0 && has_value) {
+            demo.getFrameScheduler().setIdleFps(std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--idle-timeout") == 0 && has_value) {
+            demo.getFrameScheduler().setIdleTimeout(std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--audio-device") == 0 && has_value) {
+            demo.addAudioDevice(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--headless") == 0) {
+            unsigned width = 1024, height = 1024;
+            if (has_value && std::sscanf(argv[i + 1], "%ux%u", &width, &height) == 2) {
+                i++;
+            }
+            demo.setHeadless(width, height);
+        } else if (std::strcmp(argv[i], "--views") == 0 && has_value) {
+            view_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--view-spacing") == 0 && has_value) {
+            view_spacing = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--latency-report") == 0) {
+            demo.setLatencyReport(true);
+        } else if (std::strcmp(argv[i], "--latency-test") == 0 && has_value) {
+            demo.setLatencyTest(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--no-post") == 0) {
+            demo.setPostProcessing(false);
+        } else if (std::strcmp(argv[i], "--profile-passes") == 0) {
+            demo.setProfilePasses(true);
+        } else if (std::strcmp(argv[i], "--record") == 0 && has_value) {
+            demo.setRecording(argv[++i]);
+            // Y4M on stdout is for piping into an encoder; keep the log out of it
+            if (EncoderSink::writesToStdout(argv[i])) {
+                std::cout.rdbuf(std::cerr.rdbuf());
+            }
+        } else if (std::strcmp(argv[i], "--record-fps") == 0 && has_value) {
+            demo.setRecordFps(std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--record-frames") == 0 && has_value) {
+            demo.setRecordFrames(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--band-file") == 0 && has_value) {
+            demo.setBandFile(argv[++i]);
+        } else if (std::strcmp(argv[i], "--start") == 0 && has_value) {
+            demo.setBandStart(std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--worker") == 0) {
+            demo.setWorker(true);
+            // stdout carries the job protocol
+            std::cout.rdbuf(std::cerr.rdbuf());
+        } else if (std::strcmp(argv[i], "--camera-seed") == 0 && has_value) {
+            demo.setCameraSeed((Uint32)std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--audio-camera") == 0) {
+            demo.setAudioCamera(true);
+        } else if (std::strcmp(argv[i], "--camera-record") == 0 && has_value) {
+            demo.setCameraRecord(argv[++i]);
+        } else if (std::strcmp(argv[i], "--camera-replay") == 0 && has_value) {
+            demo.setCameraReplay(argv[++i]);
+        } else if (std::strcmp(argv[i], "--no-srgb") == 0) {
+            demo.setPreferSRGB(false);
+        } else if (std::strcmp(argv[i], "--config") == 0 && has_value) {
+            demo.setConfigPath(argv[++i]);
+        } else if (std::strcmp(argv[i], "--scene") == 0 && has_value) {
+            demo.setScenePath(argv[++i]);
+        } else if (std::strcmp(argv[i], "--list-audio-devices") == 0) {
+            AudioAnalyzer::printRecordingDevices();
+            return 0;
+        } else if (std::strcmp(argv[i], "--bench-terrain") == 0) {
+            benchTerrain();
+            return 0;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
 
+    demo.setViews(view_count, view_spacing);
     if (!demo.initialize()) {
         return 1;
     }
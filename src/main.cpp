@@ -2,6 +2,7 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include "FrameScheduler.h"
 
 class SDL3InputDemo {
 private:
@@ -13,6 +14,8 @@ private:
     int mouseY = 0;
     bool mousePressed = false;
 
+    FrameScheduler frameScheduler;
+
     void handleEvent(const SDL_Event& event) {
         switch (event.type) {
             case SDL_EVENT_QUIT:
@@ -128,6 +131,9 @@ public:
         std::cout << "  - Mouse: Click and move\n";
         std::cout << "  - ESC or Q: Quit\n";
 
+        frameScheduler.setTargetFps(60.0f);
+        frameScheduler.setIdleFps(0.0f);
+
         while (running) {
             SDL_Event event;
             while (SDL_PollEvent(&event)) {
@@ -135,7 +141,7 @@ public:
             }
 
             render();
-            SDL_Delay(16); // ~60 FPS
+            frameScheduler.waitForNextFrame();
         }
 
         std::cout << "SDL3 Input Demo closed.\n";
@@ -0,0 +1,476 @@
+#include <SDL3/SDL.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "AudioAnalyzer.h"
+#include "BandFile.h"
+#include "EncoderSink.h"
+
+// Renders a long track across local worker processes. The audio is analyzed once into a
+// band file that every worker maps, the sequence is cut into chunks handed to whichever
+// worker is free next, and finished chunks are streamed into the output in order
+
+namespace {
+
+struct Options {
+    std::string audio_path;
+    std::string band_path;     // Default: <work_dir>/bands.habf
+    std::string output = "y4m:render.y4m";
+    std::string renderer;      // Default: huawei_audio next to this executable
+    std::string work_dir = "render_farm";
+    std::vector<std::string> renderer_args;  // Passed through after --
+    int workers = 0;           // 0 = one per core
+    int chunk_frames = 60;
+    float fps = 30.0f;
+    float start = 0.0f;        // seconds into the track
+    unsigned width = 1024;
+    unsigned height = 1024;
+    Uint64 frames = 0;         // 0 = the whole track
+};
+
+struct Chunk {
+    Uint64 first;
+    int count;
+    enum State { PENDING, RENDERING, DONE } state;
+};
+
+struct Worker {
+    pid_t pid;
+    int to_worker;       // Its stdin
+    int from_worker;     // Its stdout
+    std::string line;    // Partial reply read so far
+    int chunk;           // Chunk being rendered, -1 when idle
+    Uint64 next_frame;   // Its camera only steps forward, so it takes chunks from here on
+    Uint64 frames_rendered;
+    int chunks_rendered;
+};
+
+// Farm workers are restarted after a crash, but not indefinitely
+const int MAX_RESTARTS = 4;
+
+void setCloseOnExec(int fd) {
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+bool spawnWorker(const Options& options, Worker& worker) {
+    int to_child[2], from_child[2];
+    if (pipe(to_child) != 0 || pipe(from_child) != 0) {
+        std::perror("pipe");
+        return false;
+    }
+    // Other workers must not inherit this one's pipes, or its EOF would never arrive
+    setCloseOnExec(to_child[1]);
+    setCloseOnExec(from_child[0]);
+
+    std::vector<std::string> args;
+    args.push_back(options.renderer);
+    args.push_back("--headless");
+    args.push_back(std::to_string(options.width) + "x" + std::to_string(options.height));
+    args.push_back("--band-file");
+    args.push_back(options.band_path);
+    args.push_back("--record-fps");
+    args.push_back(std::to_string(options.fps));
+    args.push_back("--start");
+    args.push_back(std::to_string(options.start));
+    args.push_back("--worker");
+    args.insert(args.end(), options.renderer_args.begin(), options.renderer_args.end());
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        close(to_child[0]);
+        close(from_child[1]);
+
+        std::vector<char*> argv;
+        for (size_t i = 0; i < args.size(); i++) {
+            argv.push_back(const_cast<char*>(args[i].c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        std::perror(argv[0]);
+        _exit(127);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+    worker.pid = pid;
+    worker.to_worker = to_child[1];
+    worker.from_worker = from_child[0];
+    worker.line.clear();
+    worker.chunk = -1;
+    worker.next_frame = 0;
+    return true;
+}
+
+void closeWorker(Worker& worker) {
+    if (worker.to_worker >= 0) close(worker.to_worker);
+    if (worker.from_worker >= 0) close(worker.from_worker);
+    worker.to_worker = worker.from_worker = -1;
+    if (worker.pid > 0) {
+        int status = 0;
+        waitpid(worker.pid, &status, 0);
+    }
+    worker.pid = -1;
+}
+
+bool isPNG(const std::string& output) {
+    return output.compare(0, 4, "png:") == 0;
+}
+
+std::string chunkPath(const Options& options, const Chunk& chunk) {
+    return options.work_dir + "/chunk_" + std::to_string(chunk.first) + ".y4m";
+}
+
+// PNG output is written by the workers under the frames' own numbers; anything else goes
+// through a Y4M file per chunk that the coordinator appends to the output
+std::string chunkSink(const Options& options, const Chunk& chunk) {
+    return isPNG(options.output) ? options.output : "y4m:" + chunkPath(options, chunk);
+}
+
+bool sendChunk(const Options& options, Worker& worker, std::vector<Chunk>& chunks, int index) {
+    Chunk& chunk = chunks[index];
+    std::string job = std::to_string(chunk.first) + " " + std::to_string(chunk.count) + " " +
+                      chunkSink(options, chunk) + "\n";
+    if (write(worker.to_worker, job.data(), job.size()) != (ssize_t)job.size()) {
+        return false;
+    }
+    chunk.state = Chunk::RENDERING;
+    worker.chunk = index;
+    worker.next_frame = chunk.first + chunk.count;
+    return true;
+}
+
+// Lowest pending chunk this worker's camera can still reach, or -1
+int nextChunkFor(const Worker& worker, const std::vector<Chunk>& chunks) {
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].state == Chunk::PENDING && chunks[i].first >= worker.next_frame) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Streams one chunk's frames into the output
+bool appendChunk(const Options& options, const Chunk& chunk, EncoderSink& sink) {
+    std::string path = chunkPath(options, chunk);
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Missing chunk " << path << "\n";
+        return false;
+    }
+
+    char line[256];
+    unsigned width = 0, height = 0;
+    if (!std::fgets(line, sizeof(line), file) || std::sscanf(line, "YUV4MPEG2 W%u H%u", &width, &height) != 2 ||
+        width != options.width || height != options.height) {
+        std::cerr << "Bad chunk header in " << path << "\n";
+        std::fclose(file);
+        return false;
+    }
+
+    size_t chroma_width = (width + 1) / 2;
+    size_t chroma_height = (height + 1) / 2;
+    std::vector<Uint8> y_plane((size_t)width * height);
+    std::vector<Uint8> u_plane(chroma_width * chroma_height);
+    std::vector<Uint8> v_plane(chroma_width * chroma_height);
+
+    bool ok = true;
+    for (int i = 0; i < chunk.count && ok; i++) {
+        ok = std::fgets(line, sizeof(line), file) && std::strncmp(line, "FRAME", 5) == 0 &&
+             std::fread(y_plane.data(), 1, y_plane.size(), file) == y_plane.size() &&
+             std::fread(u_plane.data(), 1, u_plane.size(), file) == u_plane.size() &&
+             std::fread(v_plane.data(), 1, v_plane.size(), file) == v_plane.size();
+        if (!ok) {
+            std::cerr << "Chunk " << path << " ends after " << i << " of " << chunk.count << " frames\n";
+            break;
+        }
+
+        EncoderSink::Frame frame = {};
+        frame.index = chunk.first + i;
+        frame.y = y_plane.data();
+        frame.u = u_plane.data();
+        frame.v = v_plane.data();
+        frame.y_pitch = (int)width;
+        frame.uv_pitch = (int)chroma_width;
+        ok = sink.write(frame);
+    }
+    std::fclose(file);
+    std::remove(path.c_str());
+    return ok;
+}
+
+bool prepareBandFile(Options& options) {
+    if (options.band_path.empty()) {
+        options.band_path = options.work_dir + "/bands.habf";
+    }
+    if (options.audio_path.empty()) {
+        return true;
+    }
+
+    std::vector<float> samples;
+    int sample_rate = 0, channels = 0;
+    if (!AudioAnalyzer::loadWav(options.audio_path.c_str(), samples, sample_rate, channels)) {
+        return false;
+    }
+
+    Uint64 start = SDL_GetTicksNS();
+    Uint64 frames = samples.size() / channels;
+    if (!BandFile::write(options.band_path, samples.data(), frames, sample_rate, channels)) {
+        return false;
+    }
+    std::cerr << "Analyzed " << (double)frames / sample_rate << " s of audio into " << options.band_path << " in "
+              << (SDL_GetTicksNS() - start) / 1e6 << " ms\n";
+    return true;
+}
+
+int render(Options& options) {
+    if (!SDL_CreateDirectory(options.work_dir.c_str())) {
+        std::cerr << "Failed to create " << options.work_dir << ": " << SDL_GetError() << "\n";
+        return 1;
+    }
+    if (!prepareBandFile(options)) {
+        return 1;
+    }
+
+    BandFile bands;
+    if (!bands.open(options.band_path)) {
+        return 1;
+    }
+    // Frame n shows audio time start + (n + 1) / fps
+    double remaining = std::max((double)bands.getDurationNS() / SDL_NS_PER_SECOND - options.start, 0.0);
+    Uint64 track_frames = (Uint64)(remaining * options.fps);
+    Uint64 total = options.frames > 0 ? std::min(options.frames, track_frames) : track_frames;
+    bands.close();
+    if (total == 0) {
+        std::cerr << "Nothing to render\n";
+        return 1;
+    }
+
+    std::vector<Chunk> chunks;
+    for (Uint64 first = 0; first < total; first += options.chunk_frames) {
+        Chunk chunk = {first, (int)std::min((Uint64)options.chunk_frames, total - first), Chunk::PENDING};
+        chunks.push_back(chunk);
+    }
+
+    std::unique_ptr<EncoderSink> sink;
+    if (!isPNG(options.output)) {
+        sink = EncoderSink::create(options.output);
+        if (!sink || !sink->open(options.width, options.height, options.fps)) {
+            return 1;
+        }
+    }
+
+    if (options.workers <= 0) {
+        options.workers = std::max(1, SDL_GetNumLogicalCPUCores());
+    }
+    options.workers = std::min(options.workers, (int)chunks.size());
+    std::cerr << "Rendering " << total << " frames at " << options.width << "x" << options.height << ", "
+              << options.fps << " fps in " << chunks.size() << " chunks on " << options.workers << " workers\n";
+
+    // A worker that dies shows up as EOF on its pipe, not as a signal here
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Worker> workers(options.workers);
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].frames_rendered = 0;
+        workers[i].chunks_rendered = 0;
+        if (!spawnWorker(options, workers[i])) {
+            return 1;
+        }
+    }
+
+    Uint64 start = SDL_GetTicksNS();
+    Uint64 last_report = start;
+    Uint64 frames_done = 0;
+    size_t next_output = 0;
+    int restarts = 0;
+    bool failed = false;
+
+    while (next_output < chunks.size() && !failed) {
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (workers[i].pid > 0 && workers[i].chunk < 0) {
+                int index = nextChunkFor(workers[i], chunks);
+                if (index >= 0) {
+                    sendChunk(options, workers[i], chunks, index);
+                }
+            }
+        }
+
+        std::vector<pollfd> fds;
+        std::vector<size_t> owners;
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (workers[i].pid > 0 && workers[i].chunk >= 0) {
+                pollfd fd = {workers[i].from_worker, POLLIN, 0};
+                fds.push_back(fd);
+                owners.push_back(i);
+            }
+        }
+        if (fds.empty()) {
+            std::cerr << "No worker can take the remaining chunks\n";
+            failed = true;
+            break;
+        }
+        poll(fds.data(), fds.size(), 1000);
+
+        for (size_t f = 0; f < fds.size(); f++) {
+            if (!(fds[f].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            Worker& worker = workers[owners[f]];
+
+            char buffer[256];
+            ssize_t length = read(worker.from_worker, buffer, sizeof(buffer));
+            if (length <= 0) {
+                // Died mid-chunk: put the chunk back and start a fresh worker, whose camera
+                // can reach any frame
+                std::cerr << "Worker " << worker.pid << " exited during frames " << chunks[worker.chunk].first << "+\n";
+                chunks[worker.chunk].state = Chunk::PENDING;
+                worker.chunk = -1;
+                closeWorker(worker);
+                if (++restarts > MAX_RESTARTS || !spawnWorker(options, worker)) {
+                    std::cerr << "Giving up after " << restarts << " worker failures\n";
+                    failed = true;
+                }
+                continue;
+            }
+
+            worker.line.append(buffer, length);
+            size_t newline;
+            while ((newline = worker.line.find('\n')) != std::string::npos) {
+                std::string reply = worker.line.substr(0, newline);
+                worker.line.erase(0, newline + 1);
+
+                Chunk& chunk = chunks[worker.chunk];
+                if (reply.compare(0, 5, "done ") == 0) {
+                    chunk.state = Chunk::DONE;
+                    worker.frames_rendered += chunk.count;
+                    worker.chunks_rendered++;
+                    frames_done += chunk.count;
+                } else {
+                    std::cerr << "Worker " << worker.pid << " failed frames " << chunk.first << "+\n";
+                    failed = true;
+                }
+                worker.chunk = -1;
+            }
+        }
+
+        // Chunks finish out of order; the output only takes the next one in sequence
+        while (!failed && next_output < chunks.size() && chunks[next_output].state == Chunk::DONE) {
+            if (sink && !appendChunk(options, chunks[next_output], *sink)) {
+                failed = true;
+            }
+            next_output++;
+        }
+
+        Uint64 now = SDL_GetTicksNS();
+        if (now - last_report >= SDL_NS_PER_SECOND) {
+            double seconds = (now - start) / 1e9;
+            std::cerr << "Rendered " << frames_done << " / " << total << " frames, " << frames_done / seconds
+                      << " fps, " << next_output << " chunks written\n";
+            last_report = now;
+        }
+    }
+
+    // EOF on stdin ends each worker
+    for (size_t i = 0; i < workers.size(); i++) {
+        closeWorker(workers[i]);
+    }
+    if (sink) {
+        sink->close();
+    }
+
+    double seconds = (SDL_GetTicksNS() - start) / 1e9;
+    for (size_t i = 0; i < workers.size(); i++) {
+        std::cerr << "  Worker " << i << ": " << workers[i].chunks_rendered << " chunks, "
+                  << workers[i].frames_rendered << " frames\n";
+    }
+    std::cerr << (failed ? "Failed after " : "Rendered ") << frames_done << " frames in " << seconds << " s ("
+              << frames_done / seconds << " fps)\n";
+    return failed ? 1 : 0;
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [-- renderer options]\n";
+    std::cout << "  --audio <file.wav>    Track to render; analyzed once into the band file\n";
+    std::cout << "  --band-file <path>    Feature file to write, or to reuse without --audio (see analyze)\n";
+    std::cout << "                        (default <work-dir>/bands.habf)\n";
+    std::cout << "  --output <sink>       y4m:<file|->, png:<pattern>, libav:<file> (default y4m:render.y4m)\n";
+    std::cout << "  --workers <n>         Worker processes (default one per core)\n";
+    std::cout << "  --chunk <frames>      Frames per job; smaller balances better (default 60)\n";
+    std::cout << "  --fps <n>             Output frame rate (default 30)\n";
+    std::cout << "  --size <WxH>          Frame size (default 1024x1024)\n";
+    std::cout << "  --start <seconds>     Begin this far into the track (default 0)\n";
+    std::cout << "  --frames <n>          Render only the first n frames (default the rest of the track)\n";
+    std::cout << "  --renderer <path>     huawei_audio executable (default next to this one)\n";
+    std::cout << "  --work-dir <dir>      Band file and chunk scratch space (default render_farm)\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--") == 0) {
+            options.renderer_args.assign(argv + i + 1, argv + argc);
+            break;
+        } else if (std::strcmp(argv[i], "--audio") == 0 && has_value) {
+            options.audio_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--band-file") == 0 && has_value) {
+            options.band_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--output") == 0 && has_value) {
+            options.output = argv[++i];
+        } else if (std::strcmp(argv[i], "--workers") == 0 && has_value) {
+            options.workers = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--chunk") == 0 && has_value) {
+            options.chunk_frames = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--fps") == 0 && has_value) {
+            options.fps = (float)std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--size") == 0 && has_value) {
+            if (std::sscanf(argv[++i], "%ux%u", &options.width, &options.height) != 2) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--start") == 0 && has_value) {
+            options.start = std::max(0.0f, (float)std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--frames") == 0 && has_value) {
+            options.frames = (Uint64)std::atoll(argv[++i]);
+        } else if (std::strcmp(argv[i], "--renderer") == 0 && has_value) {
+            options.renderer = argv[++i];
+        } else if (std::strcmp(argv[i], "--work-dir") == 0 && has_value) {
+            options.work_dir = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (options.audio_path.empty() && options.band_path.empty()) {
+        std::cerr << "Need --audio or an existing --band-file\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (options.fps <= 0.0f) {
+        options.fps = 30.0f;
+    }
+    if (options.renderer.empty()) {
+        const char* base = SDL_GetBasePath();
+        options.renderer = std::string(base ? base : "") + "huawei_audio";
+    }
+    // The band file is written before any worker starts, so stdout can carry Y4M output
+    return render(options);
+}
@@ -2,36 +2,84 @@
 
 layout(location = 0) in vec2 fragUV;
 layout(location = 0) out vec4 fragColor;
+layout(location = 1) out float fragDepth;
 
-// Camera parameters from CPU
-layout(set = 2, binding = 0) readonly buffer CameraParams {
+// Previous frame's hit distances, used to seed the marcher
+layout(set = 2, binding = 0) uniform sampler2D depthHistory;
+
+// Audio history ring: x = spectrogram column (one analysis hop each, wrapping),
+// y = log frequency 20 Hz - 20 kHz. R = spectrum level [0, 1], G = raw waveform
+layout(set = 2, binding = 1) uniform sampler2D spectrumHistory;
+
+// Distance colour gradient in linear RGB, baked on the CPU from the config (one row)
+layout(set = 2, binding = 2) uniform sampler2D colorGradient;
+
+// Camera parameters from CPU, pushed per view each frame (std140, scalars only)
+layout(set = 3, binding = 0) uniform CameraParams {
     float pos_x;
     float pos_y;
     float pos_z;
     float yaw;
     float pitch;
     float time;
-    float padding[2];
+    float prev_pos_x;
+    float prev_pos_y;
+    float prev_pos_z;
+    float prev_yaw;
+    float history_valid;
+    float height_slack;
+    float resolution_x;
+    float resolution_y;
+    float pixel_angle;  // Cone angle covered by one pixel, in radians
+    float encode_srgb;  // 1 when the target is UNORM and the shader must encode sRGB itself
 } camera;
 
-// Audio parameters from CPU
-layout(set = 2, binding = 1) readonly buffer AudioParams {
+// Audio parameters from CPU, pushed once per frame (std140, scalars only)
+layout(set = 3, binding = 1) uniform AudioParams {
     float bass;
     float mid;
     float high;
 	float smoothed_bass;
+    float max_height;  // Upper bound of terrainHeightMap() for these bands
+    float onset;       // Onset envelope, ~1 right after an onset
+    float beat_phase;  // 0 on the beat, rising to 1
+    float spectrum_head;  // Column shown as "now" in spectrumHistory, fractional, modulo its width
+    // Per-side bands for stereo panning (both equal the mono bands for mono input)
+    float bass_left;
+    float mid_left;
+    float high_left;
+    float bass_right;
+    float mid_right;
+    float high_right;
+    float spectrum_columns;  // Columns of spectrumHistory written so far (up to its width)
+    float max_slope;         // Upper bound of the terrain's slope, this frame or last
 } audio;
 
-// Color parameters from CPU
-layout(set = 2, binding = 2) readonly buffer ColorParams {
-    float max_color_distance;
-    float saturation;
-    float brightness;
-    float num_stops;
-    // Gradient stops (position, hue) pairs, max 8 stops
-    vec2 stops[8];
+// Color parameters from CPU, only rewritten when the config changes
+layout(set = 2, binding = 3) readonly buffer ColorParams {
+    float max_color_distance;  // Distance at the far end of colorGradient
+    // Quality and march limits, validated on the CPU
+    float max_steps;       // Ray march iteration cap
+    float march_distance;  // Far end of the march, at most u_max_distance
+    float fog;             // Fog strength at march_distance, 0 = none
+    float hit_pixels;      // Hit once the surface is within this many pixel footprints
+    float lod_pixels;      // Drop fbm octaves with a wavelength under this many pixel footprints
+    float quality_tier;    // 0 low .. 3 ultra
+    float padding;
 } color_config;
 
+// SDF scene from --scene, compiled by SceneGraph: a header record, then BVH nodes, objects
+// and their instructions, 32 bytes each (the layout is in SceneGraph.h)
+struct SceneRecord
+{
+    vec4 a;
+    vec4 b;
+};
+
+layout(set = 2, binding = 4) readonly buffer SceneData {
+    SceneRecord records[];
+} scene;
+
 // Constants
 #define PI 3.14159
 #define PI2 6.28318
@@ -39,11 +87,17 @@ layout(set = 2, binding = 2) readonly buffer ColorParams {
 #define EPSILON 1e-10
 
 // Exposed variables
-const int u_max_steps = 200;
-const float u_max_distance = 100.0;
-const float u_fog = 0.5;
+const float u_min_distance = 0.1;
+const float u_max_distance = 100.0;  // Depth history's "nothing hit"; march_distance is capped to it
+const float u_reprojection_safety = 0.9;
+const int FBM_OCTAVES = 8;
+const float SPECTRUM_WIDTH = 256.0;  // Columns in spectrumHistory
+const float u_wave_speed = 0.5;      // World units travelled per spectrum column
+const float u_wave_gain = 1.0;
+const float u_waveform_gain = 0.1;
 const float u_specular = 0.3;
 const float u_light_e_w = 0.5;
+const float u_hash_drift = 1.1;  // Terrain::HASH_DRIFT
 
 // Cubic fade (C1 smooth) - more performant
 vec2 cubicInterpolation(vec2 t)
@@ -51,14 +105,30 @@ vec2 cubicInterpolation(vec2 t)
     return t*t*(3.0 - 2.0*t);
 }
 
-// Random hash
+// PCG2D (Jarzynski and Olano, "Hash Functions for GPU Rendering"). Integer only, so every
+// GPU and Terrain.cpp agree exactly; fract(sin(x) * 43758.5) depends on sin()'s precision
+uvec2 pcg2d(uvec2 v)
+{
+    v = v * 1664525u + 1013904223u;
+    v.x += v.y * 1664525u;
+    v.y += v.x * 1664525u;
+    v = v ^ (v >> 16u);
+    v.x += v.y * 1664525u;
+    v.y += v.x * 1664525u;
+    v = v ^ (v >> 16u);
+    return v;
+}
+
+// Lattice gradient in [-1, 1]^2 at the whole-number point p. Each component drifts slowly
+// with time at its own rate, along a triangle wave so it never jumps
 vec2 hash2(vec2 p)
 {
-    // Add slowly changing time offset to create gradual changes
-    float timeOffset = camera.time * 0.00005;
-    p = vec2(dot(p, vec2(127.1, 311.7)),
-             dot(p, vec2(269.5, 183.3)));
-    return -1.0 + 2.0 * fract(sin(p + timeOffset) * 43758.5453123);
+    uvec2 h = pcg2d(uvec2(ivec2(p)));
+    uvec2 r = pcg2d(h);
+    vec2 phase = vec2(h >> 8u) * (1.0 / 16777216.0);
+    vec2 rate = vec2(r >> 8u) * (2.0 / 16777216.0) - 1.0;
+    vec2 t = phase + rate * (camera.time * u_hash_drift);
+    return 1.0 - 4.0 * abs(fract(t) - 0.5);
 }
 
 float hash1(inout float seed)
@@ -93,19 +163,35 @@ float perlinNoise(vec2 P)
     return nxy*0.5+0.5;
 }
 
+// Number of fbm octaves worth evaluating for a given world-space pixel footprint.
+// Octave i has a world wavelength of 2 / 2^i; the fractional part fades in the last one
+float fbmOctaves(float footprint)
+{
+    return clamp(log2(2.0 / (color_config.lod_pixels * max(footprint, EPSILON))) + 1.0, 1.0, float(FBM_OCTAVES));
+}
+
 // Fractional Brownian Motion
-float fbm(in vec2 uv, vec3 camPos)
+float fbm(in vec2 uv, vec3 camPos, float footprint)
 {
     float value = 0.;
     float amplitude = 1.6;
     float freq = 1.0;
+    float octaves = fbmOctaves(footprint);
 
-    for (int i = 0; i < 8; i++)
+    for (int i = 0; i < FBM_OCTAVES; i++)
     {
+        float weight = clamp(octaves - float(i), 0.0, 1.0);
+        if (weight <= 0.0)
+        {
+            // Culled octaves contribute their mean so the surface doesn't sink with distance
+            value += 0.5 * amplitude * (1.0 - pow(0.4, float(FBM_OCTAVES - i))) / 0.6;
+            break;
+        }
+
         float multiplier = 1.0;
         //if(i < 3) {multiplier =  1.0 + audio.bass*0.2;}
         //if(i > 6) {multiplier =  0.75 + audio.high*0.4;}
-        value += perlinNoise(uv * freq ) * amplitude * multiplier;
+        value += mix(0.5, perlinNoise(uv * freq), weight) * amplitude * multiplier;
         amplitude *= 0.4;
         freq *= 2.0;
     }
@@ -113,15 +199,35 @@ float fbm(in vec2 uv, vec3 camPos)
     return value;
 }
 
-float terrainHeightMap(in vec3 uv, in vec3 camPos)
+// Audio heard (distance / speed) columns ago: the spectrum level at a frequency that falls
+// with distance, like the band mapping, and the waveform. (0, 0) before any history exists
+vec2 pastAudio(float distanceFromCamera)
+{
+    if (audio.spectrum_columns < 1.0) return vec2(0.0);
+
+    float age = min(distanceFromCamera / u_wave_speed, audio.spectrum_columns - 1.0);
+    float u = (audio.spectrum_head - age + 0.5) / SPECTRUM_WIDTH;
+    float v = 1.0 - clamp(distanceFromCamera / u_max_distance, 0.0, 1.0);
+    return textureLod(spectrumHistory, vec2(u, v), 0.0).rg;
+}
+
+float terrainHeightMap(in vec3 uv, in vec3 camPos, float footprint)
 {
-    float height = fbm(uv.xz*0.5, camPos);
+    float height = fbm(uv.xz*0.5, camPos, footprint);
 
     // Calculate distance from camera (horizontal distance only for consistent height zones)
     vec2 camPosXZ = vec2(camPos.x, camPos.z);
     vec2 terrainPosXZ = vec2(uv.x, uv.z);
     float distanceFromCamera = length(terrainPosXZ - camPosXZ);
 
+    // Stereo pan: blend each band between the left and right channel by
+    // which side of the view this point is on
+    vec2 cameraRight = vec2(cos(camera.yaw), -sin(camera.yaw));
+    float side = dot(terrainPosXZ - camPosXZ, cameraRight) / max(distanceFromCamera, EPSILON);
+    vec3 bands = mix(vec3(audio.bass_left, audio.mid_left, audio.high_left),
+                     vec3(audio.bass_right, audio.mid_right, audio.high_right),
+                     side * 0.5 + 0.5);
+
     // Define distance ranges for each frequency band
     // Close range (0-7): High frequencies (treble) - nearby mountains
     // Mid range (7-14): Mid frequencies - middle distance mountains
@@ -131,24 +237,205 @@ float terrainHeightMap(in vec3 uv, in vec3 camPos)
 
     // Close mountains - treble (high frequencies)
     float closeWeight = smoothstep(u_max_distance / 3, 0.0, distanceFromCamera);
-    audioMultiplier += closeWeight * audio.high * 2.5;
+    audioMultiplier += closeWeight * bands.z * 2.5;
 
     // Mid-range mountains - mid frequencies
     float midWeight = smoothstep(0.0, u_max_distance / 3, distanceFromCamera) * smoothstep(u_max_distance*2 / 3, u_max_distance / 3, distanceFromCamera);
-    audioMultiplier += midWeight * audio.mid * 1.5;
+    audioMultiplier += midWeight * bands.y * 1.5;
 
     // Far mountains - bass
     float farWeight = smoothstep(u_max_distance / 3, u_max_distance*2 / 3, distanceFromCamera);
-    audioMultiplier += farWeight * audio.bass * 1.5;
+    audioMultiplier += farWeight * bands.x * 1.5;
+
+    // Past audio travelling outward from the camera
+    vec2 past = pastAudio(distanceFromCamera);
+    audioMultiplier += past.r * u_wave_gain;
 
 	audioMultiplier *= min(0.25, distance(vec2(camPos.x, camPos.z), terrainPosXZ) / 8.);
 
     // Apply audio modulation to height
     height *= (1.0 + audioMultiplier);
+    height += past.g * u_waveform_gain;
 
     return height ;
 }
 
+// Scene opcodes, matching SceneGraph::Op
+#define SCENE_OP_PUSH_POINT 0
+#define SCENE_OP_POP_POINT 1
+#define SCENE_OP_TRANSLATE 2
+#define SCENE_OP_ROTATE 3
+#define SCENE_OP_SCALE 4
+#define SCENE_OP_REPEAT 5
+#define SCENE_OP_SPHERE 6
+#define SCENE_OP_BOX 7
+#define SCENE_OP_TORUS 8
+#define SCENE_OP_CYLINDER 9
+#define SCENE_OP_PLANE 10
+#define SCENE_OP_UNION 11
+#define SCENE_OP_INTERSECT 12
+#define SCENE_OP_SUBTRACT 13
+
+const int SCENE_STACK = 8;       // SceneGraph::MAX_STACK
+const int SCENE_BVH_STACK = 32;  // SceneGraph::BVH_STACK
+
+// Distance from p to a record's box, 0 inside: nothing in the box can be closer
+float sceneBoxDistance(SceneRecord box, vec3 p)
+{
+    return length(max(max(box.a.xyz - p, p - box.b.xyz), 0.0));
+}
+
+// Polynomial smooth minimum, at most k / 4 below min(a, b); k = 0 is the plain minimum
+float sceneSmoothMin(float a, float b, float k)
+{
+    if (k <= 0.0) return min(a, b);
+    float h = max(k - abs(a - b), 0.0) / k;
+    return min(a, b) - h * h * k * 0.25;
+}
+
+// Runs one object's program at p. The point carries its accumulated scale in w, which
+// each shape's distance is multiplied back by
+float sceneObjectDistance(SceneRecord object, vec3 p, int instructionOffset)
+{
+    vec4 points[SCENE_STACK];
+    float distances[SCENE_STACK];
+    int pointCount = 0;
+    int distanceCount = 0;
+    vec4 q = vec4(p, 1.0);
+
+    int first = instructionOffset + int(object.a.w);
+    int end = first + int(object.b.w);
+    for (int i = first; i < end; i++)
+    {
+        vec4 a = scene.records[i].a;
+        vec4 b = scene.records[i].b;
+        int op = int(a.x);
+
+        switch (op)
+        {
+        case SCENE_OP_PUSH_POINT:
+            points[pointCount++] = q;
+            break;
+        case SCENE_OP_POP_POINT:
+            q = points[--pointCount];
+            break;
+        case SCENE_OP_TRANSLATE:
+            q.xyz -= a.yzw;
+            break;
+        case SCENE_OP_ROTATE:
+            q.xyz += 2.0 * cross(b.xyz, cross(b.xyz, q.xyz) + b.w * q.xyz);
+            break;
+        case SCENE_OP_SCALE:
+            q.xyz /= a.y;
+            q.w *= a.y;
+            break;
+        case SCENE_OP_REPEAT:
+            // Nearest cell within the count; a zero period (and count) leaves the axis alone
+            q.xyz -= a.yzw * clamp(round(q.xyz / max(a.yzw, vec3(1e-6))), -b.xyz, b.xyz);
+            break;
+        case SCENE_OP_SPHERE:
+            distances[distanceCount++] = (length(q.xyz) - a.y) * q.w;
+            break;
+        case SCENE_OP_BOX:
+        {
+            vec3 e = abs(q.xyz) - a.yzw + b.x;
+            distances[distanceCount++] = (length(max(e, 0.0)) + min(max(e.x, max(e.y, e.z)), 0.0) - b.x) * q.w;
+            break;
+        }
+        case SCENE_OP_TORUS:
+            distances[distanceCount++] = (length(vec2(length(q.xz) - a.y, q.y)) - a.z) * q.w;
+            break;
+        case SCENE_OP_CYLINDER:
+        {
+            vec2 e = abs(vec2(length(q.xz), q.y)) - a.yz;
+            distances[distanceCount++] = (min(max(e.x, e.y), 0.0) + length(max(e, 0.0))) * q.w;
+            break;
+        }
+        case SCENE_OP_PLANE:
+            distances[distanceCount++] = q.y * q.w;
+            break;
+        default:
+        {
+            // CSG over the top two distances
+            float d2 = distances[--distanceCount];
+            float d1 = distances[distanceCount - 1];
+            if (op == SCENE_OP_UNION) d1 = sceneSmoothMin(d1, d2, a.y);
+            else if (op == SCENE_OP_INTERSECT) d1 = -sceneSmoothMin(-d1, -d2, a.y);
+            else d1 = -sceneSmoothMin(-d1, d2, a.y);
+            distances[distanceCount - 1] = d1;
+            break;
+        }
+        }
+    }
+    return distances[0];
+}
+
+// Nearest scene surface, or bound if nothing is closer. Objects and BVH nodes whose boxes
+// are no closer than the best so far are skipped, so with bound set to the step the march
+// would take anyway, only what that step could reach is evaluated
+float sceneDistance(vec3 p, float bound)
+{
+    SceneRecord header = scene.records[0];
+    int nodeOffset = int(header.b.x);
+    int objectOffset = int(header.b.y);
+    int instructionOffset = int(header.b.z);
+    float best = bound;
+
+    // Unbounded objects (infinite planes, endless repetition) sit outside the hierarchy
+    for (int i = 0; i < int(header.a.z); i++)
+    {
+        SceneRecord object = scene.records[objectOffset + i];
+        if (sceneBoxDistance(object, p) < best)
+        {
+            best = min(best, sceneObjectDistance(object, p, instructionOffset));
+        }
+    }
+    if (header.a.x < 1.0) return best;
+
+    int stack[SCENE_BVH_STACK];
+    int stackSize = 1;
+    stack[0] = 0;
+    while (stackSize > 0)
+    {
+        SceneRecord node = scene.records[nodeOffset + stack[--stackSize]];
+        if (sceneBoxDistance(node, p) >= best) continue;
+
+        int first = int(node.a.w);
+        int count = int(node.b.w);
+        if (count > 0)
+        {
+            for (int i = first; i < first + count; i++)
+            {
+                SceneRecord object = scene.records[objectOffset + i];
+                if (sceneBoxDistance(object, p) < best)
+                {
+                    best = min(best, sceneObjectDistance(object, p, instructionOffset));
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top, so it can tighten best before the other is tested
+        float left = sceneBoxDistance(scene.records[nodeOffset + first], p);
+        float right = sceneBoxDistance(scene.records[nodeOffset + first + 1], p);
+        int nearChild = left < right ? first : first + 1;
+        if (max(left, right) < best) stack[stackSize++] = left < right ? first + 1 : first;
+        if (min(left, right) < best) stack[stackSize++] = nearChild;
+    }
+    return best;
+}
+
+// Tetrahedral differences half a pixel footprint apart, like the terrain's
+vec3 sceneNormal(vec3 p, float footprint)
+{
+    vec2 k = vec2(1.0, -1.0);
+    float h = 0.5 * footprint;
+    return normalize(k.xyy * sceneDistance(p + k.xyy * h, u_max_distance) +
+                     k.yyx * sceneDistance(p + k.yyx * h, u_max_distance) +
+                     k.yxy * sceneDistance(p + k.yxy * h, u_max_distance) +
+                     k.xxx * sceneDistance(p + k.xxx * h, u_max_distance));
+}
+
 vec3 stepCountCostColor(float bias)
 {
     vec3 offset = vec3(0.938, 0.328, 0.718);
@@ -161,10 +448,12 @@ vec3 stepCountCostColor(float bias)
 
 vec3 getNormal(vec3 rayTerrainIntersection, float t, vec3 camPos)
 {
-    vec3 eps = vec3(.001 * t, .0, .0);
-    vec3 n = vec3(terrainHeightMap(rayTerrainIntersection - eps.xyy, camPos) - terrainHeightMap(rayTerrainIntersection + eps.xyy, camPos),
+    // Half a pixel footprint: finer differences only add aliasing
+    float footprint = camera.pixel_angle * t;
+    vec3 eps = vec3(0.5 * footprint, .0, .0);
+    vec3 n = vec3(terrainHeightMap(rayTerrainIntersection - eps.xyy, camPos, footprint) - terrainHeightMap(rayTerrainIntersection + eps.xyy, camPos, footprint),
                 2. * eps.x,
-                terrainHeightMap(rayTerrainIntersection - eps.yyx, camPos) - terrainHeightMap(rayTerrainIntersection + eps.yyx, camPos));
+                terrainHeightMap(rayTerrainIntersection - eps.yyx, camPos, footprint) - terrainHeightMap(rayTerrainIntersection + eps.yyx, camPos, footprint));
 
     return normalize(n);
 }
@@ -199,20 +488,25 @@ mat3 computeViewMatrix(float yaw, float pitch)
     return mat3(right, up, forward);
 }
 
+// sRGB transfer function, the same curve *_UNORM_SRGB targets apply on store
 vec3 toLinear(vec3 inputColor)
 {
-    inputColor.x = pow(inputColor.x, 2.2);
-    inputColor.y = pow(inputColor.y, 2.2);
-    inputColor.z = pow(inputColor.z, 2.2);
-    return inputColor;
+    vec3 low = inputColor / 12.92;
+    vec3 high = pow((inputColor + 0.055) / 1.055, vec3(2.4));
+    return mix(high, low, lessThanEqual(inputColor, vec3(0.04045)));
 }
 
 vec3 tosRGB(vec3 inputColor)
 {
-    inputColor.x = pow(inputColor.x, 1.0/2.2);
-    inputColor.y = pow(inputColor.y, 1.0/2.2);
-    inputColor.z = pow(inputColor.z, 1.0/2.2);
-    return inputColor;
+    vec3 low = inputColor * 12.92;
+    vec3 high = 1.055 * pow(inputColor, vec3(1.0 / 2.4)) - 0.055;
+    return mix(high, low, lessThanEqual(inputColor, vec3(0.0031308)));
+}
+
+// Linear colour to what the target stores: sRGB targets encode in hardware
+vec3 encodeOutput(vec3 linearColor)
+{
+    return camera.encode_srgb > 0.5 ? tosRGB(linearColor) : linearColor;
 }
 
 // HSV to RGB conversion
@@ -223,32 +517,123 @@ vec3 hsv2rgb(vec3 c)
     return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
 }
 
-vec2 rayMarching(in vec3 rayOrigin, in vec3 rayDirection, in float minDistance, in float maxDistance, inout vec3 intPos, inout float seed)
+// Where a point lands on this frame's screen, in pixels from fragUV; z <= 0 behind the camera
+vec3 projectToPixel(vec3 position, vec3 rayOrigin, mat3 viewMatrix, vec2 fragUV, float screenRatio)
+{
+    vec3 local = transpose(viewMatrix) * (position - rayOrigin);
+    vec2 uv = local.xy / max(local.z, EPSILON);
+    uv.x /= screenRatio;
+    vec2 resolution = vec2(camera.resolution_x, camera.resolution_y);
+    return vec3((uv * 0.5 + 0.5 - fragUV) * resolution, local.z);
+}
+
+// Conservative starting distance for this ray from last frame's depth buffer. Last frame's
+// depth at this pixel only picks a 2x2 footprint of the history; each texel there is then
+// moved forward on its own, rebuilding its hit point from its own depth along last frame's
+// ray. The start is the nearest of them, and only when all four land beside this pixel:
+// anything else (parallax onto another surface, disocclusion) marches from scratch
+float reprojectedStartDistance(vec3 rayOrigin, vec3 rayDirection, vec2 fragUV, float screenRatio)
+{
+    if (camera.history_valid < 0.5)
+    {
+        return u_min_distance;
+    }
+
+    vec3 prevCamPosition = vec3(camera.prev_pos_x, camera.prev_pos_y, camera.prev_pos_z);
+    mat3 prevViewMatrix = computeViewMatrix(camera.prev_yaw, 0.);
+    mat3 viewMatrix = computeViewMatrix(camera.yaw, 0.);
+
+    float guessDistance = texture(depthHistory, vec2(fragUV.x, 1.0 - fragUV.y)).r;
+    vec3 guessPosition = rayOrigin + rayDirection * guessDistance;
+    vec3 prevLocal = transpose(prevViewMatrix) * (guessPosition - prevCamPosition);
+    if (prevLocal.z <= 0.0)
+    {
+        return u_min_distance;
+    }
+    vec2 prevUV = prevLocal.xy / prevLocal.z;
+    prevUV.x /= screenRatio;
+    prevUV = prevUV * 0.5 + 0.5;
+
+    ivec2 historySize = textureSize(depthHistory, 0);
+    ivec2 base = ivec2(floor(vec2(prevUV.x, 1.0 - prevUV.y) * vec2(historySize) - 0.5));
+    if (any(lessThan(base, ivec2(0))) || any(greaterThanEqual(base + 1, historySize)))
+    {
+        return u_min_distance;
+    }
+
+    float nearest = u_max_distance;
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 texel = base + ivec2(i & 1, i >> 1);
+        float depth = texelFetch(depthHistory, texel, 0).r;
+
+        // Last frame's ray through this texel, as main() builds it
+        vec2 texelUV = (vec2(texel) + 0.5) / vec2(historySize);
+        vec2 screen = vec2(texelUV.x, 1.0 - texelUV.y) * 2.0 - 1.0;
+        screen.x *= screenRatio;
+        vec3 prevDirection = normalize(prevViewMatrix * vec3(screen, 1.0));
+        vec3 position = prevCamPosition + prevDirection * depth;
+
+        // Texels of a 2x2 footprint sit within a pixel of each other
+        vec3 landing = projectToPixel(position, rayOrigin, viewMatrix, fragUV, screenRatio);
+        if (landing.z <= 0.0 || max(abs(landing.x), abs(landing.y)) > 1.5)
+        {
+            return u_min_distance;
+        }
+        nearest = min(nearest, distance(position, rayOrigin));
+    }
+
+    // The terrain may have risen by up to height_slack since. Walking back along the ray from
+    // where it met last frame's surfaces, the gap under it grows at least as fast as the ray
+    // descends less the steepest slope, so a rise pulls the hit in by at most slack / that
+    // rate. Rays no steeper than the terrain can meet a raised ridge anywhere
+    float heightSlack = 0.0;
+    if (camera.height_slack > 0.0)
+    {
+        float descent = -rayDirection.y - audio.max_slope * length(rayDirection.xz);
+        if (descent <= 0.01)
+        {
+            return u_min_distance;
+        }
+        heightSlack = camera.height_slack / descent;
+    }
+
+    return max((nearest - heightSlack) * u_reprojection_safety, u_min_distance);
+}
+
+// Returns {distance, steps taken}. hit is set when the ray stopped on a surface within
+// maxDistance, including on the very first step; sceneHit when that surface is an object
+vec2 rayMarching(in vec3 rayOrigin, in vec3 rayDirection, in float minDistance, in float maxDistance, inout vec3 intPos, inout float seed, out bool hit, out bool sceneHit)
 {
     float intersectionDistance = minDistance;
-    float finalStepCount = 1.0;
-    float MAX_HEIGHT = 10.0;
+    int maxSteps = int(color_config.max_steps);
+    hit = false;
+    sceneHit = false;
 
-    for(int i = 0; i < u_max_steps; i++)
+    for(int i = 0; i < maxSteps; i++)
     {
         vec3 pos = rayOrigin + intersectionDistance*rayDirection;
-        float height = pos.y - terrainHeightMap(pos, rayOrigin);
-        if(abs(height) < (0.01 * intersectionDistance) || intersectionDistance > maxDistance)
+        float pixelFootprint = camera.pixel_angle * intersectionDistance;
+        float hitDistance = color_config.hit_pixels * pixelFootprint;
+        float height = pos.y - terrainHeightMap(pos, rayOrigin, pixelFootprint);
+        float stepLength = (0.35 + hash1(seed)) * height;
+        float objectDistance = sceneDistance(pos, max(stepLength, hitDistance));
+        sceneHit = objectDistance < hitDistance;
+        hit = abs(height) < hitDistance || sceneHit;
+        if(hit || intersectionDistance > maxDistance)
         {
-            finalStepCount = float(i);
+            hit = hit && intersectionDistance <= maxDistance;
+            sceneHit = sceneHit && hit;
             intPos = pos;
-            break;
+            return vec2(intersectionDistance, float(i));
         }
-        if(pos.y > MAX_HEIGHT)
-        {
-            finalStepCount = -1.0;
-            intersectionDistance = -1.0;
-            break;
-        }
-        intersectionDistance += (0.35 + hash1(seed)) * height;
+        intersectionDistance += min(stepLength, objectDistance);
     }
 
-    return vec2(intersectionDistance, finalStepCount);
+    // Out of steps short of maxDistance: still converging on a surface, so shade it there
+    hit = intersectionDistance <= maxDistance;
+    intPos = rayOrigin + intersectionDistance*rayDirection;
+    return vec2(intersectionDistance, float(maxSteps));
 }
 
 vec3 computeShading(vec3 terrainColor, vec3 lightColor, vec3 normal, vec3 lightDirection, vec3 viewDirection, vec3 skyColor, float terrainHeight)
@@ -292,18 +677,60 @@ float generateStars(vec3 rayDir)
     return 0.0;
 }
 
+// Clips [tMin, tMax] to the part of the ray below the terrain's highest possible point.
+// Returns false when the ray can never touch the terrain
+bool clipToTerrainSlab(vec3 rayOrigin, vec3 rayDirection, inout float tMin, inout float tMax)
+{
+    float top = audio.max_height;
+    if (rayOrigin.y > top)
+    {
+        if (rayDirection.y >= 0.0)
+        {
+            return false;
+        }
+        tMin = max(tMin, (rayOrigin.y - top) / -rayDirection.y);
+    }
+    else if (rayDirection.y > 0.0)
+    {
+        tMax = min(tMax, (top - rayOrigin.y) / rayDirection.y);
+    }
+    return tMin < tMax;
+}
+
+// Clips [tMin, tMax] to the scene's bounds. Returns false when the ray can't reach any object
+bool clipToSceneBounds(vec3 rayOrigin, vec3 rayDirection, inout float tMin, inout float tMax)
+{
+    SceneRecord header = scene.records[0];
+    if (header.a.z > 0.0) return tMin < tMax;  // Unbounded objects can be anywhere
+    if (header.a.x < 1.0) return false;
+
+    // Inverse direction kept finite: an axis-parallel ray starting on a slab plane would
+    // otherwise give 0 / 0, and the NaN would decide the whole test
+    vec3 directionSign = mix(vec3(1.0), vec3(-1.0), lessThan(rayDirection, vec3(0.0)));
+    vec3 inverseDirection = directionSign / max(abs(rayDirection), vec3(1e-6));
+
+    SceneRecord root = scene.records[int(header.b.x)];
+    vec3 t0 = (root.a.xyz - rayOrigin) * inverseDirection;
+    vec3 t1 = (root.b.xyz - rayOrigin) * inverseDirection;
+    vec3 tNear = min(t0, t1);
+    vec3 tFar = max(t0, t1);
+    tMin = max(tMin, max(tNear.x, max(tNear.y, tNear.z)));
+    tMax = min(tMax, min(tFar.x, min(tFar.y, tFar.z)));
+    return tMin < tMax;
+}
+
 vec3 stars(vec2 fragUV) {
   float x = fragUV.x - 0.5;
   float y = fragUV.y;
 
   float dist = sqrt(x*x + y*y);
   float spacing = 0.2;
-  float line_width = 0.05 * max(1, audio.smoothed_bass);
-  float speed = 0.1;
+  float punch = max(audio.smoothed_bass, audio.onset);
+  float line_width = 0.05 * max(1, punch);
 
-  // Correctly animate the distance before creating the pattern
-  vec3 booster = vec3(audio.smoothed_bass, audio.smoothed_bass, audio.smoothed_bass);
-  float animated_dist = dist - mod(camera.time * speed, spacing);
+  // One ring leaves the centre per beat
+  vec3 booster = vec3(punch, punch, punch);
+  float animated_dist = dist - audio.beat_phase * spacing;
   float pattern = fract(animated_dist / spacing);
 
   float circle = smoothstep(0.5 - line_width, 0.5, pattern) - smoothstep(0.5, 0.5 + line_width, pattern);
@@ -319,7 +746,7 @@ vec3 stars(vec2 fragUV) {
 void main()
 {
     vec2 uv = fragUV * 2.0 - 1.0;
-    vec2 iResolution = vec2(1024.0, 1024.0);
+    vec2 iResolution = vec2(camera.resolution_x, camera.resolution_y);
     float screenRatio = iResolution.x / iResolution.y;
     uv.x *= screenRatio;
 
@@ -336,64 +763,70 @@ void main()
     vec3 rayOrigin = camPosition;
     vec3 rayDirection = normalize(viewMatrix * vec3(uv.xy, 1.0));
 
+    vec3 skyColor = vec3(0.0);
+
+    // Sky pass: rays that neither dip below the terrain's highest point nor reach the scene's
+    // bounds skip marching entirely.
+    // Misses are stored as max distance so the next frame reads them as "nothing closer"
+    float marchStart = u_min_distance;
+    float marchEnd = min(color_config.march_distance, u_max_distance);
+    float terrainStart = marchStart;
+    float terrainEnd = marchEnd;
+    float sceneStart = marchStart;
+    float sceneEnd = marchEnd;
+    bool terrainVisible = clipToTerrainSlab(rayOrigin, rayDirection, terrainStart, terrainEnd);
+    bool sceneVisible = clipToSceneBounds(rayOrigin, rayDirection, sceneStart, sceneEnd);
+    if (!terrainVisible && !sceneVisible)
+    {
+        fragDepth = u_max_distance;
+        fragColor = vec4(encodeOutput(stars(fragUV)), 1.0);
+        return;
+    }
+    marchStart = min(terrainVisible ? terrainStart : marchEnd, sceneVisible ? sceneStart : marchEnd);
+    marchEnd = max(terrainVisible ? terrainEnd : marchStart, sceneVisible ? sceneEnd : marchStart);
+
     float seed = fragUV.x + fragUV.y * iResolution.x;
     vec3 intPos;
-    vec2 rayCollision = rayMarching(rayOrigin, rayDirection, 0.1, u_max_distance, intPos, seed);
+    float startDistance = max(marchStart, reprojectedStartDistance(rayOrigin, rayDirection, fragUV, screenRatio));
+    bool terrainHit;
+    bool sceneHit;
+    vec2 rayCollision = rayMarching(rayOrigin, rayDirection, startDistance, marchEnd, intPos, seed, terrainHit, sceneHit);
     float intersectionDistance = rayCollision.x;
 
-    float normalizedStepCost = rayCollision.y / float(u_max_steps);
-    float normalizedDistance = intersectionDistance / u_max_distance;
+    fragDepth = terrainHit ? intersectionDistance : u_max_distance;
+
+    float normalizedStepCost = rayCollision.y / color_config.max_steps;
+    float normalizedDistance = clamp(intersectionDistance / color_config.march_distance, 0.0, 1.0);
 
     float terrainHeight = intPos.y / 2.0;
     terrainHeight = smoothstep(0.7, 0.78, terrainHeight);
 
     vec3 finalColor = vec3(0.0);
 
-    vec3 skyColor = vec3(0.0);
-
     // Add stars to sky
     // float stars = generateStars(rayDirection);
     // finalColor = skyColor + vec3(stars);
     finalColor = stars(fragUV);
 
-    if (intersectionDistance < u_max_distance && rayCollision.y > 0.)
+    if (terrainHit)
     {
         vec3 rayTerrainIntersection = rayOrigin + rayDirection * intersectionDistance;
-        vec3 terrainNormal = getNormal(rayTerrainIntersection, intersectionDistance, rayOrigin);
+        vec3 terrainNormal = sceneHit ? sceneNormal(rayTerrainIntersection, camera.pixel_angle * intersectionDistance)
+                                      : getNormal(rayTerrainIntersection, intersectionDistance, rayOrigin);
         vec3 viewDirection = normalize(rayOrigin - rayTerrainIntersection);
 
-        // Calculate distance from camera for HSV color
+        // Distance along the gradient, mapped onto texel centres
         float distanceFromCamera = length(rayTerrainIntersection - camPosition);
-
         float t = clamp(distanceFromCamera / color_config.max_color_distance, 0.0, 1.0);
-
-        // Interpolate hue based on gradient stops
-        float hue = 0.0;
-        int num_stops = int(color_config.num_stops);
-
-        for (int i = 0; i < num_stops - 1; i++) {
-            float pos1 = color_config.stops[i].x;
-            float pos2 = color_config.stops[i + 1].x;
-
-            if (t >= pos1 && t <= pos2) {
-                float hue1 = color_config.stops[i].y;
-                float hue2 = color_config.stops[i + 1].y;
-                float segment_t = (t - pos1) / (pos2 - pos1);
-                hue = mix(hue1, hue2, segment_t);
-                break;
-            }
-        }
-
-        // Create HSV color using config values
-        vec3 hsvColor = vec3(hue, color_config.saturation, color_config.brightness);
-        vec3 albedo = toLinear(hsv2rgb(hsvColor));
+        float gradientTexels = float(textureSize(colorGradient, 0).x);
+        float gradientU = (t * (gradientTexels - 1.0) + 0.5) / gradientTexels;
+        vec3 albedo = textureLod(colorGradient, vec2(gradientU, 0.5), 0.0).rgb;
 
         vec3 terrainShading = computeShading(albedo, lightColor, terrainNormal, lightDirection, viewDirection, skyColor, terrainHeight);
 
-        normalizedDistance = mix(0.0, pow(normalizedDistance, 0.9), u_fog);
+        normalizedDistance = mix(0.0, pow(normalizedDistance, 0.9), color_config.fog);
         finalColor = mix(terrainShading, skyColor, normalizedDistance);
     }
 
-    finalColor = tosRGB(finalColor);
-    fragColor = vec4(finalColor, 1.0);
+    fragColor = vec4(encodeOutput(finalColor), 1.0);
 }
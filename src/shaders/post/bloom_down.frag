@@ -0,0 +1,45 @@
+#version 450
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 0) out vec4 fragColor;
+
+layout(set = 2, binding = 0) uniform sampler2D source;
+
+layout(set = 3, binding = 0) uniform BloomParams {
+    vec2 source_texel;  // 1 / source size
+    float threshold;    // Brightness where bloom starts
+    float knee;         // Soft transition below the threshold
+    float prefilter;    // 1 on the first downsample, from the scene
+    float padding0;
+    float padding1;
+    float padding2;
+} params;
+
+// Scales colour down to what's over the threshold, with a quadratic knee instead of a hard cut
+vec3 prefilterColor(vec3 color)
+{
+    float brightness = max(color.r, max(color.g, color.b));
+    float soft = clamp(brightness - params.threshold + params.knee, 0.0, 2.0 * params.knee);
+    soft = soft * soft / (4.0 * params.knee);
+    float contribution = max(soft, brightness - params.threshold) / max(brightness, 1e-4);
+    return color * contribution;
+}
+
+// Dual-filter downsample: the centre plus four bilinear taps on the texel corners,
+// 5 fetches covering a 4x4 source footprint
+void main()
+{
+    vec2 offset = params.source_texel;
+    vec3 sum = texture(source, fragUV).rgb * 4.0;
+    sum += texture(source, fragUV - offset).rgb;
+    sum += texture(source, fragUV + offset).rgb;
+    sum += texture(source, fragUV + vec2(offset.x, -offset.y)).rgb;
+    sum += texture(source, fragUV - vec2(offset.x, -offset.y)).rgb;
+    vec3 color = sum / 8.0;
+
+    if (params.prefilter > 0.5)
+    {
+        color = prefilterColor(color);
+    }
+    fragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,33 @@
+#version 450
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 0) out vec4 fragColor;
+
+layout(set = 2, binding = 0) uniform sampler2D source;
+
+layout(set = 3, binding = 0) uniform BloomParams {
+    vec2 source_texel;  // 1 / source size
+    float threshold;
+    float knee;
+    float prefilter;
+    float padding0;
+    float padding1;
+    float padding2;
+} params;
+
+// Dual-filter upsample: an 8-tap tent around the pixel, blended additively onto the
+// level above by the pipeline
+void main()
+{
+    vec2 offset = params.source_texel;
+    vec3 sum = texture(source, fragUV + vec2(-offset.x * 2.0, 0.0)).rgb;
+    sum += texture(source, fragUV + vec2(-offset.x, offset.y)).rgb * 2.0;
+    sum += texture(source, fragUV + vec2(0.0, offset.y * 2.0)).rgb;
+    sum += texture(source, fragUV + vec2(offset.x, offset.y)).rgb * 2.0;
+    sum += texture(source, fragUV + vec2(offset.x * 2.0, 0.0)).rgb;
+    sum += texture(source, fragUV + vec2(offset.x, -offset.y)).rgb * 2.0;
+    sum += texture(source, fragUV + vec2(0.0, -offset.y * 2.0)).rgb;
+    sum += texture(source, fragUV + vec2(-offset.x, -offset.y)).rgb * 2.0;
+
+    fragColor = vec4(sum / 12.0, 1.0);
+}
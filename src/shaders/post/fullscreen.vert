@@ -0,0 +1,11 @@
+#version 450
+
+// Texture space, (0, 0) at the top left
+layout(location = 0) out vec2 fragUV;
+
+// One triangle covering the screen, from the vertex index alone
+void main() {
+    vec2 position = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+    gl_Position = vec4(position, 0.0, 1.0);
+    fragUV = vec2(position.x * 0.5 + 0.5, 0.5 - position.y * 0.5);
+}
@@ -0,0 +1,39 @@
+#version 450
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 0) out vec4 fragColor;
+
+layout(set = 2, binding = 0) uniform sampler2D scene;
+layout(set = 2, binding = 1) uniform sampler2D bloom;
+
+layout(set = 3, binding = 0) uniform TonemapParams {
+    float exposure;
+    float bloom_strength;  // Already divided by the number of bloom levels
+    float encode_srgb;     // 1 when the output is UNORM and needs encoding here
+    float padding;
+} params;
+
+// Narkowicz's fit of the ACES filmic curve: highlights roll off instead of clipping
+vec3 tonemapACES(vec3 x)
+{
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+vec3 tosRGB(vec3 inputColor)
+{
+    vec3 low = inputColor * 12.92;
+    vec3 high = 1.055 * pow(inputColor, vec3(1.0 / 2.4)) - 0.055;
+    return mix(high, low, lessThanEqual(inputColor, vec3(0.0031308)));
+}
+
+void main()
+{
+    vec3 color = texture(scene, fragUV).rgb + texture(bloom, fragUV).rgb * params.bloom_strength;
+    color = tonemapACES(color * params.exposure);
+
+    if (params.encode_srgb > 0.5)
+    {
+        color = tosRGB(color);
+    }
+    fragColor = vec4(color, 1.0);
+}